@@ -99,7 +99,7 @@ private:
             return (!_filter || _filter(rec, 0));
         }
         _docRevID = _database->documentFactory().revIDFromVersion(rec.version());
-        _docFlags = (C4DocumentFlags)rec.flags() | kDocExists;
+        _docFlags = (C4DocumentFlags)publicFlags(rec.flags()) | kDocExists;
         auto optFlags = _options.flags;
         return (optFlags & kC4IncludeNonConflicted ||  (_docFlags & ::kDocConflicted))
             && (!_filter || _filter(rec, _docFlags));
@@ -115,6 +115,55 @@ private:
 };
 
 
+bool c4db_getDocInfos(C4Database *database,
+                      const C4String docIDs[],
+                      size_t count,
+                      C4DocumentInfo outInfos[],
+                      C4SliceResult *outRevIDStorage,
+                      C4Error *outError) noexcept
+{
+    *outRevIDStorage = {};
+    return tryCatch(outError, [&]{
+        vector<slice> keys;
+        keys.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            keys.emplace_back(docIDs[i]);
+        auto recs = database->defaultKeyStore().getMany(keys, kMetaOnly);
+
+        // Collect the revIDs, then copy them all into a single buffer owned by the caller:
+        vector<alloc_slice> revIDs(count);
+        size_t totalSize = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (recs[i].exists()) {
+                revIDs[i] = database->documentFactory().revIDFromVersion(recs[i].version());
+                totalSize += revIDs[i].size;
+            }
+        }
+        alloc_slice storage(totalSize);
+        auto dst = (uint8_t*)storage.buf;
+        for (size_t i = 0; i < count; ++i) {
+            const Record &rec = recs[i];
+            C4DocumentInfo &info = outInfos[i];
+            info.docID = docIDs[i];
+            if (rec.exists()) {
+                memcpy(dst, revIDs[i].buf, revIDs[i].size);
+                info.revID = slice(dst, revIDs[i].size);
+                dst += revIDs[i].size;
+                info.flags = (C4DocumentFlags)publicFlags(rec.flags()) | kDocExists;
+                info.sequence = rec.sequence();
+                info.bodySize = rec.bodySize();
+            } else {
+                info.revID = kC4SliceNull;
+                info.flags = 0;
+                info.sequence = 0;
+                info.bodySize = 0;
+            }
+        }
+        *outRevIDStorage = sliceResult(storage);
+    });
+}
+
+
 void c4enum_close(C4DocEnumerator *e) noexcept {
     if (e)
         e->close();
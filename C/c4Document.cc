@@ -49,6 +49,37 @@ C4Document* c4doc_get(C4Database *database,
 }
 
 
+bool c4db_getDocs(C4Database *database,
+                  const C4String docIDs[],
+                  size_t count,
+                  C4Document* outDocs[],
+                  C4Error *outError) noexcept
+{
+    return tryCatch(outError, [&]{
+        vector<slice> keys;
+        keys.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            keys.emplace_back(docIDs[i]);
+        auto recs = database->defaultKeyStore().getMany(keys);
+
+        for (size_t i = 0; i < count; ++i)
+            outDocs[i] = nullptr;
+        try {
+            for (size_t i = 0; i < count; ++i) {
+                if (recs[i].exists())
+                    outDocs[i] = database->documentFactory().newDocumentInstance(recs[i]);
+            }
+        } catch (...) {
+            for (size_t i = 0; i < count; ++i) {
+                c4doc_free(outDocs[i]);
+                outDocs[i] = nullptr;
+            }
+            throw;
+        }
+    });
+}
+
+
 C4Document* c4doc_getBySequence(C4Database *database,
                                 C4SequenceNumber sequence,
                                 C4Error *outError) noexcept
@@ -343,6 +374,38 @@ C4Document* c4doc_put(C4Database *database,
 }
 
 
+bool c4db_putDocs(C4Database *database,
+                  const C4DocPutRequest requests[],
+                  size_t count,
+                  C4Error outDocErrors[],
+                  C4Error *outError) noexcept
+{
+    if (!c4db_beginTransaction(database, outError))
+        return false;
+    bool ok = tryCatch(outError, [&]{
+        Database::BatchedSaves batch(database);
+        for (size_t i = 0; i < count; ++i) {
+            C4DocPutRequest rq = requests[i];
+            rq.save = true;
+            C4Error docError = {};
+            C4Document *doc = c4doc_put(database, &rq, nullptr, &docError);
+            if (doc) {
+                docError = {};
+                c4doc_free(doc);
+            }
+            if (outDocErrors)
+                outDocErrors[i] = docError;
+        }
+        batch.end();
+    });
+    if (!ok) {
+        c4db_endTransaction(database, false, nullptr);
+        return false;
+    }
+    return c4db_endTransaction(database, true, outError);
+}
+
+
 C4Document* c4doc_create(C4Database *db,
                          C4String docID,
                          C4Slice revBody,
@@ -20,17 +20,23 @@
 #include "DataFile.hh"
 #include "Query.hh"
 #include "Record.hh"
+#include "SequenceTracker.hh"
 #include <math.h>
 #include <limits.h>
+#include <algorithm>
 #include <mutex>
+#include <unordered_map>
 using namespace litecore;
+using namespace std::placeholders;
 
 
 #pragma mark COMMON CODE:
 
 
 CBL_CORE_API const C4QueryOptions kC4DefaultQueryOptions = {
-    true
+    true,
+    false,
+    false
 };
 
 
@@ -87,6 +93,11 @@ struct C4QueryEnumeratorImpl : public C4QueryEnumerator, C4InstanceCounted {
         populatePublicFields();
     }
 
+    bool nextBatch(QueryBatch &batch, unsigned maxRows) {
+        clearPublicFields();
+        return enumerator().nextBatch(batch, maxRows);
+    }
+
     void clearPublicFields() {
         ::memset((C4QueryEnumerator*)this, 0, sizeof(C4QueryEnumerator));
     }
@@ -123,6 +134,44 @@ private:
 static C4QueryEnumeratorImpl* internal(C4QueryEnumerator *e) {return (C4QueryEnumeratorImpl*)e;}
 
 
+static_assert((int)kC4BatchFleece == (int)QueryBatch::kFleeceColumn,
+              "C4BatchColumnType doesn't match QueryBatch::ColumnType");
+
+
+// Extension of C4QueryBatch; its public fields point into the QueryBatch's arrays.
+struct C4QueryBatchImpl : public C4QueryBatch, C4InstanceCounted {
+    QueryBatch batch;
+    vector<C4BatchColumn> c4Columns;
+
+    void populatePublicFields() {
+        c4Columns.resize(batch.columns.size());
+        for (size_t i = 0; i < c4Columns.size(); ++i) {
+            auto &col = batch.columns[i];
+            auto &c4col = c4Columns[i];
+            c4col = {};
+            c4col.type = (C4BatchColumnType)col.type;
+            c4col.isNull = col.isNull.data();
+            switch (col.type) {
+                case QueryBatch::kIntColumn:    c4col.ints = col.ints.data(); break;
+                case QueryBatch::kDoubleColumn: c4col.doubles = col.doubles.data(); break;
+                case QueryBatch::kBoolColumn:   c4col.bools = col.bools.data(); break;
+                case QueryBatch::kStringColumn:
+                case QueryBatch::kBlobColumn:
+                case QueryBatch::kFleeceColumn:
+                    c4col.offsets = col.offsets.data();
+                    c4col.data = col.data.data();
+                    break;
+                default:
+                    break;
+            }
+        }
+        rowCount = batch.rowCount;
+        columnCount = (uint32_t)c4Columns.size();
+        columns = c4Columns.data();
+    }
+};
+
+
 #pragma mark - QUERY:
 
 
@@ -141,6 +190,24 @@ void c4query_free(C4Query *query) noexcept {
 }
 
 
+void c4db_setQueryCacheSize(C4Database *database, unsigned maxQueries) noexcept {
+    tryCatch(nullptr, [&]{
+        database->defaultKeyStore().setQueryCacheSize(maxQueries);
+    });
+}
+
+
+C4QueryCacheStats c4db_getQueryCacheStats(C4Database *database) noexcept {
+    C4QueryCacheStats stats = {};
+    tryCatch(nullptr, [&]{
+        auto ksStats = database->defaultKeyStore().queryCacheStats();
+        stats.hits = ksStats.hits;
+        stats.misses = ksStats.misses;
+    });
+    return stats;
+}
+
+
 unsigned c4query_columnCount(C4Query *query) noexcept {
     return query->query()->columnCount();
 }
@@ -161,6 +228,10 @@ C4QueryEnumerator* c4query_run(C4Query *query,
     return tryCatch<C4QueryEnumerator*>(outError, [&]{
         Query::Options options;
         options.paramBindings = encodedParameters;
+        if (c4options) {
+            options.streaming = c4options->streaming;
+            options.allowStaleFullText = c4options->allowStaleFullText;
+        }
         return new C4QueryEnumeratorImpl(query, &options);
     });
 }
@@ -187,6 +258,30 @@ C4SliceResult c4query_fullTextMatched(C4Query *query,
 }
 
 
+unsigned c4query_fullTextMatchCount(C4Query *query) noexcept {
+    return query->query()->fullTextMatchCount();
+}
+
+
+bool c4query_fullTextMatchedBatch(C4Query *query,
+                                  const C4FullTextID fullTextIDs[],
+                                  size_t count,
+                                  C4SliceResult outTexts[],
+                                  C4Error *outError) noexcept
+{
+    return tryCatch<bool>(outError, [&]{
+        vector<Query::FullTextID> ids(fullTextIDs, fullTextIDs + count);
+        auto texts = query->query()->getMatchedTexts(ids);
+        unsigned nMatches = query->query()->fullTextMatchCount();
+        for (size_t i = 0; i < count; ++i) {
+            for (unsigned m = 0; m < nMatches; ++m)
+                outTexts[i * nMatches + m] = sliceResult(texts[i][m]);
+        }
+        return true;
+    });
+}
+
+
 #pragma mark - QUERY ENUMERATOR:
 
 
@@ -202,6 +297,29 @@ bool c4queryenum_next(C4QueryEnumerator *e,
 }
 
 
+C4QueryBatch* c4queryenum_nextBatch(C4QueryEnumerator *e,
+                                    uint32_t maxRows,
+                                    C4Error *outError) noexcept
+{
+    return tryCatch<C4QueryBatch*>(outError, [&]() -> C4QueryBatch* {
+        if (maxRows == 0)
+            error::_throw(error::InvalidParameter);
+        unique_ptr<C4QueryBatchImpl> batch(new C4QueryBatchImpl);
+        if (!internal(e)->nextBatch(batch->batch, maxRows)) {
+            clearError(outError);      // end of iteration is not an error
+            return nullptr;
+        }
+        batch->populatePublicFields();
+        return batch.release();
+    });
+}
+
+
+void c4querybatch_free(C4QueryBatch *batch) noexcept {
+    delete (C4QueryBatchImpl*)batch;
+}
+
+
 bool c4queryenum_seek(C4QueryEnumerator *e,
                       uint64_t rowIndex,
                       C4Error *outError) noexcept
@@ -245,6 +363,195 @@ void c4queryenum_free(C4QueryEnumerator *e) noexcept {
 }
 
 
+#pragma mark - QUERY OBSERVER:
+
+
+struct c4QueryObserver : public C4InstanceCounted {
+    c4QueryObserver(C4Query *query, C4Slice encodedParameters,
+                    C4QueryObserverCallback callback, void *context)
+    :_database(query->database()),
+     _query(query->query()),
+     _callback(callback),
+     _context(context),
+     _notifier(_database->sequenceTracker(),
+               bind(&c4QueryObserver::dispatchCallback, this, _1))
+    {
+        _options.paramBindings = encodedParameters;
+    }
+
+
+    void dispatchCallback(DatabaseChangeNotifier&) {
+        _callback(this, _context);
+    }
+
+
+    uint32_t getChanges(C4QueryRowChange outChanges[], uint32_t maxChanges) {
+        if (_nextPending >= _pending.size()) {
+            _pending.clear();
+            _nextPending = 0;
+            update();
+        }
+        uint32_t n = 0;
+        for (; n < maxChanges && _nextPending < _pending.size(); ++n, ++_nextPending) {
+            auto &change = _pending[_nextPending];
+            outChanges[n].type = change.type;
+            outChanges[n].docID = toc4slice(change.docID);
+            outChanges[n].columns = (FLArray)fleece::Value::fromTrustedData(change.row)->asArray();
+        }
+        return n;
+    }
+
+private:
+    struct RowChange {
+        C4QueryRowChangeType type;
+        alloc_slice docID;
+        alloc_slice row;
+    };
+
+    // Reads the database changes since the last call, and adds the resulting row changes to
+    // _pending. The first call reports all the rows of the query.
+    void update() {
+        vector<alloc_slice> docIDs;
+        {
+            lock_guard<mutex> lock(_notifier.tracker.mutex());
+            SequenceTracker::Change changes[100];
+            bool external;
+            size_t n;
+            while ((n = _notifier.readChanges(changes, 100, external)) > 0) {
+                for (size_t i = 0; i < n; ++i)
+                    docIDs.emplace_back(changes[i].docID);
+            }
+        }
+
+        if (!_started) {
+            _started = true;
+            if (_query->isPerDocument()) {
+                _query->getRowsByDocID(&_options, [&](slice docID, slice row) {
+                    alloc_slice id(docID), data(row);
+                    _rowsByDocID.emplace(id, data);
+                    _pending.push_back({kC4QueryRowAdded, id, data});
+                });
+            } else {
+                _rows = runQuery();
+                for (auto &row : _rows)
+                    _pending.push_back({kC4QueryRowAdded, alloc_slice(), row});
+            }
+        } else if (!docIDs.empty()) {
+            if (_query->isPerDocument())
+                updateDocuments(docIDs);
+            else
+                updateAllRows();
+        }
+    }
+
+    // Re-evaluates the query against just the documents that changed.
+    void updateDocuments(const vector<alloc_slice> &docIDs) {
+        for (auto &docID : docIDs) {
+            alloc_slice row = _query->getRowForDocID(docID, &_options);
+            auto i = _rowsByDocID.find(docID);
+            if (i == _rowsByDocID.end()) {
+                if (row.buf) {
+                    _rowsByDocID.emplace(docID, row);
+                    _pending.push_back({kC4QueryRowAdded, docID, row});
+                }
+            } else if (!row.buf) {
+                _pending.push_back({kC4QueryRowRemoved, docID, i->second});
+                _rowsByDocID.erase(i);
+            } else if (slice(row) != slice(i->second)) {
+                i->second = row;
+                _pending.push_back({kC4QueryRowChanged, docID, row});
+            }
+        }
+    }
+
+    // Re-runs the entire query and diffs its rows against the previous ones.
+    void updateAllRows() {
+        vector<alloc_slice> newRows = runQuery();
+        auto o = _rows.begin(), n = newRows.begin();
+        while (o != _rows.end() || n != newRows.end()) {
+            int cmp = (o == _rows.end()) ? 1 : (n == newRows.end()) ? -1 : slice(*o).compare(*n);
+            if (cmp < 0)
+                _pending.push_back({kC4QueryRowRemoved, alloc_slice(), *o++});
+            else if (cmp > 0)
+                _pending.push_back({kC4QueryRowAdded, alloc_slice(), *n++});
+            else
+                ++o, ++n;
+        }
+        _rows = move(newRows);
+    }
+
+    // Runs the query, returning its rows' encoded columns in sorted order (for diffing.)
+    vector<alloc_slice> runQuery() {
+        vector<alloc_slice> rows;
+        unique_ptr<QueryEnumerator> e(_query->createEnumerator(&_options));
+        fleece::Encoder enc;
+        while (e->next()) {
+            enc.reset();
+            enc.beginArray();
+            for (auto col = e->columns(); col; ++col)
+                enc.writeValue(col.value());
+            enc.endArray();
+            rows.push_back(enc.extractOutput());
+        }
+        sort(rows.begin(), rows.end(), [](const alloc_slice &a, const alloc_slice &b) {
+            return slice(a).compare(b) < 0;
+        });
+        return rows;
+    }
+
+public:
+    Retained<Database> _database;
+    Retained<Query> _query;
+    Query::Options _options;
+    C4QueryObserverCallback _callback;
+    void *_context;
+    DatabaseChangeNotifier _notifier;
+    //NOTE: Order of members is important! _notifier needs to appear after _database so that it
+    // will be destructed *before* _database (see c4DatabaseObserver.)
+
+private:
+    bool _started {false};
+    unordered_map<alloc_slice, alloc_slice, fleece::sliceHash> _rowsByDocID; // per-document
+    vector<alloc_slice> _rows;                                  // otherwise, sorted
+    vector<RowChange> _pending;
+    size_t _nextPending {0};
+};
+
+
+C4QueryObserver* c4queryobs_create(C4Query *query,
+                                   C4Slice encodedParameters,
+                                   C4QueryObserverCallback callback,
+                                   void *context,
+                                   C4Error *outError) noexcept
+{
+    return tryCatch<C4QueryObserver*>(outError, [&]{
+        lock_guard<mutex> lock(query->database()->sequenceTracker().mutex());
+        return new c4QueryObserver(query, encodedParameters, callback, context);
+    });
+}
+
+
+uint32_t c4queryobs_getChanges(C4QueryObserver *obs,
+                               C4QueryRowChange outChanges[],
+                               uint32_t maxChanges,
+                               C4Error *outError) noexcept
+{
+    return tryCatch<uint32_t>(outError, [&]{
+        clearError(outError);
+        return obs->getChanges(outChanges, maxChanges);
+    });
+}
+
+
+void c4queryobs_free(C4QueryObserver *obs) noexcept {
+    if (obs) {
+        Retained<Database> retainDB(obs->_database);   // keep db from being deleted too early
+        lock_guard<mutex> lock(obs->_notifier.tracker.mutex());
+        delete obs;
+    }
+}
+
+
 #pragma mark - INDEXES:
 
 
@@ -266,6 +573,69 @@ bool c4db_createIndex(C4Database *database,
 }
 
 
+bool c4db_updateDeferredIndexes(C4Database *database,
+                                unsigned maxDocs,
+                                bool *outDone,
+                                C4Error *outError) noexcept
+{
+    return tryCatch(outError, [&]{
+        *outDone = database->defaultKeyStore().updateDeferredIndexes(maxDocs);
+    });
+}
+
+
+struct c4IndexBuilder : C4InstanceCounted {
+    c4IndexBuilder(Database *db, unique_ptr<KeyStore::IndexBuilder> builder)
+    :database(db)
+    ,builder(move(builder))
+    { }
+
+    Retained<Database> database;
+    unique_ptr<KeyStore::IndexBuilder> builder;
+};
+
+
+C4IndexBuilder* c4db_beginIndexBuild(C4Database *database,
+                                     C4Slice name,
+                                     C4Slice expressionsJSON,
+                                     C4IndexType indexType,
+                                     const C4IndexOptions *indexOptions,
+                                     C4Error *outError) noexcept
+{
+    return tryCatch<C4IndexBuilder*>(outError, [&]{
+        auto builder = database->defaultKeyStore().beginIndexBuild(
+                                                (string)name,
+                                                (string)expressionsJSON,
+                                                (KeyStore::IndexType)indexType,
+                                                (const KeyStore::IndexOptions*)indexOptions);
+        return new c4IndexBuilder(database, move(builder));
+    });
+}
+
+
+bool c4indexbuilder_step(C4IndexBuilder *builder,
+                         unsigned maxDocs,
+                         bool *outDone,
+                         C4Error *outError) noexcept
+{
+    return tryCatch(outError, [&]{
+        *outDone = builder->builder->step(maxDocs);
+    });
+}
+
+
+float c4indexbuilder_getProgress(C4IndexBuilder *builder) noexcept {
+    return tryCatch<float>(nullptr, [&]{
+        return builder->builder->progress();
+    });
+}
+
+
+void c4indexbuilder_free(C4IndexBuilder *builder) noexcept {
+    delete builder;
+}
+
+
 bool c4db_deleteIndex(C4Database *database,
                       C4Slice name,
                       C4Error *outError) noexcept
@@ -281,3 +651,12 @@ C4SliceResult c4db_getIndexes(C4Database* database, C4Error* outError) noexcept
         return sliceResult(database->defaultKeyStore().getIndexes());
     });
 }
+
+bool c4db_materializeProperty(C4Database *database,
+                              C4Slice propertyPath,
+                              C4Error *outError) noexcept
+{
+    return tryCatch(outError, [&]{
+        database->defaultKeyStore().materializeProperty((string)propertyPath);
+    });
+}
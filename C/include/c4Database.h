@@ -35,6 +35,7 @@ extern "C" {
         kC4DB_SharedKeys    = 0x10, ///< Enable shared-keys optimization at creation time
         kC4DB_NoUpgrade     = 0x20, ///< Disable upgrading an older-version database
         kC4DB_NonObservable = 0x40, ///< Disable c4DatabaseObserver
+        kC4DB_CompressBodies= 0x80, ///< Store large document bodies compressed (Snappy)
     };
 
     /** Document versioning system (also determines database storage schema) */
@@ -54,6 +54,26 @@ extern "C" {
     } C4DocumentInfo;
 
 
+    /** Looks up the metadata of multiple documents at once, without reading their bodies.
+        This is much faster than calling c4doc_get() in a loop.
+        @param database  The database.
+        @param docIDs  An array of document IDs.
+        @param count  The number of items in docIDs.
+        @param outInfos  An array of `count` structs that will be filled in. The docID of each
+                        points to the corresponding input docID. A document that doesn't exist
+                        has flags 0 (no kDocExists) and a null revID.
+        @param outRevIDStorage  Will be set to a buffer containing the revIDs that the infos
+                        point to. The caller must free it with c4slice_free when done.
+        @param outError  Error will be stored here on failure.
+        @return  True on success, false on error. */
+    bool c4db_getDocInfos(C4Database *database C4NONNULL,
+                          const C4String docIDs[],
+                          size_t count,
+                          C4DocumentInfo outInfos[],
+                          C4SliceResult *outRevIDStorage C4NONNULL,
+                          C4Error *outError) C4API;
+
+
     /** Opaque handle to a document enumerator. */
     typedef struct C4DocEnumerator C4DocEnumerator;
 
@@ -78,6 +78,22 @@ extern "C" {
                                     C4SequenceNumber,
                                     C4Error *outError) C4API;
 
+    /** Gets multiple documents at once, looking up all the IDs in a single batched query.
+        This is much faster than calling c4doc_get() in a loop.
+        @param database  The database.
+        @param docIDs  An array of document IDs.
+        @param count  The number of items in docIDs.
+        @param outDocs  An array of `count` pointers. On success each will be set to the
+                        corresponding document, or to NULL if that document doesn't exist.
+                        Caller is responsible for freeing the documents.
+        @param outError  Error will be stored here on failure.
+        @return  True on success, false on error (in which case no documents are returned.) */
+    bool c4db_getDocs(C4Database *database C4NONNULL,
+                      const C4String docIDs[],
+                      size_t count,
+                      C4Document* outDocs[],
+                      C4Error *outError) C4API;
+
     /** Saves changes to a C4Document.
         Must be called within a transaction.
         The revision history will be pruned to the maximum depth given. */
@@ -261,6 +277,25 @@ extern "C" {
                           size_t *outCommonAncestorIndex,
                           C4Error *outError) C4API;
 
+    /** Saves multiple revisions in a single transaction. This is much faster than calling
+        c4doc_put in a loop, since it shares one transaction and one round of change notification
+        between all the documents.
+        Each request is handled as by c4doc_put, except that the document is always saved (the
+        request's `save` field is ignored) and isn't returned. A request that fails doesn't stop
+        the others from being saved.
+        @param database  The database.
+        @param requests  An array of put requests.
+        @param count  The number of items in requests.
+        @param outDocErrors  If non-NULL, an array of `count` errors. Each will be set to the error
+                        from the corresponding request, or to a zero code if it succeeded.
+        @param outError  Error will be stored here if the transaction itself fails.
+        @return  True if the transaction was committed, false if it failed. */
+    bool c4db_putDocs(C4Database *database C4NONNULL,
+                      const C4DocPutRequest requests[],
+                      size_t count,
+                      C4Error outDocErrors[],
+                      C4Error *outError) C4API;
+
     /** Convenience function to create a new document. This just a wrapper around c4doc_put.
         If the document already exists, it will fail with the error kC4ErrorConflict.
         @param db  The database to create the document in
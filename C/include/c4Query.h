@@ -57,16 +57,40 @@ extern "C" {
     C4StringResult c4query_nameOfColumn(C4Query *query, unsigned col) C4API;
 
 
+    //////// QUERY CACHE:
+
+
+    /** Statistics about a database's cache of compiled queries. */
+    typedef struct {
+        uint64_t hits;          ///< Number of c4query_new calls that reused a cached query
+        uint64_t misses;        ///< Number of c4query_new calls that compiled a new query
+    } C4QueryCacheStats;
+
+    /** Sets the maximum number of compiled queries the database keeps cached.
+        c4query_new reuses a cached query's SQL translation when its expression is byte-for-byte
+        identical, skipping parsing; each C4Query still gets its own SQLite statements. The cache
+        is cleared whenever the schema changes, e.g. when an index is created or deleted, even
+        through another C4Database instance on the same file. The default size is 32; 0 disables
+        caching. */
+    void c4db_setQueryCacheSize(C4Database *database C4NONNULL, unsigned maxQueries) C4API;
+
+    /** Returns the hit and miss counts of the database's query cache. */
+    C4QueryCacheStats c4db_getQueryCacheStats(C4Database *database C4NONNULL) C4API;
+
+
     //////// RUNNING QUERIES:
 
 
     /** Options for running queries. */
     typedef struct {
         bool rankFullText;      ///< Should full-text results be ranked by relevance?
+        bool streaming;         ///< Return rows as they're found, instead of pre-recording them
+        bool allowStaleFullText;///< Don't wait for deferred full-text indexes to catch up
     } C4QueryOptions;
 
 
-    /** Default query options. Has skip=0, limit=UINT_MAX, rankFullText=true. */
+    /** Default query options. Has skip=0, limit=UINT_MAX, rankFullText=true, streaming=false,
+        allowStaleFullText=false. */
 	CBL_CORE_API extern const C4QueryOptions kC4DefaultQueryOptions;
 
 
@@ -99,11 +123,24 @@ extern "C" {
     /** Runs a compiled query.
         NOTE: Queries will run much faster if the appropriate properties are indexed.
         Indexes must be created explicitly by calling `c4db_createIndex`.
+
+        By default all the result rows are collected before this function returns. If the
+        `streaming` option is set, rows are instead read from the database as the enumerator is
+        advanced: the first row arrives sooner and memory use stays flat, but
+        `c4queryenum_getRowCount` and `c4queryenum_seek` aren't supported, and
+        `c4queryenum_refresh` returns a new enumerator whenever the database has changed at all.
+        A streaming enumerator holds a read snapshot of the database until it reaches the end or
+        is closed. Outside a transaction, queries run on a pooled read-only connection, so the
+        snapshot isn't affected by later changes; but a streaming query run inside a transaction
+        shares that transaction's connection, and may or may not see changes made meanwhile.
         @param query  The compiled query to run.
-        @param options  Query options; only `skip` and `limit` are currently recognized.
+        @param options  Query options; `streaming` and `allowStaleFullText` are recognized.
+                `rankFullText` is currently ignored: to rank full-text matches, use the
+                `rank()` function in the query's ORDER_BY.
         @param encodedParameters  Optional JSON object whose keys correspond to the named
                 parameters in the query expression, and values correspond to the values to
-                bind. Any unbound parameters will be `null`.
+                bind. Any unbound parameters will be `null`. A parameter used as the right
+                side of `IN` can be bound to an array, to match any of its items.
         @param outError  On failure, will be set to the error status.
         @return  An enumerator for reading the rows, or NULL on error. */
     C4QueryEnumerator* c4query_run(C4Query *query C4NONNULL,
@@ -117,21 +154,92 @@ extern "C" {
                                            C4FullTextID fullTextID,
                                            C4Error *outError) C4API;
 
+    /** Returns the number of full-text ('MATCH') expressions in the query. */
+    unsigned c4query_fullTextMatchCount(C4Query *query C4NONNULL) C4API;
+
+    /** Returns the text matched in a batch of query rows -- such as a page of search results to
+        be displayed -- in a single call, which is much faster than calling
+        `c4query_fullTextMatched` for each row. The text is read from the full-text indexes,
+        so the term offsets in each row's `fullTextTerms` are byte ranges within it.
+        @param query  The compiled query.
+        @param fullTextIDs  The `fullTextID`s of the rows.
+        @param count  The number of rows.
+        @param outTexts  An array of `count * c4query_fullTextMatchCount(query)` slices, which
+                will be filled in row by row with the text matched by each MATCH expression, in
+                order of appearance in the query. An entry is null if its row has no text. The
+                caller must free each entry with `c4slice_free`.
+        @param outError  On failure, will be set to the error status.
+        @return  True on success, false on failure. */
+    bool c4query_fullTextMatchedBatch(C4Query *query C4NONNULL,
+                                      const C4FullTextID fullTextIDs[],
+                                      size_t count,
+                                      C4SliceResult outTexts[],
+                                      C4Error *outError) C4API;
+
     /** Advances a query enumerator to the next row, populating its fields.
         Returns true on success, false at the end of enumeration or on error. */
     bool c4queryenum_next(C4QueryEnumerator *e C4NONNULL,
                           C4Error *outError) C4API;
 
+    /** Types of columns in a C4QueryBatch. */
+    typedef C4_ENUM(uint8_t, C4BatchColumnType) {
+        kC4BatchNull,               ///< Every value is null or missing
+        kC4BatchInt,                ///< Values are in `ints`
+        kC4BatchDouble,             ///< Values are in `doubles`
+        kC4BatchBool,               ///< Values are in `bools`
+        kC4BatchString,             ///< UTF-8 strings, in `data` delimited by `offsets`
+        kC4BatchBlob,               ///< Binary data, in `data` delimited by `offsets`
+        kC4BatchFleece,             ///< Mixed or collection values, as encoded Fleece in `data`
+    };
+
+    /** One column of a C4QueryBatch. Only the arrays for the column's type are non-NULL.
+        Each has an entry for every row; a null or missing value has a zero or empty one. */
+    typedef struct {
+        C4BatchColumnType type;
+        const uint8_t *isNull;              ///< Nonzero if the row's value is null or missing
+        const int64_t *ints;
+        const double *doubles;
+        const uint8_t *bools;
+        const uint32_t *offsets;            ///< Row i's value is data[offsets[i]..offsets[i+1])
+        const uint8_t *data;
+    } C4BatchColumn;
+
+    /** A batch of query rows in columnar form, returned by `c4queryenum_nextBatch`. */
+    typedef struct {
+        uint32_t rowCount;
+        uint32_t columnCount;
+        const C4BatchColumn *columns;
+    } C4QueryBatch;
+
+    /** Reads up to `maxRows` rows from a query enumerator at once, in columnar form: each
+        column's values are in one array, so they can be handed to a consumer without a call per
+        row. A column of values of differing types is widened without losing anything: mixed
+        integers and doubles become doubles if every integer is exactly representable as one, and
+        anything else (including booleans mixed with numbers, and unsigned integers too large for
+        `ints`) becomes Fleece.
+        The enumerator's own fields are cleared; `c4queryenum_next` continues after the batch.
+        @param e  The query enumerator
+        @param maxRows  The maximum number of rows to read; must be nonzero.
+        @param outError  On failure, an error will be stored here.
+        @return  A batch, which must be freed with `c4querybatch_free`, or NULL at the end of the
+                rows or on error. */
+    C4QueryBatch* c4queryenum_nextBatch(C4QueryEnumerator *e C4NONNULL,
+                                        uint32_t maxRows,
+                                        C4Error *outError) C4API;
+
+    /** Frees a batch returned by `c4queryenum_nextBatch`. */
+    void c4querybatch_free(C4QueryBatch *batch) C4API;
+
     /** Returns the total number of rows in the query, if known.
-        Not all query enumerators may support this (but the current implementation does.)
+        Not all query enumerators may support this (streaming ones don't.)
         @param e  The query enumerator
         @param outError  On failure, an error will be stored here (probably kC4ErrorUnsupported.)
         @return  The number of rows, or -1 on failure. */
     int64_t c4queryenum_getRowCount(C4QueryEnumerator *e C4NONNULL,
                                      C4Error *outError) C4API;
 
-    /** Jumps to a specific row. Not all query enumerators may support this (but the current
-        implementation does.)
+    /** Jumps to a specific row. Not all query enumerators may support this (streaming ones
+        don't.)
         @param e  The query enumerator
         @param rowIndex  The number of the row, starting at 0
         @param outError  On failure, an error will be stored here (probably kC4ErrorUnsupported.)
@@ -155,6 +263,84 @@ extern "C" {
     /** @} */
 
 
+    //////// LIVE QUERIES:
+
+
+    /** \defgroup QueryObserver  Query Observers
+        @{ */
+
+
+    /** Types of changes to a query's result rows. */
+    typedef C4_ENUM(uint8_t, C4QueryRowChangeType) {
+        kC4QueryRowAdded,           ///< A row was added to the results
+        kC4QueryRowRemoved,         ///< A row was removed from the results
+        kC4QueryRowChanged,         ///< A document's row has different column values
+    };
+
+
+    /** A change to a query's results, as reported by `c4queryobs_getChanges`. */
+    typedef struct {
+        C4QueryRowChangeType type;
+        C4String docID;             ///< Document the row comes from (null if not per-document)
+        FLArray columns;            ///< The row's columns (the old values, if it was removed)
+    } C4QueryRowChange;
+
+
+    /** A query-observer reference. */
+    typedef struct c4QueryObserver C4QueryObserver;
+
+    /** Callback invoked by a query observer after the database changes.
+        @param observer  The observer that initiated the callback.
+        @param context  user-defined parameter given when registering the callback. */
+    typedef void (*C4QueryObserverCallback)(C4QueryObserver* observer C4NONNULL,
+                                            void *context);
+
+    /** Creates a "live query": an observer that keeps a query's results up to date as the
+        database changes, and reports the differences as row-level changes.
+        Like a database observer, the callback is called _once_ after the database changes; it
+        won't be called again until the changes have been read with `c4queryobs_getChanges`.
+        The callback may be called on any thread, so it should just schedule a call to
+        `c4queryobs_getChanges` on a thread that can use the database.
+
+        If each result row comes from a single document (i.e. the query has no aggregates,
+        GROUP_BY, DISTINCT, joins, subqueries, LIMIT or OFFSET), only the changed documents are
+        re-evaluated, and changes to documents that don't match the query cost just a key
+        lookup. Otherwise the whole query is re-run and its rows are diffed.
+        @param query  The query to observe. It may be freed before the observer.
+        @param encodedParameters  Optional JSON object of parameter bindings, as for
+                    `c4query_run`.
+        @param callback  The function to call after the database changes.
+        @param context  An arbitrary value that will be passed to the callback.
+        @param outError  On failure, will be set to the error status.
+        @return  The new observer reference, or NULL on failure. */
+    C4QueryObserver* c4queryobs_create(C4Query *query C4NONNULL,
+                                       C4String encodedParameters,
+                                       C4QueryObserverCallback callback C4NONNULL,
+                                       void *context,
+                                       C4Error *outError) C4API;
+
+    /** Returns the changes to the query's results since the last time this function was called.
+        The first call runs the query and reports every result row as added.
+        The memory pointed to by the changes' `docID` and `columns` is valid until the next call
+        or until the observer is freed.
+        @param observer  The observer.
+        @param outChanges  A caller-provided buffer of structs into which changes will be written.
+        @param maxChanges  The size of the caller's outChanges buffer.
+        @param outError  On failure, will be set to the error status; on success, its code is 0.
+        @return  The number of changes written to `outChanges`. If this is less than
+                    `maxChanges`, all changes have been read. */
+    uint32_t c4queryobs_getChanges(C4QueryObserver *observer C4NONNULL,
+                                   C4QueryRowChange outChanges[] C4NONNULL,
+                                   uint32_t maxChanges,
+                                   C4Error *outError) C4API;
+
+    /** Stops a query observer and frees the resources it's using.
+        It is safe to pass NULL to this call. */
+    void c4queryobs_free(C4QueryObserver*) C4API;
+
+    /** @} */
+
+
     //////// INDEXES:
 
 
@@ -166,7 +352,8 @@ extern "C" {
     typedef C4_ENUM(uint32_t, C4IndexType) {
         kC4ValueIndex,         ///< Regular index of property value
         kC4FullTextIndex,      ///< Full-text index
-        kC4GeoIndex,           ///< Geospatial index of GeoJSON values (NOT YET IMPLEMENTED)
+        kC4GeoIndex,           ///< Geospatial (R-tree) index of numeric coordinates
+        kC4ArrayIndex,         ///< Index of the elements of an array property
     };
 
 
@@ -184,12 +371,25 @@ extern "C" {
         /** Should diacritical marks (accents) be ignored? Defaults to false.
             Generally this should be left false for non-English text. */
         bool ignoreDiacritics;
+
+        /** Full-text only: if true, saving a document doesn't tokenize its text, it just adds
+            the document to a queue. The queue is indexed by `c4db_updateDeferredIndexes`, which
+            can be called on a background thread, and by any query that uses the index and
+            doesn't set the `allowStaleFullText` option. Defaults to false. */
+        bool deferred;
+
+        /** Full-text only: a comma-separated list of prefix lengths, such as "1,2,3", to build
+            extra indexes for. These make prefix searches like "ab*" that are no longer than one
+            of the lengths much faster (useful for search-as-you-type), at the cost of a bigger
+            index. If left null, prefix searches scan all the terms in the index instead. */
+        const char *prefixLengths;
     } C4IndexOptions;
 
 
     /** Creates a database index, of the values of specific expressions across all documents.
         The name is used to identify the index for later updating or deletion; if an index with the
-        same name already exists, it will be replaced unless it has the exact same expressions.
+        same name already exists, it will be replaced unless it has the exact same expressions and
+        options. (So re-creating a full-text index with different `prefixLengths` rebuilds it.)
 
         Currently two types of indexes are supported:
 
@@ -202,6 +402,15 @@ extern "C" {
           search: a query with a `MATCH` operator will fail to compile unless there is already a
           FTS index for the property/expression being matched. Only a single expression is
           currently allowed, and it must evaluate to a string.
+        * Geo indexes store each document as a point, whose coordinates are the numeric values of
+          the 1 to 5 expressions (e.g. `[[".lat"], [".lon"]]`), in an R-tree. They speed up
+          `["WITHIN", <expressions>, [<min>, ...], [<max>, ...]]` queries, which match the
+          documents whose values are all within their ranges; the expressions must be written
+          exactly as in the index. Documents with a non-numeric value are left out of the index.
+        * Array indexes store the elements of an array property, so that queries of the form
+          `ANY x IN array SATISFIES <predicate of x>` can look up matching documents instead of
+          iterating every document's array. The single expression must be a property, and the
+          predicate can't refer to properties of `x` (like `x.name`) or it won't use the index.
 
         Note: If the value of an expression in some document is missing or an unsupported type,
         that document will just be omitted from the index. It's not an error.
@@ -210,15 +419,22 @@ extern "C" {
         `[[".name.first"]]` will index on the first-name property. Note the two levels of brackets,
         since an expression is already an array.
 
+        A value index can be limited to the documents matching a condition, which makes it smaller
+        and cheaper to update: instead of the array, pass a JSON object whose "WHAT" property is
+        the array of expressions and whose "WHERE" property is the condition, e.g.
+        `{"WHAT": [[".name.first"]], "WHERE": ["=", [".type"], "person"]}`. The condition takes the
+        same form as a query's WHERE clause, but can't use parameters. A query can only use such
+        an index if its WHERE clause includes the identical condition (ANDed with anything else.)
+
         Currently, full-text indexes are limited to a single expression only.
-        Geospatial indexes are not implemented at all yet.
 
         @param database  The database to index.
         @param name  The name of the index. Any existing index with the same name will be replaced,
                      unless it has the identical expressions (in which case this is a no-op.)
         @param expressionsJSON  A JSON array of one or more expressions to index. Each expression
                      takes the same form as in a query, which means it's a JSON array as well;
-                     don't get mixed up by the nesting!
+                     don't get mixed up by the nesting! (Or an object with "WHAT" and "WHERE"
+                     properties, for a partial index.)
         @param indexType  The type of index (value or full-text.)
         @param indexOptions  Options for the index. If NULL, each option will get a default value.
         @param outError  On failure, will be set to the error status.
@@ -239,6 +455,59 @@ extern "C" {
                           C4String name,
                           C4Error *outError) C4API;
     
+    /** Indexes documents that were queued by deferred full-text indexes (see the `deferred`
+        index option), up to `maxDocs` documents per index, in a single transaction.
+        Call this periodically, or after saving documents, on a background thread with its own
+        database handle from `c4db_openAgain`.
+        @param database  The database.
+        @param maxDocs  The maximum number of queued documents to index in each index.
+        @param outDone  On success, will be set to true if no documents are left in the queues.
+        @param outError  On failure, will be set to the error status.
+        @return  True on success, false on failure. */
+    bool c4db_updateDeferredIndexes(C4Database *database C4NONNULL,
+                                    unsigned maxDocs,
+                                    bool *outDone C4NONNULL,
+                                    C4Error *outError) C4API;
+
+    /** An index build in progress; see `c4db_beginIndexBuild`. */
+    typedef struct c4IndexBuilder C4IndexBuilder;
+
+    /** Starts building an index incrementally, instead of all at once like `c4db_createIndex`.
+        Each call to `c4indexbuilder_step` indexes a batch of documents in its own short
+        transaction, so other writers aren't locked out for long; documents changed during the
+        build are caught up by later steps. Queries won't use the index until it's complete.
+        To keep the build off the main thread, give it its own database handle from
+        `c4db_openAgain` and call the step function on a background thread.
+        (A value index is still created by a single SQLite statement, in the first step.)
+        The parameters are the same as for `c4db_createIndex`.
+        @return  A new index builder, which must be freed with `c4indexbuilder_free`,
+                 or NULL on failure. */
+    C4IndexBuilder* c4db_beginIndexBuild(C4Database *database C4NONNULL,
+                                         C4String name,
+                                         C4String expressionsJSON,
+                                         C4IndexType indexType,
+                                         const C4IndexOptions *indexOptions,
+                                         C4Error *outError) C4API;
+
+    /** Indexes up to `maxDocs` more documents. When the last documents are indexed, the index
+        becomes available, replacing any existing index with the same name.
+        @param builder  The index builder.
+        @param maxDocs  The maximum number of documents to index in this transaction.
+        @param outDone  On success, will be set to true if the index is complete.
+        @param outError  On failure, will be set to the error status.
+        @return  True on success, false on failure. */
+    bool c4indexbuilder_step(C4IndexBuilder *builder C4NONNULL,
+                             unsigned maxDocs,
+                             bool *outDone C4NONNULL,
+                             C4Error *outError) C4API;
+
+    /** Returns the approximate fraction of the documents indexed so far, from 0.0 to 1.0. */
+    float c4indexbuilder_getProgress(C4IndexBuilder *builder C4NONNULL) C4API;
+
+    /** Frees an index builder. If the index isn't complete, the build is canceled and the
+        partially built index is deleted. */
+    void c4indexbuilder_free(C4IndexBuilder *builder) C4API;
+
     /** Returns the names of all indexes in the database.
         @param database  The database to check
         @param outError  On failure, will be set to the error status.
@@ -246,6 +515,20 @@ extern "C" {
     C4SliceResult c4db_getIndexes(C4Database* database C4NONNULL,
                                   C4Error* outError) C4API;
 
+    /** Stores a document property in a table column of its own, which is updated whenever a
+        document is saved. Queries then read the property from that column instead of decoding
+        each document, which speeds up properties that are frequently filtered or sorted on.
+        Existing value indexes on the property are rebuilt to use the column.
+        This can't be undone, and it rewrites every document, so it may take a while.
+        @param database  The database.
+        @param propertyPath  The property's path, as in a query's property expression, e.g.
+                    "name.first" or ".name.first".
+        @param outError  On failure, will be set to the error status.
+        @return  True on success, false on failure. */
+    bool c4db_materializeProperty(C4Database *database C4NONNULL,
+                                  C4String propertyPath,
+                                  C4Error *outError) C4API;
+
     /** @} */
 
 #ifdef __cplusplus
@@ -292,6 +292,67 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database AllDocsInfo", "[Database][C]")
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database GetDocs", "[Database][C]") {
+    setupAllDocs();
+    C4Error error;
+
+    // Ask for every doc in reverse order, plus a missing one, a deleted one and a duplicate,
+    // so the lookup spans more than one batch:
+    vector<string> ids;
+    char docID[20];
+    for (int i = 99; i >= 1; --i) {
+        sprintf(docID, "doc-%03d", i);
+        ids.push_back(docID);
+    }
+    ids.push_back("doc-missing");
+    ids.push_back("doc-005DEL");
+    ids.push_back("doc-042");
+    vector<C4String> docIDs;
+    for (auto &id : ids)
+        docIDs.push_back(c4str(id.c_str()));
+    size_t count = docIDs.size();
+
+    vector<C4Document*> docs(count);
+    REQUIRE(c4db_getDocs(db, docIDs.data(), count, docs.data(), &error));
+    for (size_t i = 0; i < count; ++i) {
+        if (ids[i] == "doc-missing") {
+            CHECK(docs[i] == nullptr);
+        } else {
+            REQUIRE(docs[i]);
+            CHECK(docs[i]->docID == docIDs[i]);
+            CHECK(docs[i]->revID == kRevID);
+            if (ids[i] == "doc-005DEL") {
+                CHECK((docs[i]->flags & kDocDeleted) != 0);
+            } else {
+                REQUIRE(c4doc_loadRevisionBody(docs[i], &error));
+                CHECK(docs[i]->selectedRev.body == kBody);
+            }
+        }
+        c4doc_free(docs[i]);
+    }
+
+    vector<C4DocumentInfo> infos(count);
+    C4SliceResult revIDs;
+    REQUIRE(c4db_getDocInfos(db, docIDs.data(), count, infos.data(), &revIDs, &error));
+    for (size_t i = 0; i < count; ++i) {
+        CHECK(infos[i].docID == docIDs[i]);
+        if (ids[i] == "doc-missing") {
+            CHECK(infos[i].flags == 0);
+            CHECK(infos[i].revID == kC4SliceNull);
+        } else if (ids[i] == "doc-005DEL") {
+            CHECK(infos[i].flags == (C4DocumentFlags)(kDocExists | kDocDeleted));
+            CHECK(infos[i].revID == kRevID);
+        } else {
+            CHECK(infos[i].flags == (C4DocumentFlags)kDocExists);
+            CHECK(infos[i].revID == kRevID);
+            CHECK(infos[i].bodySize >= 11);
+            CHECK(infos[i].bodySize <= 40);
+        }
+    }
+    c4slice_free(revIDs);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Changes", "[Database][C]") {
     createNumberedDocs(99);
 
@@ -421,6 +421,41 @@ N_WAY_TEST_CASE_METHOD(C4Test, "Document Put", "[Database][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4Test, "Document PutDocs", "[Database][C]") {
+    C4Error error;
+    {
+        TransactionHelper t(db);
+        C4Document *doc = c4doc_create(db, C4STR("existing"), kBody, 0, &error);
+        REQUIRE(doc);
+        c4doc_free(doc);
+    }
+    C4SequenceNumber lastSeq = c4db_getLastSequence(db);
+
+    // The second request tries to create a doc that already exists, which is a conflict:
+    C4DocPutRequest requests[3] = {};
+    C4Slice docIDs[3] = {C4STR("first"), C4STR("existing"), C4STR("third")};
+    for (int i = 0; i < 3; ++i) {
+        requests[i].docID = docIDs[i];
+        requests[i].body = C4STR("{\"ok\":\"go\"}");
+    }
+    C4Error docErrors[3];
+    REQUIRE(c4db_putDocs(db, requests, 3, docErrors, &error));
+    CHECK(docErrors[0].code == 0);
+    CHECK(docErrors[1].domain == LiteCoreDomain);
+    CHECK(docErrors[1].code == kC4ErrorConflict);
+    CHECK(docErrors[2].code == 0);
+
+    // The other docs were saved, and the existing one is unchanged:
+    CHECK(c4db_getLastSequence(db) == lastSeq + 2);
+    for (int i = 0; i < 3; ++i) {
+        C4Document *doc = c4doc_get(db, docIDs[i], true, &error);
+        REQUIRE(doc);
+        CHECK(doc->selectedRev.body == (i == 1 ? kBody : requests[i].body));
+        c4doc_free(doc);
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4Test, "Document Update", "[Database][C]") {
     C4Log("Begin test");
     C4Error error;
@@ -18,6 +18,7 @@
 #include <thread>
 #ifndef _MSC_VER
 #include <unistd.h>
+#include <sys/resource.h>
 #endif
 
 using namespace fleece;
@@ -122,6 +123,55 @@ public:
     }
 
 
+    // Returns the process's peak resident memory size in bytes, or 0 if unknown.
+    static size_t peakMemoryUsage() {
+#ifdef _MSC_VER
+        return 0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+    #ifdef __APPLE__
+        return usage.ru_maxrss;             // bytes
+    #else
+        return usage.ru_maxrss * 1024;      // kilobytes
+    #endif
+#endif
+    }
+
+
+    // Runs a query, reporting the time to the first row and to the end, and the growth of the
+    // process's peak memory usage. Returns the number of rows.
+    unsigned benchmarkQuery(const char *queryStr, bool streaming) {
+        C4Error error;
+        C4Query *query = c4query_new(db, c4str(queryStr), &error);
+        REQUIRE(query);
+        C4QueryOptions options = kC4DefaultQueryOptions;
+        options.streaming = streaming;
+
+        size_t memBefore = peakMemoryUsage();
+        Stopwatch st;
+        auto e = c4query_run(query, &options, kC4SliceNull, &error);
+        REQUIRE(e);
+        unsigned rows = 0;
+        double firstRowTime = 0;
+        while (c4queryenum_next(e, &error)) {
+            if (rows++ == 0)
+                firstRowTime = st.elapsed();
+        }
+        double totalTime = st.elapsed();
+        size_t memAfter = peakMemoryUsage();
+        c4queryenum_free(e);
+        c4query_free(query);
+
+        fprintf(stderr, "%s query: first row after %.3fms, %u rows in %.3fms, "
+                        "peak memory grew %zu KB\n",
+                (streaming ? "Streaming" : "Prerecorded"),
+                firstRowTime * 1000, rows, totalTime * 1000, (memAfter - memBefore) / 1024);
+        return rows;
+    }
+
+
     void readRandomDocs(size_t numDocs, size_t numDocsToRead) {
         std::cerr << "Reading " <<numDocsToRead<< " random docs...\n";
         Benchmark b;
@@ -149,6 +199,212 @@ N_WAY_TEST_CASE_METHOD(PerfTest, "Performance", "[Perf][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(PerfTest, "Bulk insert", "[Perf][C]") {
+    static const unsigned kNumDocs = 20000;
+    std::vector<std::string> docIDs;
+    std::vector<FLSliceResult> bodies;
+    for (unsigned i = 0; i < kNumDocs; ++i) {
+        char buf[100];
+        sprintf(buf, "%07u", i);
+        docIDs.push_back(buf);
+        sprintf(buf, "{\"n\":%u,\"name\":\"Document number %u\",\"tags\":[\"a\",\"b\"]}", i, i);
+        C4Error error;
+        FLSliceResult body = c4db_encodeJSON(db, c4str(buf), &error);
+        REQUIRE(body.buf);
+        bodies.push_back(body);
+    }
+
+    // `docID` must outlive the request.
+    auto makeRequest = [&](const std::string &docID, unsigned i) {
+        C4DocPutRequest rq = {};
+        rq.docID = c4str(docID.c_str());
+        rq.body = (C4Slice)bodies[i];
+        rq.save = true;
+        return rq;
+    };
+
+    {
+        // One c4doc_put per document:
+        std::vector<std::string> ids;
+        for (unsigned i = 0; i < kNumDocs; ++i)
+            ids.push_back("loop-" + docIDs[i]);
+        Stopwatch st;
+        {
+            TransactionHelper t(db);
+            for (unsigned i = 0; i < kNumDocs; ++i) {
+                C4DocPutRequest rq = makeRequest(ids[i], i);
+                C4Error error;
+                C4Document *doc = c4doc_put(db, &rq, nullptr, &error);
+                REQUIRE(doc != nullptr);
+                c4doc_free(doc);
+            }
+        }
+        st.printReport("Inserting with c4doc_put", kNumDocs, "doc");
+    }
+    {
+        // One c4db_putDocs call:
+        std::vector<std::string> ids;
+        std::vector<C4DocPutRequest> requests;
+        for (unsigned i = 0; i < kNumDocs; ++i)
+            ids.push_back("bulk-" + docIDs[i]);
+        for (unsigned i = 0; i < kNumDocs; ++i)
+            requests.push_back(makeRequest(ids[i], i));
+        std::vector<C4Error> errors(kNumDocs);
+        Stopwatch st;
+        C4Error error;
+        REQUIRE(c4db_putDocs(db, requests.data(), kNumDocs, errors.data(), &error));
+        st.printReport("Inserting with c4db_putDocs", kNumDocs, "doc");
+        for (auto &docError : errors)
+            CHECK(docError.code == 0);
+    }
+    CHECK(c4db_getDocumentCount(db) == 2 * kNumDocs);
+
+    for (auto &body : bodies)
+        FLSliceResult_Free(body);
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Get docs with deep histories", "[Perf][C]") {
+    static const unsigned kNumDocs = 2000, kDepth = 20;
+    C4Error error;
+    FLSliceResult body = c4db_encodeJSON(db, c4str("{\"name\":\"Document with a long history\"}"),
+                                         &error);
+    REQUIRE(body.buf);
+
+    // Each doc gets two branches of kDepth revisions sharing a root, i.e. a conflict:
+    std::vector<std::string> docIDs;
+    {
+        TransactionHelper t(db);
+        for (unsigned i = 0; i < kNumDocs; ++i) {
+            char buf[100];
+            sprintf(buf, "doc-%07u", i);
+            docIDs.push_back(buf);
+            for (int branch = 0; branch < 2; ++branch) {
+                std::vector<std::string> revIDs;
+                for (unsigned gen = kDepth; gen >= 1; --gen) {
+                    sprintf(buf, "%u-%s", gen, (gen == 1 ? "1111" : (branch ? "bbbb" : "aaaa")));
+                    revIDs.push_back(buf);
+                }
+                std::vector<C4Slice> history;
+                for (auto &revID : revIDs)
+                    history.push_back(c4str(revID.c_str()));
+                C4DocPutRequest rq = {};
+                rq.existingRevision = true;
+                rq.docID = c4str(docIDs.back().c_str());
+                rq.history = history.data();
+                rq.historyCount = history.size();
+                rq.body = (C4Slice)body;
+                rq.save = true;
+                C4Document *doc = c4doc_put(db, &rq, nullptr, &error);
+                REQUIRE(doc != nullptr);
+                c4doc_free(doc);
+            }
+        }
+    }
+    FLSliceResult_Free(body);
+    reopenDB();
+
+    Stopwatch st;
+    for (auto &docID : docIDs) {
+        C4Document *doc = c4doc_get(db, c4str(docID.c_str()), true, &error);
+        REQUIRE(doc);
+        CHECK(doc->selectedRev.body.size > 0);
+        c4doc_free(doc);
+    }
+    st.printReport("Reading current revision", kNumDocs, "doc");
+
+    Stopwatch st2;
+    unsigned nRevs = 0;
+    for (auto &docID : docIDs) {
+        C4Document *doc = c4doc_get(db, c4str(docID.c_str()), true, &error);
+        REQUIRE(doc);
+        do {
+            ++nRevs;
+        } while (c4doc_selectNextRevision(doc));
+        c4doc_free(doc);
+    }
+    st2.printReport("Reading all revisions", nRevs, "rev");
+    CHECK(nRevs == kNumDocs * (2 * kDepth - 1));
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Compressed bodies", "[Perf][C][.slow]") {
+    for (int pass = 0; pass < 2; ++pass) {
+        bool compressed = (pass == 1);
+        auto config = *c4db_getConfig(db);
+        if (compressed)
+            config.flags |= kC4DB_CompressBodies;
+        C4Error error;
+        REQUIRE(c4db_delete(db, &error));
+        c4db_free(db);
+        db = c4db_open(databasePath(), &config, &error);
+        REQUIRE(db);
+        fprintf(stderr, "---- %s bodies:\n", (compressed ? "Compressed" : "Uncompressed"));
+
+        auto numDocs = importJSONLines(sFixturesDir + "iTunesMusicLibrary.json");
+        reopenDB();     // checkpoints the WAL, so the file size is accurate
+
+        C4StringResult path = c4db_getPath(db);
+        std::string dbFile = std::string((const char*)path.buf, path.size) + "db.sqlite3";
+        c4slice_free(path);
+        struct stat info;
+        REQUIRE(stat(dbFile.c_str(), &info) == 0);
+        fprintf(stderr, "Database file size is %lld KB\n", (long long)info.st_size / 1024);
+
+        Stopwatch st;
+        auto e = c4db_enumerateAllDocs(db, &kC4DefaultEnumeratorOptions, &error);
+        REQUIRE(e);
+        unsigned n = 0;
+        while (c4enum_next(e, &error)) {
+            C4Document *doc = c4enum_getDocument(e, &error);
+            REQUIRE(doc);
+            CHECK(doc->selectedRev.body.size > 0);
+            c4doc_free(doc);
+            ++n;
+        }
+        c4enum_free(e);
+        st.printReport("Scanning all docs", n, "doc");
+        CHECK(n == numDocs);
+
+        Stopwatch st2;
+        auto rows = queryWhere("[\"=\", [\".Artist\"], \"Radiohead\"]");
+        st2.printReport("Query scan", numDocs, "doc");
+        CHECK(rows > 0);
+
+        readRandomDocs(numDocs, 10000);
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Multi-property query", "[Perf][C][.slow]") {
+    // Each row's body is read by four property accesses, which share one decoded root:
+    static const char *kQuery = "[\"SELECT\", {\"WHAT\": [[\"._id\"]],"
+                                "\"WHERE\": [\"AND\", [\">\", [\".Year\"], 1990],"
+                                            "[\"<\", [\".Total Time\"], 300000],"
+                                            "[\"IS NOT\", [\".Artist\"], [\"MISSING\"]]],"
+                                "\"ORDER_BY\": [[\".Name\"]]}]";
+    static const int kRepeat = 10;
+    for (int pass = 0; pass < 2; ++pass) {
+        bool compressed = (pass == 1);
+        auto config = *c4db_getConfig(db);
+        if (compressed)
+            config.flags |= kC4DB_CompressBodies;
+        C4Error error;
+        REQUIRE(c4db_delete(db, &error));
+        c4db_free(db);
+        db = c4db_open(databasePath(), &config, &error);
+        REQUIRE(db);
+        fprintf(stderr, "---- %s bodies:\n", (compressed ? "Compressed" : "Uncompressed"));
+
+        auto numDocs = importJSONLines(sFixturesDir + "iTunesMusicLibrary.json");
+        Stopwatch st;
+        for (int i = 0; i < kRepeat; ++i)
+            CHECK(benchmarkQuery(kQuery, false) > 0);
+        st.printReport("Multi-property query", numDocs * kRepeat, "doc");
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD(PerfTest, "Import names", "[Perf][C][.slow]") {
     // Download https://github.com/arangodb/example-datasets/raw/master/RandomUsers/names_300000.json
     // to C/tests/data/ before running this test.
@@ -178,6 +434,22 @@ N_WAY_TEST_CASE_METHOD(PerfTest, "Import names", "[Perf][C][.slow]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(PerfTest, "Query first-row latency", "[Perf][C][.slow]") {
+    // Download https://github.com/arangodb/example-datasets/raw/master/RandomUsers/names_300000.json
+    // to C/tests/data/ before running this test.
+    auto numDocs = importJSONLines(sFixturesDir + "names_300000.json", 30.0, true);
+    reopenDB();
+
+    // No LIMIT, so a prerecorded enumerator has to collect every row before returning one.
+    // The streaming run goes first, since peak memory usage can only go up.
+    const char *queryStr = "[\"SELECT\", {\"WHAT\": [[\"._id\"], [\".name\"], [\".contact\"]]}]";
+    auto streamed = benchmarkQuery(queryStr, true);
+    auto recorded = benchmarkQuery(queryStr, false);
+    CHECK(streamed == numDocs);
+    CHECK(recorded == numDocs);
+}
+
+
 N_WAY_TEST_CASE_METHOD(PerfTest, "Import geoblocks", "[Perf][C][.slow]") {
     // Download https://github.com/arangodb/example-datasets/raw/master/IPRanges/geoblocks.json
     // to C/tests/data/ before running this test.
@@ -191,6 +463,206 @@ N_WAY_TEST_CASE_METHOD(PerfTest, "Import geoblocks", "[Perf][C][.slow]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(PerfTest, "Geo query", "[Perf][C][.slow]") {
+    // Download https://github.com/arangodb/example-datasets/raw/master/IPRanges/geoblocks.json
+    // to C/tests/data/ before running this test.
+    auto numDocs = importJSONLines(sFixturesDir + "geoblocks.json", 15.0, true);
+    reopenDB();
+
+    // Bounding box around the continental US:
+    auto scanQuery = json5("['AND', ['BETWEEN', ['.geo[0]'], 25, 49], ['BETWEEN', ['.geo[1]'], -125, -67]]");
+    auto geoQuery  = json5("['WITHIN', [['.geo[0]'], ['.geo[1]']], [25, -125], [49, -67]]");
+    static const int kRepeat = 10;
+
+    Stopwatch st;
+    unsigned nScan = 0;
+    for (int i = 0; i < kRepeat; ++i)
+        nScan = queryWhere(scanQuery.c_str());
+    st.printReport("Bounding-box query by scan", numDocs * kRepeat, "doc");
+
+    Stopwatch st2;
+    C4Error error;
+    REQUIRE(c4db_createIndex(db, C4STR("geo"), c4str(json5("[['.geo[0]'], ['.geo[1]']]").c_str()),
+                             kC4GeoIndex, nullptr, &error));
+    st2.printReport("Creating geo index", 1, "index");
+
+    Stopwatch st3;
+    unsigned nGeo = 0;
+    for (int i = 0; i < kRepeat; ++i)
+        nGeo = queryWhere(geoQuery.c_str());
+    st3.printReport("Bounding-box query with geo index", numDocs * kRepeat, "doc");
+    CHECK(nGeo == nScan);
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "FTS update of unindexed property", "[Perf][C][FTS][.slow]") {
+    static const int kNumDocs = 2000;
+    static const char* const kWords[] = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur",
+                                         "adipiscing", "elit", "sed", "eiusmod", "tempor"};
+    C4Error error;
+    auto saveDocs = [&](C4Slice revID, int count, bool changeText) {
+        TransactionHelper t(db);
+        for (int i = 0; i < kNumDocs; ++i) {
+            char docID[20];
+            sprintf(docID, "doc-%05d", i);
+            std::string text;
+            for (int w = 0; w < 500; ++w)
+                text += std::string(kWords[(i + w * 7) % 11]) + " ";
+            if (changeText)
+                text += "v" + std::to_string(count);
+            std::string json = "{\"count\": " + std::to_string(count) + ", \"text\": \"" + text + "\"}";
+            C4SliceResult body = c4db_encodeJSON(db, c4str(json.c_str()), &error);
+            REQUIRE(body.buf);
+            createRev(c4str(docID), revID, {body.buf, body.size});
+            c4slice_free(body);
+        }
+    };
+    saveDocs(kRevID, 1, false);
+    REQUIRE(c4db_createIndex(db, C4STR("text"), C4STR("[[\".text\"]]"), kC4FullTextIndex,
+                             nullptr, &error));
+
+    // The text is unchanged, so the full-text index only has to remap the sequences:
+    Stopwatch st;
+    saveDocs(kRev2ID, 2, false);
+    st.printReport("Updating docs without changing indexed text", kNumDocs, "doc");
+
+    Stopwatch st2;
+    saveDocs(kRev3ID, 3, true);
+    st2.printReport("Updating docs and their indexed text", kNumDocs, "doc");
+
+    auto query = json5("['SELECT', {WHAT: [['._id']], WHERE: ['MATCH', ['.text'], 'tempor']}]");
+    CHECK(queryWhere(query.c_str()) == kNumDocs);
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "FTS prefix query latency", "[Perf][C][FTS][.slow]") {
+    static const int kNumDocs = 20000, kRepeat = 20;
+    static const char* const kPrefixes[] = {"q", "qu", "que"};
+    C4Error error;
+    {
+        // Docs of 20 random 4-8 letter words each:
+        TransactionHelper t(db);
+        for (int i = 0; i < kNumDocs; ++i) {
+            char docID[20];
+            sprintf(docID, "doc-%05d", i);
+            std::string text;
+            for (int w = 0; w < 20; ++w) {
+                int length = 4 + (int)(random() % 5);
+                for (int c = 0; c < length; ++c)
+                    text += (char)('a' + random() % 26);
+                text += ' ';
+            }
+            std::string json = "{\"text\": \"" + text + "\"}";
+            C4SliceResult body = c4db_encodeJSON(db, c4str(json.c_str()), &error);
+            REQUIRE(body.buf);
+            createRev(c4str(docID), kRevID, {body.buf, body.size});
+            c4slice_free(body);
+        }
+    }
+
+    auto benchmarkPrefixes = [&](const char *indexDescription, unsigned counts[]) {
+        for (int p = 0; p < 3; ++p) {
+            std::string query = json5("['SELECT', {WHAT: [['._id']], WHERE: ['MATCH', ['.text'], '")
+                                + kPrefixes[p] + "*']}]";
+            Benchmark b;
+            for (int i = 0; i < kRepeat; ++i) {
+                b.start();
+                counts[p] = queryWhere(query.c_str());
+                b.stop();
+            }
+            fprintf(stderr, "%d-letter prefix, %s (%u docs): ", p + 1, indexDescription, counts[p]);
+            b.printReport(1, "query");
+        }
+    };
+
+    unsigned plainCounts[3], prefixCounts[3];
+    REQUIRE(c4db_createIndex(db, C4STR("text"), C4STR("[[\".text\"]]"), kC4FullTextIndex,
+                             nullptr, &error));
+    benchmarkPrefixes("no prefix index", plainCounts);
+
+    REQUIRE(c4db_deleteIndex(db, C4STR("text"), &error));
+    C4IndexOptions options = {};
+    options.prefixLengths = "1,2,3";
+    REQUIRE(c4db_createIndex(db, C4STR("text"), C4STR("[[\".text\"]]"), kC4FullTextIndex,
+                             &options, &error));
+    benchmarkPrefixes("prefix index", prefixCounts);
+
+    for (int p = 0; p < 3; ++p)
+        CHECK(prefixCounts[p] == plainCounts[p]);
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Regex query", "[Perf][C][.slow]") {
+    // Download https://github.com/arangodb/example-datasets/raw/master/RandomUsers/names_300000.json
+    // to C/tests/data/ before running this test.
+    auto numDocs = importJSONLines(sFixturesDir + "names_300000.json", 30.0, true);
+    reopenDB();
+
+    static const char* const kPatterns[] = {
+        "ar",               // literal
+        "^Ma",              // prefix
+        "son$",             // suffix
+        "^[A-M].*a$",       // regular expression
+    };
+    for (auto pattern : kPatterns) {
+        std::string query = json5("['SELECT', {WHAT: [['._id']], "
+                                  "WHERE: ['regexp_like()', ['.name.first'], '") + pattern + "']}]";
+        Benchmark b;
+        unsigned count = 0;
+        for (int i = 0; i < 5; ++i) {
+            b.start();
+            count = queryWhere(query.c_str());
+            b.stop();
+        }
+        CHECK(count > 0);
+        fprintf(stderr, "regexp_like '%s' (%u of %u docs): ", pattern, count, numDocs);
+        b.printReport(1, "query");
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "Query IN array parameter", "[Perf][C][.slow]") {
+    // Download https://github.com/arangodb/example-datasets/raw/master/RandomUsers/names_300000.json
+    // to C/tests/data/ before running this test.
+    auto numDocs = importJSONLines(sFixturesDir + "names_300000.json", 30.0, true);
+    reopenDB();
+
+    C4Error error;
+    C4Query *query = c4query_new(db, c4str(json5("['SELECT', {WHAT: [['._id']], "
+                                                 "WHERE: ['IN', ['._id'], ['$ids']]}]").c_str()),
+                                 &error);
+    REQUIRE(query);
+    for (unsigned listSize : {10u, 1000u, 100000u}) {
+        // The same compiled query is run with a different list each time:
+        std::string params = "{\"ids\":[";
+        for (unsigned i = 0; i < listSize; ++i) {
+            char docID[20];
+            sprintf(docID, "%s\"%07u\"", (i ? "," : ""), ((unsigned)random() % numDocs) + 1);
+            params += docID;
+        }
+        params += "]}";
+
+        Benchmark b;
+        unsigned rows = 0;
+        for (int i = 0; i < 5; ++i) {
+            b.start();
+            auto e = c4query_run(query, nullptr, c4str(params.c_str()), &error);
+            REQUIRE(e);
+            rows = 0;
+            while (c4queryenum_next(e, &error))
+                ++rows;
+            c4queryenum_free(e);
+            b.stop();
+        }
+        CHECK(rows > 0);
+        CHECK(rows <= listSize);
+        fprintf(stderr, "IN $ids with %u items (%u rows): ", listSize, rows);
+        b.printReport(1, "query");
+    }
+    c4query_free(query);
+}
+
+
 N_WAY_TEST_CASE_METHOD(PerfTest, "Import Wikipedia", "[Perf][C][.slow]") {
     // Download https://github.com/diegoceccarelli/json-wikipedia/blob/master/src/test/resources/misc/en-wikipedia-articles-1000-1.json.gz
     // and unzip to C/tests/data/ before running this test.
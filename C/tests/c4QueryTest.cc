@@ -10,6 +10,7 @@
 #include "c4Query.h"
 #include "c4.hh"
 #include "c4Document+Fleece.h"
+#include <algorithm>
 #include <iostream>
 
 using namespace std;
@@ -75,6 +76,24 @@ public:
         return docIDs;
     }
 
+    // Returns the SQLite query plan of the current query.
+    std::string explain() {
+        REQUIRE(query);
+        C4StringResult explanation = c4query_explain(query);
+        std::string result((const char*)explanation.buf, explanation.size);
+        c4slice_free(explanation);
+        return result;
+    }
+
+    // Saves a revision whose body is given as JSON5.
+    void saveDoc(C4Slice docID, C4Slice revID, const std::string &json) {
+        C4Error error;
+        C4SliceResult body = c4db_encodeJSON(db, c4str(json5(json).c_str()), &error);
+        REQUIRE(body.buf);
+        createRev(docID, revID, {body.buf, body.size});
+        c4slice_free(body);
+    }
+
 protected:
     C4Query *query {nullptr};
 };
@@ -119,8 +138,49 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query IN", "[Query][C]") {
     // Type 2: RHS is an array literal; generates a SQL "IN" expression
     compile(json5("['IN', ['.', 'name', 'first'], ['[]', 'Eddie', 'Verna']]"));
     CHECK(run() == (vector<string>{"0000091", "0000093"}));
+
+    // Type 3: RHS is a parameter, which can be bound to an array; generates a SQL "IN" with
+    // a subquery on fl_each_param
+    compile(json5("['IN', ['.', 'name', 'first'], ['$names']]"));
+    CHECK(run("{\"names\": [\"Eddie\", \"Verna\"]}") == (vector<string>{"0000091", "0000093"}));
+    CHECK(run("{\"names\": [\"Verna\"]}") == (vector<string>{"0000093"}));
+    CHECK(run("{\"names\": []}") == (vector<string>{}));
+    compile(json5("['IN', ['._id'], ['$ids']]"));
+    auto result = run("{\"ids\": [\"0000093\", \"nonexistent\", \"0000007\"]}");
+    sort(result.begin(), result.end());     // rows may come in the order of the list
+    CHECK(result == (vector<string>{"0000007", "0000093"}));
 }
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query batches", "[Query][C]") {
+    compileSelect(json5("{WHAT: [['._id'], ['length()', ['.name.first']], ['.likes']], "
+                         "WHERE: ['=', ['.contact.address.state'], 'CA'], ORDER_BY: [['._id']]}"));
+    C4Error error;
+    auto e = c4query_run(query, nullptr, kC4SliceNull, &error);
+    REQUIRE(e);
+    vector<string> docIDs;
+    unsigned batches = 0;
+    while (C4QueryBatch *batch = c4queryenum_nextBatch(e, 3, &error)) {
+        ++batches;
+        REQUIRE(batch->columnCount == 3);
+        CHECK(batch->rowCount <= 3);
+        const C4BatchColumn &ids = batch->columns[0];
+        REQUIRE(ids.type == kC4BatchString);
+        for (uint32_t row = 0; row < batch->rowCount; ++row)
+            docIDs.emplace_back((const char*)ids.data + ids.offsets[row],
+                                ids.offsets[row + 1] - ids.offsets[row]);
+        CHECK(batch->columns[1].type == kC4BatchInt);
+        CHECK(batch->columns[1].ints[0] > 0);
+        CHECK(batch->columns[2].type == kC4BatchFleece);
+        c4querybatch_free(batch);
+    }
+    CHECK(error.code == 0);
+    CHECK(batches == 3);
+    CHECK(docIDs == (vector<string>{"0000001", "0000015", "0000036", "0000043",
+                                    "0000053", "0000064", "0000072", "0000073"}));
+    c4queryenum_free(e);
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query sorted", "[Query][C]") {
     compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"),
             json5("[['.', 'name', 'last']]"));
@@ -136,6 +196,114 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query bindings", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query cache", "[Query][C]") {
+    auto caStates = vector<string>{"0000001", "0000015", "0000036", "0000043", "0000053", "0000064", "0000072", "0000073"};
+    C4QueryCacheStats before = c4db_getQueryCacheStats(db);
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], ['$', 'state']]"));
+    CHECK(run("{\"state\": \"CA\"}") == caStates);
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], ['$', 'state']]"));
+    CHECK(run("{\"state\": \"CA\"}") == caStates);
+    C4QueryCacheStats after = c4db_getQueryCacheStats(db);
+    CHECK(after.misses == before.misses + 1);
+    CHECK(after.hits == before.hits + 1);
+
+    // Creating an index clears the cache:
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("state"), C4STR("[[\".contact.address.state\"]]"),
+                             kC4ValueIndex, nullptr, &err));
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], ['$', 'state']]"));
+    CHECK(run("{\"state\": \"CA\"}") == caStates);
+    CHECK(c4db_getQueryCacheStats(db).misses == after.misses + 1);
+
+    // So does deleting an index through another connection:
+    C4Database *db2 = c4db_openAgain(db, &err);
+    REQUIRE(db2);
+    REQUIRE(c4db_deleteIndex(db2, C4STR("state"), &err));
+    REQUIRE(c4db_close(db2, &err));
+    c4db_free(db2);
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], ['$', 'state']]"));
+    CHECK(run("{\"state\": \"CA\"}") == caStates);
+    CHECK(c4db_getQueryCacheStats(db).misses == after.misses + 2);
+
+    // Size 0 disables the cache:
+    c4db_setQueryCacheSize(db, 0);
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], ['$', 'state']]"));
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], ['$', 'state']]"));
+    CHECK(c4db_getQueryCacheStats(db).misses == after.misses + 4);
+    CHECK(c4db_getQueryCacheStats(db).hits == after.hits);
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query streaming", "[Query][C][!throws]") {
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"),
+            json5("[['.', 'name', 'last']]"));
+    auto expected = run();
+    REQUIRE(expected.size() == 8);
+
+    C4QueryOptions options = kC4DefaultQueryOptions;
+    options.streaming = true;
+    C4Error error;
+    auto e = c4query_run(query, &options, kC4SliceNull, &error);
+    REQUIRE(e);
+    vector<string> docIDs;
+    while (c4queryenum_next(e, &error))
+        docIDs.push_back(Array::iterator(e->columns)[0].asstring());
+    CHECK(error.code == 0);
+    CHECK(docIDs == expected);
+
+    // A streaming enumerator can't jump around:
+    {
+        ExpectingExceptions x;
+        CHECK(!c4queryenum_seek(e, 0, &error));
+        CHECK(error.code == kC4ErrorUnsupported);
+    }
+    // ...but it can tell that the database hasn't changed:
+    CHECK(c4queryenum_refresh(e, &error) == nullptr);
+    CHECK(error.code == 0);
+    c4queryenum_free(e);
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query observer", "[Query][C]") {
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"));
+    int callbackCount = 0;
+    C4Error error;
+    auto obs = c4queryobs_create(query, kC4SliceNull,
+                                 [](C4QueryObserver*, void *context) {++*(int*)context;},
+                                 &callbackCount, &error);
+    REQUIRE(obs);
+
+    // The first call reports all the current rows:
+    C4QueryRowChange changes[20];
+    REQUIRE(c4queryobs_getChanges(obs, changes, 20, &error) == 8);
+    CHECK(changes[0].type == kC4QueryRowAdded);
+    CHECK(changes[0].docID == C4STR("0000001"));
+    CHECK(FLValue_AsString(FLArray_Get(changes[0].columns, 0)) == C4STR("0000001"));
+    CHECK(c4queryobs_getChanges(obs, changes, 20, &error) == 0);
+    CHECK(error.code == 0);
+
+    // Changing a document that doesn't match the query doesn't change the results:
+    saveDoc(C4STR("ny"), kRevID, "{contact: {address: {state: 'NY'}}}");
+    CHECK(callbackCount == 1);
+    CHECK(c4queryobs_getChanges(obs, changes, 20, &error) == 0);
+
+    // A new matching document is added:
+    saveDoc(C4STR("ca"), kRevID, "{contact: {address: {state: 'CA'}}}");
+    CHECK(callbackCount == 2);
+    REQUIRE(c4queryobs_getChanges(obs, changes, 20, &error) == 1);
+    CHECK(changes[0].type == kC4QueryRowAdded);
+    CHECK(changes[0].docID == C4STR("ca"));
+
+    // ...and removed when it stops matching:
+    saveDoc(C4STR("ca"), kRev2ID, "{contact: {address: {state: 'OR'}}}");
+    REQUIRE(c4queryobs_getChanges(obs, changes, 20, &error) == 1);
+    CHECK(changes[0].type == kC4QueryRowRemoved);
+    CHECK(changes[0].docID == C4STR("ca"));
+
+    c4queryobs_free(obs);
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query ANY", "[Query][C]") {
     compile(json5("['ANY', 'like', ['.', 'likes'], ['=', ['?', 'like'], 'climbing']]"));
     CHECK(run() == (vector<string>{"0000017", "0000021", "0000023", "0000045", "0000060"}));
@@ -156,6 +324,183 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query ANY", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query ANY constraint pushdown", "[Query][C]") {
+    // Comparisons with the variable are handed to fl_each (idxNum 2, then the operators), which
+    // skips the items that can't match:
+    compile(json5("['ANY', 'like', ['.', 'likes'], ['=', ['?', 'like'], 'climbing']]"));
+    CHECK(explain().find("VIRTUAL TABLE INDEX 2:=") != string::npos);
+    CHECK(run() == (vector<string>{"0000017", "0000021", "0000023", "0000045", "0000060"}));
+
+    compile(json5("['ANY', 'like', ['.', 'likes'], ['AND', ['>=', ['?', 'like'], 'climbing'], \
+                                                          ['<', ['?', 'like'], 'climbinh']]]"));
+    CHECK(explain().find("VIRTUAL TABLE INDEX 2:") != string::npos);
+    CHECK(run() == (vector<string>{"0000017", "0000021", "0000023", "0000045", "0000060"}));
+
+    // Strings sort after numbers:
+    compile(json5("['ANY', 'like', ['.', 'likes'], ['<', ['?', 'like'], 17]]"));
+    CHECK(run().size() == 0);
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query ANY constraint pushdown results", "[Query][C]") {
+    saveDoc(C4STR("mixed1"), kRevID, "{values: [1, 5, 'apple']}");
+    saveDoc(C4STR("mixed2"), kRevID, "{values: ['Banana', 3.5, null]}");
+    saveDoc(C4STR("mixed3"), kRevID, "{values: [[1, 2], {a: 1}, 10]}");
+    saveDoc(C4STR("mixed4"), kRevID, "{values: []}");
+    saveDoc(C4STR("mixed5"), kRevID, "{values: [true, 'cherry', -2]}");
+
+    // Each comparison is run with the constraint pushed down into fl_each, and again wrapped in
+    // NOT NOT, which SQLite can't hand to fl_each, so it filters every item itself. The cursor
+    // may only skip items that fail the comparison, so the results have to be the same:
+    struct { const char *op, *value, *idxStr; } comparisons[] = {
+        {"=",  "5",        "INDEX 2:="},
+        {"<",  "4",        "INDEX 2:<"},
+        {"<=", "3.5",      "INDEX 2:L"},
+        {">",  "'apple'",  "INDEX 2:>"},
+        {">=", "10",       "INDEX 2:G"},
+        {"<",  "'B'",      "INDEX 2:<"},
+        {"=",  "'cherry'", "INDEX 2:="},
+        {">",  "-5",       "INDEX 2:>"},
+    };
+    for (auto &cmp : comparisons) {
+        string test = string("['") + cmp.op + "', ['?', 'v'], " + cmp.value + "]";
+        INFO("Comparison: " << test);
+        compile(json5("['ANY', 'v', ['.values'], " + test + "]"));
+        CHECK(explain().find(cmp.idxStr) != string::npos);
+        auto pushed = run();
+
+        compile(json5("['ANY', 'v', ['.values'], ['NOT', ['NOT', " + test + "]]]"));
+        CHECK(explain().find("VIRTUAL TABLE INDEX 2:\n") != string::npos);
+        auto filtered = run();
+        CHECK(pushed == filtered);
+    }
+
+    compile(json5("['ANY', 'v', ['.values'], ['=', ['?', 'v'], 5]]"));
+    CHECK(run() == (vector<string>{"mixed1"}));
+    compile(json5("['ANY', 'v', ['.values'], ['>=', ['?', 'v'], 10]]"));
+    CHECK(run() == (vector<string>{"mixed1", "mixed2", "mixed3", "mixed5"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query ANY w/array index", "[Query][C]") {
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("likes"), C4STR("[[\".likes\"]]"), kC4ArrayIndex, nullptr, &err));
+
+    compile(json5("['ANY', 'like', ['.', 'likes'], ['=', ['?', 'like'], 'climbing']]"));
+    CHECK(explain().find("fl_each") == string::npos);
+    auto result = run();
+    sort(result.begin(), result.end());
+    CHECK(result == (vector<string>{"0000017", "0000021", "0000023", "0000045", "0000060"}));
+
+    // The index is updated when documents change:
+    saveDoc(C4STR("climber"), kRevID, "{likes: ['climbing', 'climbing']}");
+    saveDoc(C4STR("0000017"), kRev2ID, "{likes: ['knitting']}");
+    result = run();
+    sort(result.begin(), result.end());
+    CHECK(result == (vector<string>{"0000021", "0000023", "0000045", "0000060", "climber"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query incremental index build", "[Query][C]") {
+    C4Error err;
+    C4IndexBuilder *builder = c4db_beginIndexBuild(db, C4STR("likes"), C4STR("[[\".likes\"]]"),
+                                                   kC4ArrayIndex, nullptr, &err);
+    REQUIRE(builder);
+    CHECK(c4indexbuilder_getProgress(builder) == 0.0f);
+    bool done = false;
+    REQUIRE(c4indexbuilder_step(builder, 30, &done, &err));
+    CHECK(!done);
+    CHECK(c4indexbuilder_getProgress(builder) > 0.0f);
+    CHECK(c4indexbuilder_getProgress(builder) < 1.0f);
+
+    // The index isn't used until it's complete:
+    compile(json5("['ANY', 'like', ['.', 'likes'], ['=', ['?', 'like'], 'climbing']]"));
+    CHECK(explain().find("fl_each") != string::npos);
+
+    // Changes made during the build, to indexed and unindexed docs, are caught up:
+    saveDoc(C4STR("climber"), kRevID, "{likes: ['climbing']}");
+    saveDoc(C4STR("0000017"), kRev2ID, "{likes: ['knitting']}");
+    saveDoc(C4STR("0000090"), kRev2ID, "{likes: ['climbing']}");
+
+    int steps = 1;
+    while (!done) {
+        REQUIRE(c4indexbuilder_step(builder, 30, &done, &err));
+        ++steps;
+    }
+    CHECK(steps == 4);
+    CHECK(c4indexbuilder_getProgress(builder) == 1.0f);
+    c4indexbuilder_free(builder);
+
+    compile(json5("['ANY', 'like', ['.', 'likes'], ['=', ['?', 'like'], 'climbing']]"));
+    CHECK(explain().find("fl_each") == string::npos);
+    auto result = run();
+    sort(result.begin(), result.end());
+    CHECK(result == (vector<string>{"0000021", "0000023", "0000045", "0000060", "0000090", "climber"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query cancel index build", "[Query][C][FTS]") {
+    C4Error err;
+    C4IndexBuilder *builder = c4db_beginIndexBuild(db, C4STR("byStreet"),
+                                                   C4STR("[[\".contact.address.street\"]]"),
+                                                   kC4FullTextIndex, nullptr, &err);
+    REQUIRE(builder);
+    bool done;
+    REQUIRE(c4indexbuilder_step(builder, 50, &done, &err));
+    CHECK(!done);
+    c4indexbuilder_free(builder);
+
+    // The partial index was discarded:
+    string queryJSON = json5("['SELECT', {WHAT: [['._id']], WHERE: ['MATCH', ['.', 'contact', 'address', 'street'], 'Hwy']}]");
+    {
+        ExpectingExceptions x;
+        CHECK(!c4query_new(db, c4str(queryJSON.c_str()), &err));
+        CHECK(err.code == kC4ErrorMissingIndex);
+    }
+
+    REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, nullptr, &err));
+    compileSelect(queryJSON);
+    CHECK(run() == (vector<string>{"0000013", "0000015", "0000043", "0000044", "0000052"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query incremental full-text index build", "[Query][C][FTS]") {
+    C4Error err;
+    C4IndexBuilder *builder = c4db_beginIndexBuild(db, C4STR("byStreet"),
+                                                   C4STR("[[\".contact.address.street\"]]"),
+                                                   kC4FullTextIndex, nullptr, &err);
+    REQUIRE(builder);
+    bool done;
+    REQUIRE(c4indexbuilder_step(builder, 30, &done, &err));
+    CHECK(!done);
+
+    // Change one indexed doc and purge another, both of which matched 'Hwy':
+    saveDoc(C4STR("0000013"), kRev2ID, "{contact: {address: {street: 'Main St'}}}");
+    REQUIRE(c4db_beginTransaction(db, &err));
+    REQUIRE(c4db_purgeDoc(db, C4STR("0000015"), &err));
+    REQUIRE(c4db_endTransaction(db, true, &err));
+
+    while (!done)
+        REQUIRE(c4indexbuilder_step(builder, 30, &done, &err));
+    c4indexbuilder_free(builder);
+
+    compile(json5("['MATCH', ['.', 'contact', 'address', 'street'], 'Hwy']"));
+    CHECK(run() == (vector<string>{"0000043", "0000044", "0000052"}));
+
+    // The rows indexed from their old revisions are gone, so they don't skew BM25 ranking:
+    for (const char *table : {"\"kv_default::.contact.address.street\"",
+                              "\"kv_default::.contact.address.street::seqs\""}) {
+        C4SliceResult rows = c4db_rawQuery(db, c4str((string("SELECT count(*) FROM ") + table).c_str()),
+                                           &err);
+        REQUIRE(rows.buf);
+        FLArray result = FLValue_AsArray(FLValue_FromTrustedData({rows.buf, rows.size}));
+        FLArray row = FLValue_AsArray(FLArray_Get(result, 0));
+        CHECK(FLValue_AsInt(FLArray_Get(row, 0)) == (int64_t)c4db_getDocumentCount(db));
+        c4slice_free(rows);
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD(PathsQueryTest, "DB Query ANY w/paths", "[Query][C]") {
     // For https://github.com/couchbase/couchbase-lite-core/issues/238
     compile(json5("['ANY','path',['.paths'],['=',['?path','city'],'San Jose']]"));
@@ -169,6 +514,20 @@ N_WAY_TEST_CASE_METHOD(PathsQueryTest, "DB Query ANY w/paths", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(PathsQueryTest, "DB Query ANY w/array index of dicts", "[Query][C]") {
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("paths"), C4STR("[[\".paths\"]]"), kC4ArrayIndex, nullptr, &err));
+
+    // The elements are dicts, so testing them with a function has to iterate the arrays:
+    compile(json5("['ANY','path',['.paths'],['isobject()',['?path']]]"));
+    CHECK(explain().find("fl_each") != string::npos);
+    CHECK(run() == (vector<string>{ "0000001", "0000002", "0000003" }));
+
+    compile(json5("['ANY','path',['.paths'],['=',['?path','city'],'San Jose']]"));
+    CHECK(run() == (vector<string>{ "0000001" }));
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query expression index", "[Query][C]") {
     C4Error err;
     REQUIRE(c4db_createIndex(db, C4STR("length"), c4str(json5("[['length()', ['.name.first']]]").c_str()), kC4ValueIndex, nullptr, &err));
@@ -178,6 +537,88 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query expression index", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query partial index", "[Query][C]") {
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("femaleNames"),
+                             c4str(json5("{WHAT: [['.name.first']], WHERE: ['=', ['.gender'], 'female']}").c_str()),
+                             kC4ValueIndex, nullptr, &err));
+
+    // A query with the index's condition can use it, even if it's written the other way round:
+    compile(json5("['AND', ['=', 'female', ['.gender']], ['=', ['.name.first'], 'Verna']]"));
+    CHECK(explain().find("USING INDEX femaleNames") != string::npos);
+    CHECK(run() == (vector<string>{"0000093"}));
+
+    // A query without it can't:
+    compile(json5("['=', ['.name.first'], 'Verna']"));
+    CHECK(explain().find("femaleNames") == string::npos);
+    CHECK(run() == (vector<string>{"0000093"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query LIKE prefix uses index", "[Query][C]") {
+    // Without an index the query is left alone:
+    compile(json5("['LIKE', ['.name.first'], 'ver%']"));
+    CHECK(explain().find("Rewrote for index use") == string::npos);
+    CHECK(run() == (vector<string>{"0000093"}));
+
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("byFirstName"), C4STR("[[\".name.first\"]]"),
+                             kC4ValueIndex, nullptr, &err));
+
+    // LIKE is case-insensitive, so the range has to cover 'Verna' as well as 'ver...':
+    compile(json5("['LIKE', ['.name.first'], 'ver%']"));
+    string explanation = explain();
+    CHECK(explanation.find("USING INDEX byFirstName") != string::npos);
+    CHECK(explanation.find("Rewrote for index use: LIKE 'ver%'") != string::npos);
+    CHECK(run() == (vector<string>{"0000093"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query lower() equality uses NOCASE index", "[Query][C]") {
+    // Without a NOCASE index the query is left alone:
+    compile(json5("['=', ['lower()', ['.name.first']], 'verna']"));
+    CHECK(explain().find("Rewrote for index use") == string::npos);
+    CHECK(run() == (vector<string>{"0000093"}));
+
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("byFirstNameNoCase"),
+                             C4STR("[[\"COLLATE\", {\"CASE\": false}, [\".name.first\"]]]"),
+                             kC4ValueIndex, nullptr, &err));
+    compile(json5("['=', ['lower()', ['.name.first']], 'verna']"));
+    string explanation = explain();
+    CHECK(explanation.find("USING INDEX byFirstNameNoCase") != string::npos);
+    CHECK(explanation.find("Rewrote for index use: lower() = 'verna'") != string::npos);
+    CHECK(run() == (vector<string>{"0000093"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query geo index", "[Query][C]") {
+    C4Error err;
+    {
+        TransactionHelper t(db);
+        for (int i = 0; i < 20; ++i) {
+            char docID[20], json[100];
+            sprintf(docID, "geo-%02d", i);
+            sprintf(json, "{geo: [%d.5, %d]}", i, -10 * i);
+            saveDoc(c4str(docID), kRevID, json);
+        }
+    }
+    REQUIRE(c4db_createIndex(db, C4STR("geo"), c4str(json5("[['.geo[0]'], ['.geo[1]']]").c_str()),
+                             kC4GeoIndex, nullptr, &err));
+
+    compile(json5("['WITHIN', [['.geo[0]'], ['.geo[1]']], [3, -100], [8.5, -50]]"));
+    auto result = run();
+    sort(result.begin(), result.end());
+    CHECK(result == (vector<string>{"geo-05", "geo-06", "geo-07", "geo-08"}));
+
+    // The index is updated when a document changes:
+    saveDoc(C4STR("geo-00"), kRev2ID, "{geo: [4, -60]}");
+    result = run();
+    sort(result.begin(), result.end());
+    CHECK(result == (vector<string>{"geo-00", "geo-05", "geo-06", "geo-07", "geo-08"}));
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "Delete indexed doc", "[Query][C]") {
     // Create the same index as the above test:
     C4Error err;
@@ -209,6 +650,63 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "Delete indexed doc", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query materialized property", "[Query][C]") {
+    auto caStates = vector<string>{"0000001", "0000015", "0000036", "0000043", "0000053", "0000064", "0000072", "0000073"};
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("state"), C4STR("[[\".contact.address.state\"]]"),
+                             kC4ValueIndex, nullptr, &err));
+    REQUIRE(c4db_materializeProperty(db, C4STR("contact.address.state"), &err));
+    REQUIRE(c4db_materializeProperty(db, C4STR(".contact.address.state"), &err));  // no-op
+
+    // The query reads the column instead of decoding the body, and still uses the index:
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"));
+    string explanationStr = explain();
+    INFO("Explanation: " << explanationStr);
+    CHECK(explanationStr.find("fl_value") == string::npos);
+    CHECK(explanationStr.find("USING INDEX state") != string::npos);
+    CHECK(run() == caStates);
+
+    // The column is updated when a document is saved:
+    saveDoc(C4STR("ca"), kRevID, "{contact: {address: {state: 'CA'}}}");
+    caStates.push_back("ca");
+    CHECK(run() == caStates);
+
+    // Arrays and dicts read from a column are still treated as Fleece values:
+    REQUIRE(c4db_materializeProperty(db, C4STR("contact.phone"), &err));
+    REQUIRE(c4db_materializeProperty(db, C4STR("likes"), &err));
+    compile(json5("['AND', ['=', ['array_count()', ['.', 'contact', 'phone']], 2],\
+                           ['=', ['.', 'gender'], 'male']]"));
+    CHECK(run() == (vector<string>{"0000002", "0000014", "0000017", "0000027", "0000031", "0000033", "0000038", "0000039", "0000045", "0000047",
+        "0000049", "0000056", "0000063", "0000065", "0000075", "0000082", "0000089", "0000094", "0000097"}));
+    compile(json5("['IN', 'reading', ['.', 'likes']]"));
+    CHECK(run() == (vector<string>{"0000004", "0000056", "0000064", "0000079", "0000099"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query materialized property from other connection", "[Query][C]") {
+    // A second connection, opened before the property is materialized, has to notice the new
+    // column and keep it updated when it saves documents:
+    C4Error err;
+    C4Database *db2 = c4db_openAgain(db, &err);
+    REQUIRE(db2);
+    C4SliceResult body = c4db_encodeJSON(db2, c4str(json5("{contact: {address: {state: 'CA'}}}").c_str()), &err);
+    REQUIRE(body.buf);
+    createRev(db2, C4STR("before"), kRevID, {body.buf, body.size});
+
+    REQUIRE(c4db_materializeProperty(db, C4STR("contact.address.state"), &err));
+    createRev(db2, C4STR("after"), kRevID, {body.buf, body.size});
+    c4slice_free(body);
+
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"));
+    auto result = run();
+    sort(result.begin(), result.end());
+    CHECK(result == (vector<string>{"0000001", "0000015", "0000036", "0000043", "0000053",
+                                    "0000064", "0000072", "0000073", "after", "before"}));
+    REQUIRE(c4db_close(db2, &err));
+    c4db_free(db2);
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "Full-text query", "[Query][C][FTS]") {
     C4Error err;
     REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, nullptr, &err));
@@ -217,6 +715,101 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "Full-text query", "[Query][C][FTS]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "Full-text query after updates", "[Query][C][FTS]") {
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, nullptr, &err));
+    compile(json5("['MATCH', ['.', 'contact', 'address', 'street'], 'Hwy']"));
+
+    // Same text, so the FTS row is kept; then different text, so it's replaced:
+    saveDoc(C4STR("0000013"), kRev2ID, "{contact: {address: {street: '4 Hwy 36'}}, x: 1}");
+    saveDoc(C4STR("0000015"), kRev2ID, "{contact: {address: {street: '1 Main St'}}}");
+    saveDoc(C4STR("0000013"), kRev3ID, "{contact: {address: {street: '4 Hwy 36'}}, x: 2}");
+    saveDoc(C4STR("0000001"), kRev2ID, "{contact: {address: {street: '5 Hwy 9'}}}");
+    auto result = run();
+    sort(result.begin(), result.end());
+    CHECK(result == (vector<string>{"0000001", "0000013", "0000043", "0000044", "0000052"}));
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "Full-text prefix query", "[Query][C][FTS]") {
+    C4Error err;
+    C4IndexOptions indexOptions = {};
+    indexOptions.prefixLengths = "1,x";
+    {
+        ExpectingExceptions x;
+        CHECK(!c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, &indexOptions, &err));
+        CHECK(err.domain == LiteCoreDomain);
+        CHECK(err.code == kC4ErrorInvalidParameter);
+    }
+
+    // Prefix indexes only make prefix searches faster; the results and ranking are the same.
+    // (Rows with the same rank are sorted by docID, so the order is fully determined.)
+    auto runPrefixQuery = [&]() {
+        compile(json5("['MATCH', ['.', 'contact', 'address', 'street'], 'Hw*']"),
+                json5("[['DESC', ['rank()', ['.', 'contact', 'address', 'street']]], ['._id']]"));
+        return run();
+    };
+    REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, nullptr, &err));
+    auto unprefixed = runPrefixQuery();
+    CHECK(unprefixed.size() >= 5);
+
+    // Creating the index again with prefix lengths rebuilds it:
+    c4query_free(query);
+    query = nullptr;
+    indexOptions.prefixLengths = "1,2, 3";
+    REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, &indexOptions, &err));
+    C4SliceResult schema = c4db_rawQuery(db, C4STR("SELECT sql FROM sqlite_master WHERE "
+                                                   "name='kv_default::.contact.address.street'"), &err);
+    REQUIRE(schema.buf);
+    FLArray rows = FLValue_AsArray(FLValue_FromTrustedData({schema.buf, schema.size}));
+    FLArray row = FLValue_AsArray(FLArray_Get(rows, 0));
+    string tableSQL = fleece::slice(FLValue_AsString(FLArray_Get(row, 0))).asString();
+    c4slice_free(schema);
+    CHECK(tableSQL.find("prefix=\"1,2,3\"") != string::npos);
+    CHECK(runPrefixQuery() == unprefixed);
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "Deferred full-text index", "[Query][C][FTS]") {
+    C4Error err;
+    C4IndexOptions indexOptions = {};
+    indexOptions.deferred = true;
+    REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, &indexOptions, &err));
+    compile(json5("['MATCH', ['.', 'contact', 'address', 'street'], 'Hwy']"));
+    CHECK(run() == (vector<string>{"0000013", "0000015", "0000043", "0000044", "0000052"}));
+
+    auto runStale = [&]() {
+        C4QueryOptions options = kC4DefaultQueryOptions;
+        options.allowStaleFullText = true;
+        auto e = c4query_run(query, &options, kC4SliceNull, &err);
+        REQUIRE(e);
+        vector<string> docIDs;
+        while (c4queryenum_next(e, &err))
+            docIDs.push_back(fleece::slice(FLValue_AsString(FLArrayIterator_GetValueAt(&e->columns, 0))).asString());
+        CHECK(err.code == 0);
+        c4queryenum_free(e);
+        sort(docIDs.begin(), docIDs.end());
+        return docIDs;
+    };
+
+    // Saving a document only queues it, so a query that allows stale results doesn't see it yet:
+    saveDoc(C4STR("0000001"), kRev2ID, "{contact: {address: {street: '1 Lonely Hwy'}}}");
+    CHECK(runStale() == (vector<string>{"0000013", "0000015", "0000043", "0000044", "0000052"}));
+
+    // A regular query catches up the index first:
+    auto result = run();
+    sort(result.begin(), result.end());
+    CHECK(result == (vector<string>{"0000001", "0000013", "0000015", "0000043", "0000044", "0000052"}));
+
+    // Or the queue can be indexed explicitly:
+    saveDoc(C4STR("0000013"), kRev2ID, "{contact: {address: {street: '2 Main St'}}}");
+    bool done = false;
+    REQUIRE(c4db_updateDeferredIndexes(db, 100, &done, &err));
+    CHECK(done);
+    CHECK(runStale() == (vector<string>{"0000001", "0000015", "0000043", "0000044", "0000052"}));
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "Multiple Full-text indexes", "[Query][C][FTS]") {
     C4Error err;
     REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, nullptr, &err));
@@ -227,6 +820,56 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "Multiple Full-text indexes", "[Query][C][FTS]
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "Full-text matched text in batches", "[Query][C][FTS]") {
+    C4Error err;
+    REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, nullptr, &err));
+    compile(json5("['MATCH', ['.', 'contact', 'address', 'street'], 'Hwy']"));
+    CHECK(c4query_fullTextMatchCount(query) == 1);
+
+    vector<C4FullTextID> ids;
+    vector<vector<C4FullTextTerm>> terms;
+    auto e = c4query_run(query, &kC4DefaultQueryOptions, kC4SliceNull, &err);
+    REQUIRE(e);
+    while (c4queryenum_next(e, &err)) {
+        ids.push_back(e->fullTextID);
+        terms.emplace_back(e->fullTextTerms, e->fullTextTerms + e->fullTextTermCount);
+    }
+    c4queryenum_free(e);
+    REQUIRE(ids.size() == 5);
+
+    vector<C4SliceResult> texts(ids.size());
+    REQUIRE(c4query_fullTextMatchedBatch(query, ids.data(), ids.size(), texts.data(), &err));
+    for (size_t i = 0; i < ids.size(); ++i) {
+        C4SliceResult text = c4query_fullTextMatched(query, ids[i], &err);
+        CHECK(fleece::slice(text.buf, text.size) == fleece::slice(texts[i].buf, texts[i].size));
+        c4slice_free(text);
+        REQUIRE(terms[i].size() >= 1);
+        for (auto &term : terms[i]) {
+            REQUIRE(term.start + term.length <= texts[i].size);
+            CHECK(string((const char*)texts[i].buf + term.start, term.length) == "Hwy");
+        }
+        c4slice_free(texts[i]);
+    }
+
+    // Two MATCH expressions give two texts per row:
+    REQUIRE(c4db_createIndex(db, C4STR("byCity"), C4STR("[[\".contact.address.city\"]]"), kC4FullTextIndex, nullptr, &err));
+    compile(json5("['AND', ['MATCH', ['.', 'contact', 'address', 'street'], 'Hwy'],\
+                           ['MATCH', ['.', 'contact', 'address', 'city'], 'Santa']]"));
+    CHECK(c4query_fullTextMatchCount(query) == 2);
+    e = c4query_run(query, &kC4DefaultQueryOptions, kC4SliceNull, &err);
+    REQUIRE(e);
+    REQUIRE(c4queryenum_next(e, &err));
+    C4FullTextID id = e->fullTextID;
+    c4queryenum_free(e);
+    C4SliceResult rowTexts[2];
+    REQUIRE(c4query_fullTextMatchedBatch(query, &id, 1, rowTexts, &err));
+    CHECK(string((const char*)rowTexts[0].buf, rowTexts[0].size).find("Hwy") != string::npos);
+    CHECK(string((const char*)rowTexts[1].buf, rowTexts[1].size).find("Santa") != string::npos);
+    c4slice_free(rowTexts[0]);
+    c4slice_free(rowTexts[1]);
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "Full-text query in multiple ANDs", "[Query][C][FTS]") {
     C4Error err;
     REQUIRE(c4db_createIndex(db, C4STR("byStreet"), C4STR("[[\".contact.address.street\"]]"), kC4FullTextIndex, nullptr, &err));
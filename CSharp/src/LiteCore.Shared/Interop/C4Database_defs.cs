@@ -42,6 +42,7 @@ namespace LiteCore.Interop
         SharedKeys    = 0x10,
         NoUpgrade     = 0x20,
         NonObservable = 0x40,
+        CompressBodies = 0x80,
     }
 
 #if LITECORE_PACKAGED
@@ -38,6 +38,23 @@ namespace LiteCore.Interop
         ValueIndex,
         FullTextIndex,
         GeoIndex,
+        ArrayIndex,
+    }
+
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+    enum C4BatchColumnType : byte
+    {
+        Null,
+        Int,
+        Double,
+        Bool,
+        String,
+        Blob,
+        Fleece,
     }
 
 #if LITECORE_PACKAGED
@@ -57,6 +74,8 @@ namespace LiteCore.Interop
     unsafe partial struct C4QueryOptions
     {
         private byte _rankFullText;
+        private byte _streaming;
+        private byte _allowStaleFullText;
 
         public bool rankFullText
         {
@@ -67,6 +86,26 @@ namespace LiteCore.Interop
                 _rankFullText = Convert.ToByte(value);
             }
         }
+
+        public bool streaming
+        {
+            get {
+                return Convert.ToBoolean(_streaming);
+            }
+            set {
+                _streaming = Convert.ToByte(value);
+            }
+        }
+
+        public bool allowStaleFullText
+        {
+            get {
+                return Convert.ToBoolean(_allowStaleFullText);
+            }
+            set {
+                _allowStaleFullText = Convert.ToByte(value);
+            }
+        }
     }
 
 #if LITECORE_PACKAGED
@@ -78,6 +117,8 @@ namespace LiteCore.Interop
     {
         private IntPtr _language;
         private byte _ignoreDiacritics;
+        private byte _deferred;
+        private IntPtr _prefixLengths;
 
         public string language
         {
@@ -99,6 +140,27 @@ namespace LiteCore.Interop
                 _ignoreDiacritics = Convert.ToByte(value);
             }
         }
+
+        public bool deferred
+        {
+            get {
+                return Convert.ToBoolean(_deferred);
+            }
+            set {
+                _deferred = Convert.ToByte(value);
+            }
+        }
+
+        public string prefixLengths
+        {
+            get {
+                return Marshal.PtrToStringAnsi(_prefixLengths);
+            }
+            set {
+                var old = Interlocked.Exchange(ref _prefixLengths, Marshal.StringToHGlobalAnsi(value));
+                Marshal.FreeHGlobal(old);
+            }
+        }
     }
 
 #if LITECORE_PACKAGED
@@ -124,4 +186,32 @@ namespace LiteCore.Interop
         public uint termIndex;
         public uint start, length;
     }
+
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+    unsafe struct C4BatchColumn
+    {
+        public C4BatchColumnType type;
+        public byte* isNull;
+        public long* ints;
+        public double* doubles;
+        public byte* bools;
+        public uint* offsets;
+        public byte* data;
+    }
+
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+    unsafe struct C4QueryBatch
+    {
+        public uint rowCount;
+        public uint columnCount;
+        public C4BatchColumn* columns;
+    }
 }
\ No newline at end of file
@@ -37,6 +37,7 @@ public interface C4Constants {
         int kC4DB_SharedKeys = 0x10;    ///< Enable shared-keys optimization at creation time
         int kC4DB_NoUpgrade = 0x20;     ///< Disable upgrading an older-version database
         int kC4DB_NonObservable = 0x40; ///< Disable c4DatabaseObserver
+        int kC4DB_CompressBodies = 0x80; ///< Store large document bodies compressed (Snappy)
     }
 
     // Document versioning system (also determines database storage schema)
@@ -101,7 +102,8 @@ public interface C4Constants {
     interface C4IndexType {
         int kC4ValueIndex = 0; ///< Regular index of property value
         int kC4FullTextIndex = 1; ///< Full-text index
-        int kC4GeoIndex = 2; ///< Geospatial index of GeoJSON values (NOT YET IMPLEMENTED)
+        int kC4GeoIndex = 2; ///< Geospatial (R-tree) index of numeric coordinates
+        int kC4ArrayIndex = 3; ///< Index of the elements of an array property
     }
 
     ////////////////////////////////////
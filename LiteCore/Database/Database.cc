@@ -101,6 +101,7 @@ namespace c4Internal {
         options.create = (config.flags & kC4DB_Create) != 0;
         options.writeable = (config.flags & kC4DB_ReadOnly) == 0;
         options.useDocumentKeys = (config.flags & kC4DB_SharedKeys) != 0;
+        options.keyStores.compressBodies = (config.flags & kC4DB_CompressBodies) != 0;
 
         options.encryptionAlgorithm = (EncryptionAlgorithm)config.encryptionKey.algorithm;
         if (options.encryptionAlgorithm != kNoEncryption) {
@@ -513,7 +514,10 @@ namespace c4Internal {
 
     
     bool Database::purgeDocument(slice docID) {
-        return defaultKeyStore().del(docID, transaction());
+        if (!defaultKeyStore().del(docID, transaction()))
+            return false;
+        _documentFactory->documentPurged(docID);
+        return true;
     }
 
 
@@ -585,8 +589,13 @@ namespace c4Internal {
 
     void Database::saved(Document* doc) {
         if (_sequenceTracker) {
-            lock_guard<mutex> lock(_sequenceTracker->mutex());
             Assert(doc->selectedRev.sequence == doc->sequence); // The new revision must be selected
+            if (_batchingSaves) {
+                _batchedSaves.push_back({doc->_docIDBuf, doc->_selectedRevIDBuf,
+                                         doc->selectedRev.sequence, doc->selectedRev.body.size});
+                return;
+            }
+            lock_guard<mutex> lock(_sequenceTracker->mutex());
             _sequenceTracker->documentChanged(doc->_docIDBuf,
                                               doc->_selectedRevIDBuf,
                                               doc->selectedRev.sequence,
@@ -594,4 +603,29 @@ namespace c4Internal {
         }
     }
 
+
+    void Database::beginBatchedSaves() {
+        if (!inTransaction())
+            error::_throw(error::NotInTransaction);
+        _batchingSaves = true;
+    }
+
+
+    void Database::endBatchedSaves() {
+        _batchingSaves = false;
+        if (_sequenceTracker && !_batchedSaves.empty()) {
+            lock_guard<mutex> lock(_sequenceTracker->mutex());
+            for (auto &change : _batchedSaves)
+                _sequenceTracker->documentChanged(change.docID, change.revID,
+                                                  change.sequence, change.bodySize);
+        }
+        _batchedSaves.clear();
+    }
+
+
+    void Database::discardBatchedSaves() noexcept {
+        _batchingSaves = false;
+        _batchedSaves.clear();
+    }
+
 }
@@ -17,6 +17,7 @@
 #include <memory>
 #include <mutex>
 #include <unordered_set>
+#include <vector>
 
 namespace fleece {
     class Encoder;
@@ -75,6 +76,24 @@ namespace c4Internal {
 
         bool inTransaction() noexcept;
 
+        // While batching saves, document changes are collected and passed to the
+        // SequenceTracker all at once by endBatchedSaves(), instead of one lock per document.
+        // Must be called within a transaction.
+        void beginBatchedSaves();
+        void endBatchedSaves();
+
+        // Batches saves for its lifetime. If it's destroyed without end() being called, as when
+        // an exception aborts the transaction, the collected changes are discarded.
+        class BatchedSaves {
+        public:
+            explicit BatchedSaves(Database *db)     :_db(db) {_db->beginBatchedSaves();}
+            ~BatchedSaves()                         {if (_db) _db->discardBatchedSaves();}
+            void end()                              {auto db = _db; _db = nullptr;
+                                                     db->endBatchedSaves();}
+        private:
+            Database *_db;
+        };
+
         KeyStore& defaultKeyStore();
         KeyStore& getKeyStore(const string &name) const;
 
@@ -120,6 +139,7 @@ namespace c4Internal {
                                            C4StorageEngine &outStorageEngine);
         static bool deleteDatabaseFileAtPath(const string &dbPath, C4StorageEngine);
         void _cleanupTransaction(bool committed);
+        void discardBatchedSaves() noexcept;
         
         std::unique_ptr<BlobStore> createBlobStore(const std::string &dirname, C4EncryptionKey);
         std::unordered_set<std::string> collectBlobs();
@@ -131,6 +151,13 @@ namespace c4Internal {
         unique_ptr<DocumentFactory> _documentFactory;       // Instantiates C4Documents
         unique_ptr<fleece::Encoder> _encoder;
         unique_ptr<SequenceTracker> _sequenceTracker;       // Doc change tracker/notifier
+        struct SavedChange {
+            alloc_slice docID, revID;
+            sequence_t sequence;
+            uint64_t bodySize;
+        };
+        bool                        _batchingSaves {false}; // Between begin/endBatchedSaves?
+        vector<SavedChange>         _batchedSaves;          // Changes not yet sent to tracker
         unique_ptr<BlobStore>       _blobStore;
         uint32_t                    _maxRevTreeDepth {0};
         recursive_mutex             _clientMutex;
@@ -151,6 +178,8 @@ namespace c4Internal {
         virtual Document* newDocumentInstance(const Record&) =0;
         virtual alloc_slice revIDFromVersion(slice version) =0;
         virtual bool isFirstGenRevID(slice revID)               {return false;}
+        /** Called after a document's record has been purged from the default KeyStore. */
+        virtual void documentPurged(slice docID)                { }
 
     private:
         Database* const _db;
@@ -165,6 +194,7 @@ namespace c4Internal {
         Document* newDocumentInstance(const Record&) override;
         alloc_slice revIDFromVersion(slice version) override;
         bool isFirstGenRevID(slice revID) override;
+        void documentPurged(slice docID) override;
         static DataFile::FleeceAccessor fleeceAccessor();
     };
 
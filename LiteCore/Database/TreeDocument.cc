@@ -69,7 +69,7 @@ namespace c4Internal {
 
         void init() {
             docID = _docIDBuf = _versionedDoc.docID();
-            flags = (C4DocumentFlags)_versionedDoc.flags();
+            flags = (C4DocumentFlags)publicFlags(_versionedDoc.flags());
             if (_versionedDoc.exists())
                 flags = (C4DocumentFlags)(flags | kDocExists);
 
@@ -102,6 +102,17 @@ namespace c4Internal {
             }
         }
 
+        // Makes sure the non-current revisions are in memory; they're loaded lazily.
+        bool loadHistory() noexcept {
+            try {
+                _versionedDoc.loadHistory();
+                return true;
+            } catch (const std::exception &x) {
+                Warn("Couldn't load revision history of '%.*s': %s", SPLAT(docID), x.what());
+                return false;
+            }
+        }
+
         bool hasRevisionBody() noexcept override {
             if (!revisionsLoaded())
                 Warn("c4doc_hasRevisionBody called on doc loaded without kC4IncludeBodies");
@@ -157,16 +168,18 @@ namespace c4Internal {
         bool selectParentRevision() noexcept override {
             if (!revisionsLoaded())
                 Warn("Trying to access revision tree of doc loaded without kC4IncludeBodies");
-            if (_selectedRev)
-                selectRevision(_selectedRev->parent);
+            if (!_selectedRev || !loadHistory())
+                return false;
+            selectRevision(_selectedRev->parent);
             return _selectedRev != nullptr;
         }
 
         bool selectNextRevision() noexcept override {    // does not throw
             if (!revisionsLoaded())
                 Warn("Trying to access revision tree of doc loaded without kC4IncludeBodies");
-            if (_selectedRev)
-                selectRevision(_selectedRev->next());
+            if (!_selectedRev || !loadHistory())
+                return false;
+            selectRevision(_selectedRev->next());
             return _selectedRev != nullptr;
         }
 
@@ -174,7 +187,7 @@ namespace c4Internal {
             if (!revisionsLoaded())
                 Warn("Trying to access revision tree of doc loaded without kC4IncludeBodies");
             auto rev = _selectedRev;
-            if (!rev)
+            if (!rev || !loadHistory())
                 return false;
             do {
                 rev = rev->next();
@@ -205,7 +218,7 @@ namespace c4Internal {
 
         void updateMeta() {
             _versionedDoc.updateMeta();
-            flags = (C4DocumentFlags)_versionedDoc.flags() | kDocExists;
+            flags = (C4DocumentFlags)publicFlags(_versionedDoc.flags()) | kDocExists;
             initRevID();
         }
 
@@ -310,6 +323,11 @@ namespace c4Internal {
         return revID.hasPrefix(slice("1-", 2));
     }
 
+    void TreeDocumentFactory::documentPurged(slice docID) {
+        VersionedDocument::purgeHistory(database()->defaultKeyStore(), docID,
+                                        database()->transaction());
+    }
+
 
 
 #pragma mark - INSERTING REVISIONS
@@ -70,7 +70,7 @@ namespace c4Internal {
             _revIDBuf = _current->revID();
             revID = _revIDBuf;
             sequence = _current->sequence();
-            flags = (C4DocumentFlags)_current->flags();
+            flags = (C4DocumentFlags)publicFlags(_current->flags());
             if (_current->exists())
                 flags = (C4DocumentFlags)(flags | kDocExists);
         }
@@ -16,10 +16,204 @@
 #include "Query.hh"
 #include "KeyStore.hh"
 #include "Logging.hh"
+#include "Fleece.hh"
+
+using namespace std;
+using namespace fleece;
 
 
 namespace litecore {
 
     LogDomain QueryLog("Query");
 
+
+#pragma mark - QUERY BATCH:
+
+
+    static QueryBatch::ColumnType columnTypeOf(const Value *value) {
+        if (!value)
+            return QueryBatch::kNullColumn;
+        switch (value->type()) {
+            case kNull:     return QueryBatch::kNullColumn;
+            case kBoolean:  return QueryBatch::kBoolColumn;
+            case kNumber:
+                if (!value->isInteger())
+                    return QueryBatch::kDoubleColumn;
+                else if (value->isUnsigned() && value->asUnsigned() > (uint64_t)INT64_MAX)
+                    return QueryBatch::kFleeceColumn;   // too big for `ints`
+                else
+                    return QueryBatch::kIntColumn;
+            case kString:   return QueryBatch::kStringColumn;
+            case kData:     return QueryBatch::kBlobColumn;
+            default:        return QueryBatch::kFleeceColumn;
+        }
+    }
+
+
+    static bool isNumeric(QueryBatch::ColumnType type) {
+        return type == QueryBatch::kIntColumn || type == QueryBatch::kDoubleColumn;
+    }
+
+
+    // True if converting `i` to a double and back gives `i`.
+    static bool isExactDouble(int64_t i) {
+        double d = (double)i;
+        return d >= -9223372036854775808.0 && d < 9223372036854775808.0 && (int64_t)d == i;
+    }
+
+
+    void QueryBatch::clear() {
+        rowCount = 0;
+        columns.clear();
+    }
+
+
+    void QueryBatch::addRow(Array::iterator row) {
+        if (rowCount == 0)
+            columns.resize(row.count());
+        for (unsigned i = 0; i < columns.size(); ++i)
+            columns[i].add(i < row.count() ? row[i] : nullptr);
+        ++rowCount;
+    }
+
+
+    // Appends a value. If its type doesn't match the column's, the column changes to a type
+    // that can hold both exactly: mixed ints and doubles widen to doubles if every int
+    // converts exactly, and anything else (including bools mixed with numbers) becomes Fleece.
+    void QueryBatch::Column::add(const Value *value) {
+        ColumnType valueType = columnTypeOf(value);
+        if (valueType != kNullColumn && valueType != type) {
+            if (type == kNullColumn)
+                changeType(valueType);
+            else if (isNumeric(type) && isNumeric(valueType) && intsAreExactDoubles(value))
+                changeType(kDoubleColumn);
+            else
+                changeType(kFleeceColumn);
+        }
+
+        bool null = (valueType == kNullColumn);
+        isNull.push_back(null);
+        switch (type) {
+            case kNullColumn:
+                break;
+            case kIntColumn:
+                ints.push_back(null ? 0 : value->asInt());
+                break;
+            case kDoubleColumn:
+                doubles.push_back(null ? 0.0 : value->asDouble());
+                break;
+            case kBoolColumn:
+                bools.push_back(!null && value->asBool());
+                break;
+            case kStringColumn:
+            case kBlobColumn:
+                appendBytes(null ? nullslice : (type == kStringColumn ? value->asString()
+                                                                      : value->asData()));
+                break;
+            case kFleeceColumn:
+                if (null) {
+                    appendBytes(nullslice);
+                } else {
+                    Encoder enc;
+                    enc.writeValue(value);
+                    appendBytes(enc.extractOutput());
+                }
+                break;
+        }
+    }
+
+
+    // True if the column's ints, and `value` if it's an int, can all be stored as doubles.
+    bool QueryBatch::Column::intsAreExactDoubles(const Value *value) const {
+        if (value->isInteger() && !isExactDouble(value->asInt()))
+            return false;
+        if (type == kIntColumn) {
+            for (size_t row = 0; row < ints.size(); ++row) {
+                if (!isNull[row] && !isExactDouble(ints[row]))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+
+    void QueryBatch::Column::appendBytes(slice bytes) {
+        if (offsets.empty())
+            offsets.push_back(0);
+        data.insert(data.end(), (const uint8_t*)bytes.buf, (const uint8_t*)bytes.buf + bytes.size);
+        offsets.push_back((uint32_t)data.size());
+    }
+
+
+    // Appends the Fleece encoding of one of this column's values to another column.
+    void QueryBatch::Column::appendFleeceTo(Column &dst, size_t row) const {
+        if (isNull[row]) {
+            dst.appendBytes(nullslice);
+            return;
+        }
+        Encoder enc;
+        switch (type) {
+            case kIntColumn:    enc.writeInt(ints[row]); break;
+            case kDoubleColumn: enc.writeDouble(doubles[row]); break;
+            case kBoolColumn:   enc.writeBool(bools[row] != 0); break;
+            case kStringColumn:
+            case kBlobColumn: {
+                slice bytes(data.data() + offsets[row], offsets[row + 1] - offsets[row]);
+                if (type == kStringColumn)
+                    enc.writeString(bytes);
+                else
+                    enc.writeData(bytes);
+                break;
+            }
+            default:            enc.writeNull(); break;
+        }
+        dst.appendBytes(enc.extractOutput());
+    }
+
+
+    // Converts the values already in the column to a new type.
+    void QueryBatch::Column::changeType(ColumnType newType) {
+        size_t nRows = isNull.size();
+        Column converted;
+        converted.type = newType;
+        converted.isNull = isNull;
+        for (size_t row = 0; row < nRows; ++row) {
+            switch (newType) {
+                case kIntColumn:
+                    converted.ints.push_back(0);
+                    break;
+                case kDoubleColumn:
+                    converted.doubles.push_back(type == kIntColumn ? (double)ints[row] : 0.0);
+                    break;
+                case kBoolColumn:
+                    converted.bools.push_back(0);
+                    break;
+                case kStringColumn:
+                case kBlobColumn:
+                    converted.appendBytes(nullslice);
+                    break;
+                case kFleeceColumn:
+                    if (type == kNullColumn)
+                        converted.appendBytes(nullslice);
+                    else
+                        appendFleeceTo(converted, row);
+                    break;
+                default:
+                    break;
+            }
+        }
+        *this = move(converted);
+    }
+
+
+#pragma mark - QUERY ENUMERATOR:
+
+
+    bool QueryEnumerator::nextBatch(QueryBatch &batch, unsigned maxRows) {
+        batch.clear();
+        while (batch.rowCount < maxRows && next())
+            batch.addRow(columns());
+        return batch.rowCount > 0;
+    }
+
 }
@@ -27,16 +27,42 @@ namespace litecore {
         virtual unsigned columnCount() const noexcept                   {return 0;}
         virtual std::string nameOfColumn(unsigned col) const            {return "";}
 
+        /** The number of full-text ('MATCH') expressions in the query. */
+        virtual unsigned fullTextMatchCount() const noexcept            {return 0;}
+
         virtual alloc_slice getMatchedText(FullTextID)                  {return alloc_slice();}
 
+        /** Returns the text matched by the query's full-text ('MATCH') expressions in each of the
+            given rows: a vector per FullTextID, with a text for each expression in order of
+            appearance in the query (null if the row has none.) */
+        virtual std::vector<std::vector<alloc_slice>> getMatchedTexts(const std::vector<FullTextID>&)
+                                                                        {return {};}
+
         virtual std::string explain()                                   {return "";}
 
         struct Options {
             alloc_slice paramBindings;
+            bool streaming {false};     ///< Step the query lazily instead of pre-recording rows
+            bool allowStaleFullText {false}; ///< Don't catch up deferred full-text indexes
         };
 
         virtual QueryEnumerator* createEnumerator(const Options* =nullptr) =0;
 
+        /** True if every result row comes from a single document, independently of the others,
+            so that the results can be kept up to date by re-evaluating only changed documents. */
+        virtual bool isPerDocument() const                              {return false;}
+
+        /** Runs a per-document query, calling the callback with each row's docID and its result
+            columns (encoded as a Fleece array.) */
+        virtual void getRowsByDocID(const Options*,
+                                    function_ref<void(slice docID, slice row)>)
+                                                                {error::_throw(error::Unimplemented);}
+
+        /** Evaluates a per-document query against a single document, returning its encoded
+            result columns, or a null slice if the document isn't in the results. */
+        virtual alloc_slice getRowForDocID(slice docID, const Options*)
+                                                                {error::_throw(error::Unimplemented);}
+
     protected:
         Query(KeyStore &keyStore) noexcept
         :_keyStore(keyStore)
@@ -49,6 +75,48 @@ namespace litecore {
     };
 
 
+    /** A batch of query rows in columnar form, as filled in by QueryEnumerator::nextBatch().
+        Each column has one entry per row in its values array, or in its `offsets` (plus a final
+        entry) if its values are variable-length; null or missing values have placeholders. */
+    struct QueryBatch {
+        enum ColumnType : uint8_t {
+            kNullColumn,        ///< Every value is null or missing
+            kIntColumn,         ///< Values are in `ints`
+            kDoubleColumn,      ///< Values are in `doubles`
+            kBoolColumn,        ///< Values are in `bools`
+            kStringColumn,      ///< UTF-8 strings, in `data` delimited by `offsets`
+            kBlobColumn,        ///< Binary data, in `data` delimited by `offsets`
+            kFleeceColumn,      ///< Mixed or collection values, as encoded Fleece in `data`
+        };
+
+        struct Column {
+            ColumnType type {kNullColumn};
+            std::vector<uint8_t> isNull;        ///< 1 if the row's value is null or missing
+            std::vector<int64_t> ints;
+            std::vector<double> doubles;
+            std::vector<uint8_t> bools;
+            std::vector<uint32_t> offsets;      ///< Start of each row's value in `data`
+            std::vector<uint8_t> data;
+
+            /** Appends a value, changing the column's type if needed to one that holds every
+                value exactly: ints mixed with doubles become doubles unless an int can't be
+                represented as one, and any other mix becomes kFleeceColumn. */
+            void add(const fleece::Value*);
+        private:
+            bool intsAreExactDoubles(const fleece::Value*) const;
+            void changeType(ColumnType);
+            void appendBytes(slice);
+            void appendFleeceTo(Column &dst, size_t row) const;
+        };
+
+        unsigned rowCount {0};
+        std::vector<Column> columns;
+
+        void clear();
+        void addRow(fleece::Array::iterator columns);
+    };
+
+
     /** Iterator/enumerator of query results. Abstract class created by Query::createEnumerator. */
     class QueryEnumerator {
     public:
@@ -58,8 +126,12 @@ namespace litecore {
 
         virtual fleece::Array::iterator columns() const noexcept =0;
 
-        /** Random access to rows. May not be supported by all implementations, but does work with
-            the current SQLite query implementation. */
+        /** Reads up to `maxRows` rows into `batch`, replacing its contents. Returns false if there
+            were no more rows. */
+        virtual bool nextBatch(QueryBatch &batch, unsigned maxRows);
+
+        /** Random access to rows. May not be supported by all implementations; the SQLite
+            implementation supports it unless the `streaming` option was used. */
         virtual int64_t getRowCount() const         {return -1;}
         virtual void seek(uint64_t rowIndex)        {error::_throw(error::UnsupportedOperation);}
 
@@ -37,6 +37,7 @@ namespace litecore {
     static constexpr slice kValueFnName = "fl_value"_sl;
     static constexpr slice kRootFnName  = "fl_root"_sl;
     static constexpr slice kEachFnName  = "fl_each"_sl;
+    static constexpr slice kEachParamFnName = "fl_each_param"_sl;
     static constexpr slice kCountFnName = "fl_count"_sl;
     static constexpr slice kExistsFnName= "fl_exists"_sl;
 
@@ -145,8 +146,11 @@ namespace litecore {
         _parameters.clear();
         _variables.clear();
         _ftsTables.clear();
+        _geoTables.clear();
+        _rewrites.clear();
         _1stCustomResultCol = 0;
-        _isAggregateQuery = _aggregatesOK = false;
+        _isAggregateQuery = _aggregatesOK = _writingResultColumns = false;
+        _isPerDocumentQuery = _hasSubquery = false;
     }
 
 
@@ -233,6 +237,8 @@ namespace litecore {
         for (auto ftsTable : _ftsTables) {
             _sql << (nCol++ ? ", " : "") << "offsets(\"" << ftsTable << "\")";
         }
+        if (_trackDocIDs)
+            _sql << (nCol++ ? ", " : "") << defaultTablePrefix << "key";
         _1stCustomResultCol = nCol;
 
         auto nCustomCol = writeSelectListClause(operands, "WHAT"_sl, (nCol ? ", " : ""), true);
@@ -271,6 +277,10 @@ namespace litecore {
         // LIMIT, OFFSET clauses:
         writeOrderOrLimitClause(operands, "LIMIT"_sl,  "LIMIT");
         writeOrderOrLimitClause(operands, "OFFSET"_sl, "OFFSET");
+
+        _isPerDocumentQuery = !_isAggregateQuery && !_hasSubquery && _aliases.size() <= 1
+                                && !getCaseInsensitive(operands, "LIMIT"_sl)
+                                && !getCaseInsensitive(operands, "OFFSET"_sl);
     }
 
 
@@ -290,7 +300,9 @@ namespace litecore {
         _context.push_back(&kExpressionListOperation); // suppresses parens around arg list
         Array::iterator items(list);
         _aggregatesOK = aggregatesOK;
+        _writingResultColumns = (key == "WHAT"_sl);
         writeColumnList(items);
+        _writingResultColumns = false;
         _aggregatesOK = false;
         _context.pop_back();
         return count;
@@ -312,6 +324,12 @@ namespace litecore {
             }
             writeNotDeletedTest(0);
         }
+        if (_restrictToDocID) {
+            _sql << ((_includeDeleted && !where) ? " WHERE " : " AND ");
+            if (!_aliases.empty())
+                _sql << '"' << _aliases[0] << "\".";
+            _sql << "key = " << kDocIDParameterName;
+        }
     }
 
 
@@ -326,12 +344,21 @@ namespace litecore {
     }
 
 
-    void QueryParser::writeCreateIndex(const string &name, const Array *expressions) {
+    void QueryParser::writeCreateIndex(const string &name,
+                                       const Array *expressions,
+                                       const Value *where)
+    {
         reset();
         _sql << "CREATE INDEX \"" << name << "\" ON " << _tableName << " ";
         Array::iterator iter(expressions);
         writeColumnList(iter);
-        // TODO: Add 'WHERE' clause for use with SQLite 3.15+
+        if (where) {
+            // SQLite only uses a partial index for a query whose WHERE clause contains every term
+            // of the index's, so write it exactly the way a query's WHERE clause is written:
+            writeWhereClause(where);
+            require(_parameters.empty(), "Index WHERE clause can't use parameters");
+            require(!_hasSubquery, "Index WHERE clause can't contain a SELECT");
+        }
     }
 
 
@@ -396,8 +423,15 @@ namespace litecore {
             ++ftsTableNo;
             if (i > 1)
                 _sql << ",";
-            _sql << " JOIN \"" << ftsTable << "\" AS FTS" << ftsTableNo
-                 << " ON FTS" << ftsTableNo << ".rowid = kv_default.sequence";
+            if (_mappedFTSTables.find(ftsTable) != _mappedFTSTables.end()) {
+                _sql << " JOIN \"" << ftsTable << "::seqs\" AS FTSSEQS" << ftsTableNo
+                     << " ON FTSSEQS" << ftsTableNo << ".kvSequence = kv_default.sequence"
+                     << " JOIN \"" << ftsTable << "\" AS FTS" << ftsTableNo
+                     << " ON FTS" << ftsTableNo << ".rowid = FTSSEQS" << ftsTableNo << ".ftsRowid";
+            } else {
+                _sql << " JOIN \"" << ftsTable << "\" AS FTS" << ftsTableNo
+                     << " ON FTS" << ftsTableNo << ".rowid = kv_default.sequence";
+            }
         }
     }
 
@@ -551,6 +585,166 @@ namespace litecore {
     }
 
 
+    // Handles comparison operators. A literal on the left side is moved to the right (mirroring
+    // the operator), so equivalent predicates produce identical SQL; otherwise SQLite won't
+    // recognize that a query's WHERE term matches a partial index's.
+    void QueryParser::comparisonOp(slice op, Array::iterator& operands) {
+        const Value *lhs = operands[0], *rhs = operands[1];
+        if (op == "="_sl && !_collation.unicodeAware)
+            writeLowerEqualityRewrite(lhs, rhs);
+        if (lhs->asArray() != nullptr || rhs->asArray() == nullptr) {
+            infixOp(op, operands);
+            return;
+        }
+        if (op == "<"_sl)
+            op = ">"_sl;
+        else if (op == "<="_sl)
+            op = ">="_sl;
+        else if (op == ">"_sl)
+            op = "<"_sl;
+        else if (op == ">="_sl)
+            op = "<="_sl;
+        parseCollatableNode(operands[1]);
+        _sql << ' ' << op << ' ';
+        parseCollatableNode(operands[0]);
+    }
+
+
+    // The text forms of numbers ("12", "-1.5", "Inf") can only start with these characters.
+    // Since fl_value returns numbers as SQL numbers, which sort before all strings, a string
+    // range only contains every possible match of a pattern that can't match a number.
+    static bool canStartNumber(uint8_t c) {
+        return isdigit(c) || c == '-' || c == '+' || c == '.' || c == 'I' || c == 'i';
+    }
+
+    static string changeASCIICase(string str, bool toUppercase) {
+        for (char &c : str)
+            c = char(toUppercase ? toupper((uint8_t)c) : tolower((uint8_t)c));
+        return str;
+    }
+
+    // Returns the least string greater than all strings starting with `prefix` (in binary
+    // order), or an empty string if there is none.
+    static string prefixUpperBound(string prefix) {
+        while (!prefix.empty() && (uint8_t)prefix.back() == 0xFF)
+            prefix.pop_back();
+        if (!prefix.empty())
+            prefix.back() = char((uint8_t)prefix.back() + 1);
+        return prefix;
+    }
+
+
+    // Handles "x LIKE pattern". If the pattern is a string literal beginning with a fixed prefix,
+    // range tests on x are added after the LIKE, which stays in place to do the exact matching.
+    // SQLite's LIKE ignores collations and is case-insensitive only for ASCII letters, so a
+    // range is written for each kind of index on x there is: one a binary index can use, and
+    // one a `COLLATE NOCASE` index can use. Without an index the ranges would just be more
+    // expressions to evaluate on every row, so none are written.
+    void QueryParser::likeOp(slice op, Array::iterator& operands) {
+        const Value *lhs = operands[0];
+        slice pattern = operands[1]->asString();
+        infixOp(op, operands);
+
+        size_t prefixLen = 0;
+        while (prefixLen < pattern.size && pattern[prefixLen] != '%' && pattern[prefixLen] != '_')
+            ++prefixLen;
+        if (prefixLen == 0 || canStartNumber(pattern[0]))
+            return;
+        string prefix((const char*)pattern.buf, prefixLen);
+
+        string operand = operandSQL(lhs);
+        bool binaryIndexed = isIndexed(operand), noCaseIndexed = isIndexed(operand + " COLLATE NOCASE");
+        if (!binaryIndexed && !noCaseIndexed)
+            return;
+
+        // Every case variant of the prefix is >= its uppercase form and < the bound of its
+        // lowercase form, since uppercase ASCII letters sort before lowercase ones:
+        string lower = changeASCIICase(prefix, false);
+        if (binaryIndexed)
+            writeRangeTest(operand, nullptr, changeASCIICase(prefix, true), prefixUpperBound(lower));
+        if (noCaseIndexed)
+            writeRangeTest(operand, "NOCASE", lower, prefixUpperBound(lower));
+        _rewrites.push_back("LIKE '" + pattern.asString() + "' also tests range of prefix '"
+                            + prefix + "'");
+    }
+
+
+    // Writes " AND operand >= minValue AND operand < maxValue", the latter only if maxValue is
+    // nonempty. The comparisons use the given collation, or the default (binary) one.
+    void QueryParser::writeRangeTest(const string &operand, const char *collation,
+                                     const string &minValue, const string &maxValue)
+    {
+        for (int i = 0; i < 2; ++i) {
+            const string &value = i ? maxValue : minValue;
+            if (value.empty())
+                break;
+            _sql << " AND " << operand;
+            if (collation)
+                _sql << " COLLATE " << collation;
+            _sql << (i ? " < " : " >= ");
+            writeSQLString(slice(value));
+        }
+    }
+
+
+    // Returns the SQL for an operand, parenthesized if it needs to be to go before a COLLATE or
+    // comparison, without writing it.
+    string QueryParser::operandSQL(const Value *operand) {
+        stringstream sql;
+        swap(_sql, sql);
+        _context.push_back(&kHighPrecedenceOperation);
+        parseNode(operand);
+        _context.pop_back();
+        swap(_sql, sql);
+        return sql.str();
+    }
+
+
+    // True if the SQL expression (which may end with a COLLATE) is the first column of a value
+    // index. An index expression doesn't name a table, but SQLite matches it to the same
+    // expression on an aliased table, so aliases are ignored.
+    bool QueryParser::isIndexed(string expression) const {
+        for (auto &alias : _aliases) {
+            string prefix = "\"" + alias + "\".";
+            for (size_t pos; string::npos != (pos = expression.find(prefix)); )
+                expression.erase(pos, prefix.size());
+        }
+        return _indexedExpressions.find(expression) != _indexedExpressions.end();
+    }
+
+
+    // Handles "lower(x) = 'literal'" (in either order) by first writing the equivalent test
+    // "x COLLATE NOCASE = 'literal'", which a `COLLATE NOCASE` index on x can satisfy, followed
+    // by " AND "; the caller then writes the original comparison to do the exact matching.
+    // This is only done if there is such an index, since otherwise the extra test is just
+    // another expression to evaluate on every row.
+    // NOCASE only folds ASCII letters, so the literal has to be ASCII, and it must not contain
+    // 'i' or 'k', which non-ASCII letters (U+0130, the Kelvin sign) can lowercase to. It also
+    // has to start with a letter, since a number's lowercased text form could equal it.
+    void QueryParser::writeLowerEqualityRewrite(const Value *lhs, const Value *rhs) {
+        if (rhs->type() != kString)
+            swap(lhs, rhs);
+        const Array *fn = lhs->asArray();
+        slice literal = rhs->asString();
+        if (!fn || fn->count() != 2 || !fn->get(0)->asString().caseEquivalent("lower()"_sl)
+                || !literal || !isalpha(literal[0]))
+            return;
+        for (size_t i = 0; i < literal.size; ++i) {
+            uint8_t c = literal[i];
+            if (c >= 0x80 || isupper(c) || c == 'i' || c == 'k')
+                return;
+        }
+
+        string operand = operandSQL(fn->get(1));
+        if (!isIndexed(operand + " COLLATE NOCASE"))
+            return;
+        _sql << operand << " COLLATE NOCASE = ";
+        writeSQLString(literal);
+        _sql << " AND ";
+        _rewrites.push_back("lower() = '" + literal.asString() + "' also tests COLLATE NOCASE");
+    }
+
+
     // Handles array literals (the "[]" op)
     // But note that this op is treated specially if it's an operand of "IN" (see inOp)
     void QueryParser::arrayLiteralOp(slice op, Array::iterator& operands) {
@@ -634,6 +828,18 @@ namespace litecore {
             Array::iterator arrayOperands(arrayOperand);
             writeArgList(++arrayOperands);
 
+        } else if (arrayOperand && arrayOperand->count() > 0
+                                && arrayOperand->get(0)->asString().hasPrefix("$"_sl)) {
+            // RHS is a parameter, which can be bound to an array: iterate it with fl_each_param,
+            // so the statement can be reused for any list, and SQLite can look up each item in
+            // an index on the LHS.
+            parseCollatableNode(operands[0]);
+            _sql << ' ' << op << " (SELECT value FROM " << kEachParamFnName << "(";
+            _context.push_back(&kArgListOperation);
+            parseNode(operands[1]);
+            _context.pop_back();
+            _sql << "))";
+
         } else {
             // Otherwise generate a call to array_contains():
             _context.push_back(&kArgListOperation);     // prevents extra parens around operands
@@ -673,6 +879,73 @@ namespace litecore {
     }
 
 
+    // Handles ["WITHIN", [expr, ...], [min, ...], [max, ...]], which is true if every expression's
+    // value is in its [min, max] range. It requires a geo index on the same expressions.
+    void QueryParser::withinOp(slice op, Array::iterator& operands) {
+        auto expressions = requiredArray(operands[0], "WITHIN expressions");
+        auto mins = requiredArray(operands[1], "WITHIN minimums");
+        auto maxes = requiredArray(operands[2], "WITHIN maximums");
+        uint32_t n = expressions->count();
+        require(n > 0 && mins->count() == n && maxes->count() == n,
+                "WITHIN needs the same number of expressions, minimums and maximums");
+        require(_aliases.empty(), "WITHIN can't be used in a query with a FROM clause");
+
+        // The R-tree rounds values outwards to 32-bit floats, so use it to find the documents
+        // whose boxes overlap the range, then check the exact values:
+        string geoTable = geoIndexName(expressions);
+        _geoTables.insert(geoTable);
+        _sql << "(" << _tableName << ".sequence IN (SELECT id FROM \"" << geoTable << "\" WHERE ";
+        for (uint32_t i = 0; i < n; ++i) {
+            if (i > 0)
+                _sql << " AND ";
+            _sql << "max" << i << " >= ";
+            parseNode(mins->get(i));
+            _sql << " AND min" << i << " <= ";
+            parseNode(maxes->get(i));
+        }
+        _sql << ")";
+        for (uint32_t i = 0; i < n; ++i) {
+            _sql << " AND ";
+            parseNode(expressions->get(i));
+            _sql << " BETWEEN ";
+            parseNode(mins->get(i));
+            _sql << " AND ";
+            parseNode(maxes->get(i));
+        }
+        _sql << ")";
+    }
+
+
+    // Returns true if every reference to a variable in the expression is a direct operand of
+    // a comparison, e.g. ["=", ["?x"], "foo"]. An array index only stores each variable's value
+    // itself, not its properties (["?x.name"]), and an array or dict value loses the subtype
+    // that tells Fleece functions it's encoded Fleece; a comparison doesn't care about that,
+    // but a function call or nested ANY/EVERY would misread it.
+    static bool usesVariablesOnlyInComparisons(const Value *node, bool inComparison =false) {
+        static const slice kComparisons[] = {"="_sl, "!="_sl, "<"_sl, "<="_sl, ">"_sl, ">="_sl,
+                                             "IS"_sl, "IS NOT"_sl, "BETWEEN"_sl};
+        Array::iterator i(node->asArray());
+        if (i.count() == 0)
+            return true;
+        slice op = i.value()->asString();
+        if (op.size > 0 && op[0] == '?') {
+            if (!inComparison)
+                return false;
+            if (op.size == 1)
+                return i.count() <= 2;
+            return i.count() == 1 && !op.findByte('.') && !op.findByte('[');
+        }
+        bool comparison = false;
+        for (auto c : kComparisons)
+            comparison = comparison || op.caseEquivalent(c);
+        for (++i; i; ++i) {
+            if (!usesVariablesOnlyInComparisons(i.value(), comparison))
+                return false;
+        }
+        return true;
+    }
+
+
     // Handles "ANY var IN array SATISFIES expr" (and EVERY, and ANY AND EVERY)
     void QueryParser::anyEveryOp(slice op, Array::iterator& operands) {
         auto var = (string)requiredString(operands[0], "ANY/EVERY first parameter");
@@ -687,6 +960,20 @@ namespace litecore {
         bool every = !op.caseEquivalent("ANY"_sl);
         bool anyAndEvery = op.caseEquivalent("ANY AND EVERY"_sl);
 
+        if (!every && _aliases.empty() && _variables.size() == 1
+                && usesVariablesOnlyInComparisons(operands[2])
+                && find(_arrayIndexedProperties.begin(), _arrayIndexedProperties.end(), property)
+                        != _arrayIndexedProperties.end()) {
+            // The array is indexed, so look up the matching elements in the index instead of
+            // iterating the array of every document:
+            _sql << _tableName << ".key IN (SELECT key FROM \"" << arrayIndexName(property)
+                 << "\" AS _" << var << " WHERE ";
+            parseNode(operands[2]);
+            _sql << ')';
+            _variables.erase(var);
+            return;
+        }
+
         //OPT: If expr is `var = value`, can generate `fl_contains(array, value)` instead 
 
         if (anyAndEvery) {
@@ -817,7 +1104,12 @@ namespace litecore {
             writeSelect(dict);
         } else {
             // Nested SELECT; use a fresh parser
+            _hasSubquery = true;
             QueryParser nested(_tableName, _bodyColumnName);
+            nested.setMaterializedProperties(_materializedProperties);
+            nested.setArrayIndexedProperties(_arrayIndexedProperties);
+            nested.setMappedFTSTables(_mappedFTSTables);
+            nested.setIndexedExpressions(_indexedExpressions);
             nested.parse(dict);
             _sql << nested.SQL();
         }
@@ -995,7 +1287,27 @@ namespace litecore {
             string fts = FTSIndexName(property);
             if (find(_ftsTables.begin(), _ftsTables.end(), fts) == _ftsTables.end())
                 fail("rank() can only be called on FTS-indexed properties");
-            _sql << "rank(matchinfo(\"" << fts << "\"))";
+            // BM25 ranking; the constant 2nd arg lets the function cache per-query weights:
+            _sql << "bm25(matchinfo(\"" << fts << "\", 'pcnalx'), ";
+            writeSQLString(_sql, slice(fts));
+            _sql << ")";
+        } else if (fn == kValueFnName && find(_materializedProperties.begin(),
+                                              _materializedProperties.end(),
+                                              property) != _materializedProperties.end()) {
+            // The property's value is kept in a column of its own; no need to decode the body.
+            // SQL operators and indexes use the column as it is, but a function argument or
+            // result column needs fl_materialized to restore the Fleece subtype of collections.
+            // (The consumer is the operation below the property's own on the stack, if any.)
+            auto consumer = _context.back();
+            if (consumer != &kColumnListOperation && _context.size() >= 2)
+                consumer = _context[_context.size() - 2];
+            bool needsFleece = (consumer == &kArgListOperation)
+                            || (consumer == &kColumnListOperation && _writingResultColumns);
+            if (needsFleece)
+                _sql << "fl_materialized(";
+            _sql << tableName << materializedColumnName(property);
+            if (needsFleece)
+                _sql << ")";
         } else {
             // It's more efficent to get the doc root with fl_root than with fl_value:
             if (property == "" && fn == kValueFnName)
@@ -1012,6 +1324,17 @@ namespace litecore {
     }
 
 
+    /*static*/ std::string QueryParser::materializedColumnName(const std::string &property) {
+        string name = "\"prop:";
+        for (char c : property) {
+            if (c == '"')
+                name += '"';
+            name += c;
+        }
+        return name + "\"";
+    }
+
+
     /*static*/ std::string QueryParser::expressionSQL(const fleece::Value* expr,
                                                       const char *bodyColumnName)
     {
@@ -1063,6 +1386,22 @@ namespace litecore {
         return _tableName + "::." + property;
     }
 
+    string QueryParser::arrayIndexName(const string &property) const {
+        return _tableName + "::unnest." + property;
+    }
+
+    string QueryParser::geoIndexName(const Array *expressions) const {
+        string name = expressions->toJSON().asString();
+        replace(name, '"', '\'');
+        return _tableName + "::geo:" + name;
+    }
+
+    /*static*/ string QueryParser::arrayIndexProperty(const Value *expression) {
+        string property = propertyFromNode(expression);
+        require(!property.empty(), "Array index expression must be a property");
+        return property;
+    }
+
     size_t QueryParser::FTSPropertyIndex(const Value *matchLHS, bool canAdd) {
         string key = FTSIndexName(matchLHS);
         auto i = find(_ftsTables.begin(), _ftsTables.end(), key);
@@ -24,6 +24,9 @@ namespace fleece {
 
 namespace litecore {
 
+    /** Name of the SQL parameter that a docID-restricted query is bound to; see setTrackDocIDs. */
+    constexpr const char* kDocIDParameterName = "@docID";
+
 
     class QueryParser {
     public:
@@ -34,12 +37,40 @@ namespace litecore {
 
         void setBaseResultColumns(const std::vector<std::string>& c){_baseResultColumns = c;}
 
+        /** Tells the parser which document properties are materialized as columns of the table
+            (see KeyStore::materializeProperty), so it can read those columns directly instead
+            of calling fl_value. */
+        void setMaterializedProperties(const std::vector<std::string> &p) {_materializedProperties = p;}
+
+        /** The (quoted) name of the table column a materialized property is stored in. */
+        static std::string materializedColumnName(const std::string &property);
+
+        /** Tells the parser which properties have array indexes, so it can look up ANY
+            expressions on them in the index instead of iterating every document's array. */
+        void setArrayIndexedProperties(const std::vector<std::string> &p) {_arrayIndexedProperties = p;}
+        /** Sets the FTS tables whose rows are found through a "::seqs" table mapping record
+            sequences to FTS rowids. Other FTS tables' rowids are sequences. */
+        void setMappedFTSTables(const std::set<std::string> &t)     {_mappedFTSTables = t;}
+        /** Sets the SQL expressions that are the first column of a value index, including any
+            COLLATE. Predicates are only rewritten into forms an index can use when there is one. */
+        void setIndexedExpressions(const std::set<std::string> &e)  {_indexedExpressions = e;}
+
+        /** Adds the docID as the last implicit result column, just before the custom ones. If
+            `restrictToDocID` is true, the query also only matches the document whose ID is bound
+            to the parameter kDocIDParameterName. (Used to update live queries incrementally.) */
+        void setTrackDocIDs(bool restrictToDocID)   {_trackDocIDs = true;
+                                                     _restrictToDocID = restrictToDocID;}
+
         void parse(const fleece::Value*);
         void parseJSON(slice);
 
         void parseJustExpression(const fleece::Value *expression);
 
-        void writeCreateIndex(const std::string &name, const fleece::Array *expressions);
+        /** Writes a CREATE INDEX statement. If `where` is given it's a partial index, containing
+            only the documents matching that expression. */
+        void writeCreateIndex(const std::string &name,
+                              const fleece::Array *expressions,
+                              const fleece::Value *where =nullptr);
 
         static void writeSQLString(std::ostream &out, slice str);
 
@@ -47,13 +78,26 @@ namespace litecore {
 
         const std::set<std::string>& parameters()                   {return _parameters;}
         const std::vector<std::string>& ftsTablesUsed() const       {return _ftsTables;}
+        const std::set<std::string>& geoTablesUsed() const          {return _geoTables;}
+
+        /** Descriptions of the predicates that were rewritten into index-friendly forms. */
+        const std::vector<std::string>& rewrites() const            {return _rewrites;}
         unsigned firstCustomResultColumn() const                    {return _1stCustomResultCol;}
 
         bool isAggregateQuery() const                               {return _isAggregateQuery;}
 
+        /** True if every result row comes from a single document, independently of any other
+            document (no aggregates, joins, subqueries, LIMIT or OFFSET.) */
+        bool isPerDocumentQuery() const                             {return _isPerDocumentQuery;}
+
         static std::string expressionSQL(const fleece::Value*, const char *bodyColumnName = "body");
         std::string FTSIndexName(const fleece::Value *key) const;
         std::string FTSIndexName(const std::string &property) const;
+        std::string arrayIndexName(const std::string &property) const;
+        std::string geoIndexName(const fleece::Array *expressions) const;
+
+        /** Returns the property path of an array index's expression, which must be a property. */
+        static std::string arrayIndexProperty(const fleece::Value *expression);
 
     private:
         struct Operation;
@@ -89,12 +133,15 @@ namespace litecore {
         void prefixOp(slice, fleece::Array::iterator&);
         void postfixOp(slice, fleece::Array::iterator&);
         void infixOp(slice, fleece::Array::iterator&);
+        void comparisonOp(slice, fleece::Array::iterator&);
+        void likeOp(slice, fleece::Array::iterator&);
         void arrayLiteralOp(slice, fleece::Array::iterator&);
         void betweenOp(slice, fleece::Array::iterator&);
         void existsOp(slice, fleece::Array::iterator&);
         void collateOp(slice, fleece::Array::iterator&);
         void inOp(slice, fleece::Array::iterator&);
         void matchOp(slice, fleece::Array::iterator&);
+        void withinOp(slice, fleece::Array::iterator&);
         void anyEveryOp(slice, fleece::Array::iterator&);
         void parameterOp(slice, fleece::Array::iterator&);
         void propertyOp(slice, fleece::Array::iterator&);
@@ -114,6 +161,11 @@ namespace litecore {
         void writeResultColumn(const fleece::Value*);
         void writeCollation();
         void parseCollatableNode(const fleece::Value*);
+        void writeRangeTest(const std::string &operand, const char *collation,
+                            const std::string &minValue, const std::string &maxValue);
+        std::string operandSQL(const fleece::Value *operand);
+        bool isIndexed(std::string expression) const;
+        void writeLowerEqualityRewrite(const fleece::Value *lhs, const fleece::Value *rhs);
 
         void parseJoin(const fleece::Dict*);
 
@@ -124,14 +176,25 @@ namespace litecore {
         std::string _bodyColumnName;
         std::vector<std::string> _aliases;      // Aliased table/join names
         std::vector<std::string> _baseResultColumns;
+        std::vector<std::string> _materializedProperties;
+        std::vector<std::string> _arrayIndexedProperties;
+        std::set<std::string> _mappedFTSTables;
+        std::set<std::string> _indexedExpressions;
         std::stringstream _sql;
         std::vector<const Operation*> _context;
         std::set<std::string> _parameters;
         std::set<std::string> _variables;
         std::vector<std::string> _ftsTables;
+        std::set<std::string> _geoTables;       // Geo index tables used by WITHIN
+        std::vector<std::string> _rewrites;     // Predicates rewritten for index use
         unsigned _1stCustomResultCol {0};
         bool _aggregatesOK {false};
+        bool _writingResultColumns {false};     // Writing the WHAT clause?
         bool _isAggregateQuery {false};
+        bool _isPerDocumentQuery {false};
+        bool _hasSubquery {false};
+        bool _trackDocIDs {false};
+        bool _restrictToDocID {false};
         static constexpr bool _includeDeleted {false};  // In future add an accessor to set this
         Collation _collation;
         bool _collationUsed {true};
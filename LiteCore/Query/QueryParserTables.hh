@@ -40,19 +40,20 @@ namespace litecore {
         {"-"_sl,       2, 2,  6,  &QueryParser::infixOp},
         {"-"_sl,       1, 1,  9,  &QueryParser::prefixOp},
 
-        {"<"_sl,       2, 2,  4,  &QueryParser::infixOp},
-        {"<="_sl,      2, 2,  4,  &QueryParser::infixOp},
-        {">"_sl,       2, 2,  4,  &QueryParser::infixOp},
-        {">="_sl,      2, 2,  4,  &QueryParser::infixOp},
-
-        {"="_sl,       2, 2,  3,  &QueryParser::infixOp},
-        {"!="_sl,      2, 2,  3,  &QueryParser::infixOp},
-        {"IS"_sl,      2, 2,  3,  &QueryParser::infixOp},
-        {"IS NOT"_sl,  2, 2,  3,  &QueryParser::infixOp},
+        {"<"_sl,       2, 2,  4,  &QueryParser::comparisonOp},
+        {"<="_sl,      2, 2,  4,  &QueryParser::comparisonOp},
+        {">"_sl,       2, 2,  4,  &QueryParser::comparisonOp},
+        {">="_sl,      2, 2,  4,  &QueryParser::comparisonOp},
+
+        {"="_sl,       2, 2,  3,  &QueryParser::comparisonOp},
+        {"!="_sl,      2, 2,  3,  &QueryParser::comparisonOp},
+        {"IS"_sl,      2, 2,  3,  &QueryParser::comparisonOp},
+        {"IS NOT"_sl,  2, 2,  3,  &QueryParser::comparisonOp},
         {"IN"_sl,      2, 9,  3,  &QueryParser::inOp},
         {"NOT IN"_sl,  2, 9,  3,  &QueryParser::inOp},
-        {"LIKE"_sl,    2, 2,  3,  &QueryParser::infixOp},
+        {"LIKE"_sl,    2, 2,  3,  &QueryParser::likeOp},
         {"MATCH"_sl,   2, 2,  3,  &QueryParser::matchOp},
+        {"WITHIN"_sl,  3, 3,  3,  &QueryParser::withinOp},
         {"BETWEEN"_sl, 3, 3,  3,  &QueryParser::betweenOp},
         {"EXISTS"_sl,  1, 1,  8,  &QueryParser::existsOp},
 
@@ -11,6 +11,9 @@
 #include "SQLiteFleeceUtil.hh"
 #include <sqlite3.h>
 #include <stdint.h>
+#include <cmath>
+#include <new>
+#include <vector>
 
 
 namespace litecore {
@@ -90,7 +93,10 @@ namespace litecore {
                 int nHitCount = aPhraseinfo[3*iCol];
                 int nGlobalHitCount = aPhraseinfo[3*iCol+1];
                 double weight = 1.0; // sqlite3_value_double(apVal[iCol+1]);
-                if( nHitCount>0 ){
+                /* A prefix phrase ("term*") is reported as a single phrase whose counts cover
+                 ** every term it expands to, whether or not the table has a prefix index for it.
+                 ** Don't divide by zero if the global count is missing for some reason. */
+                if( nHitCount>0 && nGlobalHitCount>0 ){
                     score += ((double)nHitCount / (double)nGlobalHitCount) * weight;
                 }
             }
@@ -105,8 +111,102 @@ namespace litecore {
     }
 
 
+    /*
+     ** Okapi BM25 relevance ranking. This is what the query language's rank() function calls:
+     **
+     **     bm25(matchinfo(fts, 'pcnalx'), 'fts')
+     **
+     ** The score of a row is the sum, over each phrase and column, of
+     **
+     **     idf * (tf * (k1 + 1)) / (tf + k1 * (1 - b + b * dl / avgdl))
+     **
+     ** where tf is the number of hits in the row's column, dl is the column's length in tokens,
+     ** avgdl is the column's average length, and idf = log(1 + (N - df + 0.5) / (df + 0.5)),
+     ** N being the number of rows and df the number of rows that contain the phrase.
+     **
+     ** FTS4 keeps N and the total token counts in its "_stat" table, updating them as rows are
+     ** added and removed, so the 'n' and 'a' values come without scanning the index; likewise 'l'
+     ** comes from the "_docsize" table. The terms of the formula that don't depend on the row
+     ** (the idf of each phrase/column and the length normalization factors) are computed from the
+     ** first row and cached for the rest of the statement, using SQLite's auxiliary-data API on
+     ** the constant second argument. That leaves a few multiplications per hit for each row, so
+     ** top-k queries (ORDER BY rank LIMIT k), whose sorter only keeps k rows, stay cheap.
+     */
+    static constexpr double kBM25_K1 = 1.2;
+    static constexpr double kBM25_B  = 0.75;
+
+    struct BM25Weights {
+        int32_t nPhrase, nCol;
+        uint32_t nDoc;
+        std::vector<double> idf;        // indexed by iPhrase*nCol + iCol
+        std::vector<double> lengthNorm; // k1 * b / avgdl, indexed by iCol
+
+        static void destroy(void *weights)  {delete (BM25Weights*)weights;}
+    };
+
+    static void bm25func(sqlite3_context *ctx, int argc, sqlite3_value **argv) noexcept {
+        // Layout of the 'pcnalx' matchinfo blob:
+        auto matchinfo = (const uint32_t*)sqlite3_value_blob(argv[0]);
+        int nInts = sqlite3_value_bytes(argv[0]) / (int)sizeof(uint32_t);
+        if (!matchinfo || nInts < 3) {
+            sqlite3_result_error(ctx, "nothing for rank() to match", -1);
+            return;
+        }
+        int32_t nPhrase = matchinfo[0], nCol = matchinfo[1];
+        uint32_t nDoc = matchinfo[2];
+        const uint32_t *avgLength = &matchinfo[3];
+        const uint32_t *length = avgLength + nCol;
+        const uint32_t *hits = length + nCol;
+        if (nInts != 3 + 2 * nCol + 3 * nCol * nPhrase) {
+            sqlite3_result_error(ctx, "rank() needs matchinfo format 'pcnalx'", -1);
+            return;
+        }
+
+        auto weights = (BM25Weights*)sqlite3_get_auxdata(ctx, 1);
+        if (!weights || weights->nPhrase != nPhrase || weights->nCol != nCol
+                     || weights->nDoc != nDoc) {
+            try {
+                weights = new BM25Weights {nPhrase, nCol, nDoc};
+                weights->idf.resize(nPhrase * nCol);
+                for (int i = 0; i < nPhrase * nCol; ++i) {
+                    double df = hits[3*i + 2];
+                    weights->idf[i] = std::log(1.0 + (nDoc - df + 0.5) / (df + 0.5));
+                }
+                weights->lengthNorm.resize(nCol);
+                for (int iCol = 0; iCol < nCol; ++iCol)
+                    weights->lengthNorm[iCol] = avgLength[iCol] ? kBM25_K1 * kBM25_B / avgLength[iCol]
+                                                                : 0.0;
+            } catch (const std::bad_alloc&) {
+                sqlite3_result_error_nomem(ctx);
+                return;
+            }
+            // (SQLite takes ownership; it deletes the weights at once if it can't keep them.)
+            sqlite3_set_auxdata(ctx, 1, weights, &BM25Weights::destroy);
+            weights = (BM25Weights*)sqlite3_get_auxdata(ctx, 1);
+            if (!weights) {
+                sqlite3_result_error_nomem(ctx);
+                return;
+            }
+        }
+
+        double score = 0.0;
+        for (int iCol = 0; iCol < nCol; ++iCol) {
+            double denominatorBase = kBM25_K1 * (1.0 - kBM25_B)
+                                   + weights->lengthNorm[iCol] * length[iCol];
+            for (int iPhrase = 0; iPhrase < nPhrase; ++iPhrase) {
+                int i = iPhrase * nCol + iCol;
+                double tf = hits[3*i];
+                if (tf > 0)
+                    score += weights->idf[i] * tf * (kBM25_K1 + 1.0) / (tf + denominatorBase);
+            }
+        }
+        sqlite3_result_double(ctx, score);
+    }
+
+
     const SQLiteFunctionSpec kRankFunctionsSpec[] = {
         { "rank",          1, rankfunc  },
+        { "bm25",          2, bm25func  },
         { }
     };
 
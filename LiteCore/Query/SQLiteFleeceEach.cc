@@ -27,6 +27,7 @@
 #include "Path.hh"
 
 #include <sqlite3.h>
+#include <algorithm>
 
 using namespace std;
 using namespace fleece;
@@ -55,9 +56,33 @@ enum {
 };
 
 
+// Planner estimates. Arrays in documents are usually short; the cost of a scan is mostly that of
+// handing each row to SQLite, since items failing a pushed-down constraint are skipped cheaply.
+static constexpr double kEstimatedItemCount = 10;
+static constexpr double kSkippedItemCost    = 0.1;
+static constexpr double kRangeSelectivity   = 0.25;
+
+// Maximum number of constraints on the 'value' column that the cursor tests itself
+static constexpr int kMaxValueConstraints = 4;
+
+
+// A constraint on the 'value' column, pushed down by bestIndex() and tested by the cursor.
+// These are only a pre-filter: SQLite still evaluates the constraint on every row returned, so
+// an item is only skipped when it certainly fails.
+struct ValueConstraint {
+    char op;                // '=', '<', 'L' (<=), '>', 'G' (>=)
+    bool binaryCollation;   // Is the comparison known to use the BINARY collation?
+    int type;               // SQLite type of the operand
+    int64_t intValue;
+    double doubleValue;
+    alloc_slice bytes;      // Operand if it's text or a blob
+};
+
+
 // Registered virtual-table instance that hangs onto the necessary per-database context info.
 struct FleeceVTab : public sqlite3_vtab {
-    fleeceFuncContext context;
+    fleeceFuncContext *context;         // Owned by the module registration, which outlives me
+    bool paramData;                     // root_data is Fleece bound as a parameter, not a body
 };
 
 
@@ -68,11 +93,14 @@ private:
     // Instance data:
     FleeceVTab* _vtab;                  // The virtual table
     alloc_slice _fleeceData;            // The root Fleece data
+    alloc_slice _decompressedData;      // _fleeceData decompressed, if it was compressed
     alloc_slice _rootPath;              // The path string within the data, if any
     const Value *_container;            // The object being iterated (target of the path)
     valueType _containerType;           // The value type of _container
     uint32_t _rowid;                    // The current row number, starting at 0
     uint32_t _rowCount;                 // The number of rows
+    ValueConstraint _constraints[kMaxValueConstraints]; // Pushed-down constraints on 'value'
+    int _constraintCount;               // Number of items in _constraints
 
 
 #pragma mark - STATIC METHODS (DIRECT CALLBACKS):
@@ -83,7 +111,10 @@ private:
     static void operator delete(void *mem) noexcept     {free(mem);}
 
     
-    // Creates a new sqlite3_vtab that describes the virtual table.
+    // Creates a new sqlite3_vtab that describes the virtual table. `ParamData` distinguishes
+    // fl_each_param, whose root_data is Fleece data bound to a query parameter (like an array
+    // to match with `IN $param`) instead of a record body.
+    template <bool ParamData>
     static int connect(sqlite3 *db,
                        void *aux,
                        int argc, const char *const*argv,
@@ -98,11 +129,12 @@ private:
         if( rc!=SQLITE_OK )
             return rc;
 
-        // Allocate a new FleeceVTab and copy the context into it:
+        // Allocate a new FleeceVTab and point it to the context:
         auto vtab = (FleeceVTab*) malloc(sizeof(FleeceVTab));
         if (!vtab)
             return SQLITE_NOMEM;
-        vtab->context = *(fleeceFuncContext*)aux;
+        vtab->context = (fleeceFuncContext*)aux;
+        vtab->paramData = ParamData;
         *outVtab = vtab;
         return SQLITE_OK;
     }
@@ -140,34 +172,79 @@ private:
         /* From json1.c: "The query strategy is to look for an equality constraint on the
            [`root_data`] column.  Without such a constraint, the table cannot operate." */
         int rootDataIdx = -1, rootPathIdx = -1;
+        int valueIdx[kMaxValueConstraints];
+        char valueOps[2 * kMaxValueConstraints + 1];
+        int nValueConstraints = 0;
+        double estimatedRows = kEstimatedItemCount;
         auto constraint = info->aConstraint;
         for (int i = 0; i < info->nConstraint; i++, constraint++){
-            if (constraint->usable && constraint->op == SQLITE_INDEX_CONSTRAINT_EQ) {
+            if (!constraint->usable)
+                continue;
+            if (constraint->op == SQLITE_INDEX_CONSTRAINT_EQ) {
                 switch( constraint->iColumn ){
-                    case kRootFleeceDataColumn: rootDataIdx = i;    break;
-                    case kRootPathColumn:       rootPathIdx = i;    break;
+                    case kRootFleeceDataColumn: rootDataIdx = i;    continue;
+                    case kRootPathColumn:       rootPathIdx = i;    continue;
                     default:                    /* no-op */     break;
                 }
             }
+            if (constraint->iColumn != kValueColumn || nValueConstraints == kMaxValueConstraints)
+                continue;
+            char op;
+            switch (constraint->op) {
+                case SQLITE_INDEX_CONSTRAINT_EQ: op = '='; estimatedRows = 1; break;
+                case SQLITE_INDEX_CONSTRAINT_LT: op = '<'; break;
+                case SQLITE_INDEX_CONSTRAINT_LE: op = 'L'; break;
+                case SQLITE_INDEX_CONSTRAINT_GT: op = '>'; break;
+                case SQLITE_INDEX_CONSTRAINT_GE: op = 'G'; break;
+                default:                         continue;
+            }
+            if (op != '=')
+                estimatedRows *= kRangeSelectivity;
+            // Text can only be compared if the collation is known (and SQLite can tell it.)
+            bool binary = false;
+#if SQLITE_VERSION_NUMBER >= 3022000
+            const char *collation = sqlite3_vtab_collation(info, i);
+            binary = (!collation || sqlite3_stricmp(collation, "BINARY") == 0);
+#endif
+            valueOps[2 * nValueConstraints]     = op;
+            valueOps[2 * nValueConstraints + 1] = binary ? 'b' : '?';
+            valueIdx[nValueConstraints++] = i;
         }
+        valueOps[2 * nValueConstraints] = '\0';
+
         // `info->idxNum` is used to communicate to the filter() function below; the value set here
-        // will be passed to that function.
+        // will be passed to that function. `info->idxStr` lists the value constraints' operators.
         // `argvIndex` specifies which constraint values will be passed as arguments to filter()
         // and in what order.
         if( rootDataIdx < 0 ) {
             info->idxNum = kNoIndex;
             info->estimatedCost = 1e99;
+            info->estimatedRows = INT32_MAX;
         } else {
-            info->estimatedCost = 1.0;
-            info->aConstraintUsage[rootDataIdx].argvIndex = 1;
+            int argvIndex = 1;
+            info->aConstraintUsage[rootDataIdx].argvIndex = argvIndex++;
             info->aConstraintUsage[rootDataIdx].omit = 1;
             if (rootPathIdx < 0) {
                 info->idxNum = kFleeceDataIndex;
             } else {
-                info->aConstraintUsage[rootPathIdx].argvIndex = 2;
+                info->aConstraintUsage[rootPathIdx].argvIndex = argvIndex++;
                 info->aConstraintUsage[rootPathIdx].omit = 1;
                 info->idxNum = kPathIndex;
             }
+            // SQLite still checks the value constraints itself, so they're not omitted:
+            for (int i = 0; i < nValueConstraints; ++i)
+                info->aConstraintUsage[valueIdx[i]].argvIndex = argvIndex++;
+            if (nValueConstraints > 0) {
+                info->idxStr = sqlite3_mprintf("%s", valueOps);
+                if (!info->idxStr)
+                    return SQLITE_NOMEM;
+                info->needToFreeIdxStr = 1;
+            }
+            estimatedRows = max(estimatedRows, 1.0);
+            info->estimatedRows = (sqlite3_int64)estimatedRows;
+            info->estimatedCost = estimatedRows;
+            if (nValueConstraints > 0)
+                info->estimatedCost += kEstimatedItemCount * kSkippedItemCost;
         }
         return SQLITE_OK;
     }
@@ -178,16 +255,21 @@ private:
 
     FleeceCursor(FleeceVTab *vtab)
     :_vtab(vtab)
+    ,_constraintCount(0)
     { }
 
 
     void reset() noexcept {
         _fleeceData = nullslice;
+        _decompressedData = nullslice;
         _rootPath = nullslice;
         _container = nullptr;
         _containerType = kNull;
         _rowCount = 0;
         _rowid = 0;
+        for (int i = 0; i < _constraintCount; ++i)
+            _constraints[i].bytes = nullslice;
+        _constraintCount = 0;
     }
 
 
@@ -201,19 +283,36 @@ private:
 
         // Parse the Fleece data:
         _fleeceData = valueAsSlice(argv[0]);
-        slice data = _fleeceData;
-        if (_vtab->context.accessor)
-            data = _vtab->context.accessor(data);
-        _container = Value::fromTrustedData(data);
-        if (!_container) {
-            Warn("Invalid Fleece data in SQLite table");
-            return SQLITE_MISMATCH; // failed to parse Fleece data
+        if (_vtab->paramData) {
+            // A parameter that isn't an array or dict (or is unbound) produces no rows:
+            if (sqlite3_value_type(argv[0]) != SQLITE_BLOB)
+                return SQLITE_OK;
+            // The client can bind any blob, so the data has to be validated:
+            _container = Value::fromData(_fleeceData);
+            if (!_container) {
+                Warn("Invalid Fleece data in query parameter");
+                return SQLITE_MISMATCH;
+            }
+        } else {
+            slice data;
+            try {
+                // Shares the decompressed body with the other functions called on this row:
+                data = _vtab->context->fleeceData(_fleeceData, &_decompressedData);
+            } catch (...) {
+                Warn("Invalid compressed record body in SQLite table");
+                return SQLITE_CORRUPT;
+            }
+            _container = Value::fromTrustedData(data);
+            if (!_container) {
+                Warn("Invalid Fleece data in SQLite table");
+                return SQLITE_MISMATCH; // failed to parse Fleece data
+            }
         }
 
         // Evaluate the path, if there is one:
         if (idxNum == kPathIndex) {
             _rootPath = valueAsSlice(argv[1]);
-            int rc = evaluatePath(_rootPath, _vtab->context.sharedKeys, &_container);
+            int rc = evaluatePath(_rootPath, _vtab->context->sharedKeys, &_container);
             if (rc != SQLITE_OK)
                 return rc;
         }
@@ -227,10 +326,153 @@ private:
                 default:     _rowCount = 1; break;
             }
         }
+
+        // Save the values of the constraints pushed down by bestIndex(), and skip to the first
+        // row that could match them:
+        int firstConstraintArg = (idxNum == kPathIndex) ? 2 : 1;
+        for (const char *op = idxStr; op && op[0]; op += 2) {
+            if (firstConstraintArg + _constraintCount >= argc)
+                return SQLITE_ERROR;
+            sqlite3_value *arg = argv[firstConstraintArg + _constraintCount];
+            auto &c = _constraints[_constraintCount++];
+            c.op = op[0];
+            c.binaryCollation = (op[1] == 'b');
+            c.type = sqlite3_value_type(arg);
+            c.intValue = sqlite3_value_int64(arg);
+            c.doubleValue = sqlite3_value_double(arg);
+            try {
+                if (c.type == SQLITE_TEXT)
+                    c.bytes = alloc_slice(valueAsStringSlice(arg));
+                else if (c.type == SQLITE_BLOB)
+                    c.bytes = alloc_slice(valueAsSlice(arg));
+            } catch (...) {
+                return SQLITE_NOMEM;
+            }
+        }
+        skipNonMatchingRows();
         return SQLITE_OK;
     }
 
 
+    // The SQLite type classes in their sort order; comparing values of different classes only
+    // depends on this order.
+    enum TypeClass { kNullClass, kNumericClass, kTextClass, kBlobClass };
+
+    static TypeClass typeClassOf(int sqliteType) noexcept {
+        switch (sqliteType) {
+            case SQLITE_INTEGER:
+            case SQLITE_FLOAT:  return kNumericClass;
+            case SQLITE_TEXT:   return kTextClass;
+            case SQLITE_BLOB:   return kBlobClass;
+            default:            return kNullClass;
+        }
+    }
+
+
+    // Compares an integer with a floating-point number exactly, as SQLite does; converting the
+    // integer to a double would round it if its magnitude is over 2^53.
+    static int compareIntWithDouble(int64_t i, double d) noexcept {
+        if (d < -9223372036854775808.0)
+            return 1;
+        if (d >= 9223372036854775808.0)
+            return -1;
+        auto truncated = (int64_t)d;
+        if (i != truncated)
+            return (i < truncated) ? -1 : 1;
+        auto asDouble = (double)i;
+        return (asDouble < d) ? -1 : (asDouble > d);
+    }
+
+
+    // Compares an item, as the 'value' column would return it, with a constraint's operand.
+    // Returns false if the result can't be known here: text comparisons depend on the collation,
+    // and the affinity of the other operand can convert between text and numbers.
+    static bool compareItem(const Value *item, const ValueConstraint &c, int &cmp) noexcept {
+        TypeClass itemClass, argClass = typeClassOf(c.type);
+        slice itemBytes;
+        bool bytesKnown = true;
+        switch (item->type()) {
+            case kNull:     itemClass = kBlobClass; break;     // returned as an empty blob
+            case kBoolean:
+            case kNumber:   itemClass = kNumericClass; break;
+            case kString:   itemClass = kTextClass; itemBytes = item->asString(); break;
+            case kData:     itemClass = kBlobClass; itemBytes = item->asData(); break;
+            default:        itemClass = kBlobClass; bytesKnown = false; break;  // encoded Fleece
+        }
+
+        if (itemClass != argClass) {
+            if (itemClass != kBlobClass && argClass != kBlobClass && argClass != kNullClass)
+                return false;   // number vs. text: affinity may convert one to the other
+            cmp = int(itemClass) - int(argClass);
+            return true;
+        }
+        switch (itemClass) {
+            case kNumericClass:
+                // The column returns unsigned integers as doubles, like other non-int64 numbers:
+                if (item->isInteger() && !item->isUnsigned()) {
+                    int64_t i = item->asInt();
+                    if (c.type == SQLITE_INTEGER)
+                        cmp = (i < c.intValue) ? -1 : (i > c.intValue);
+                    else
+                        cmp = compareIntWithDouble(i, c.doubleValue);
+                } else {
+                    double d = item->asDouble();
+                    if (c.type == SQLITE_INTEGER)
+                        cmp = -compareIntWithDouble(c.intValue, d);
+                    else
+                        cmp = (d < c.doubleValue) ? -1 : (d > c.doubleValue);
+                }
+                return true;
+            case kTextClass:
+                if (!c.binaryCollation)
+                    return false;
+                cmp = itemBytes.compare(c.bytes);
+                return true;
+            case kBlobClass:
+                if (!bytesKnown)
+                    return false;
+                cmp = itemBytes.compare(c.bytes);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+
+    // Returns false if the current item certainly fails one of the pushed-down constraints.
+    bool currentRowMayMatch() noexcept {
+        const Value *item = currentValue();
+        for (int i = 0; i < _constraintCount; ++i) {
+            auto &c = _constraints[i];
+            if (c.type == SQLITE_NULL || !item)
+                return false;           // a comparison with NULL is never true
+            int cmp;
+            if (!compareItem(item, c, cmp))
+                continue;
+            bool ok;
+            switch (c.op) {
+                case '=': ok = (cmp == 0); break;
+                case '<': ok = (cmp <  0); break;
+                case 'L': ok = (cmp <= 0); break;
+                case '>': ok = (cmp >  0); break;
+                case 'G': ok = (cmp >= 0); break;
+                default:  ok = true;       break;
+            }
+            if (!ok)
+                return false;
+        }
+        return true;
+    }
+
+
+    void skipNonMatchingRows() noexcept {
+        if (_constraintCount > 0) {
+            while (!atEOF() && !currentRowMayMatch())
+                ++_rowid;
+        }
+    }
+
+
     // Return true if the cursor has been moved off of the last row of output;
     bool atEOF() noexcept {
         return (_rowid >= _rowCount);
@@ -246,7 +488,7 @@ private:
                 auto key = currentKey();
                 if (key && key->isInteger()) {
                     setResultTextFromSlice(ctx,
-                                           _vtab->context.sharedKeys->decode((int)key->asInt()));
+                                           _vtab->context->sharedKeys->decode((int)key->asInt()));
                 } else {
                     setResultFromValue(ctx, key);
                 }
@@ -316,6 +558,7 @@ private:
     // Advance a FleeceCursor to its next row of output.
     int next() noexcept {
         ++_rowid;
+        skipNonMatchingRows();
         return SQLITE_OK;
     }
 
@@ -349,7 +592,31 @@ public:
     constexpr static sqlite3_module kEachModule = {
         0,                         /* iVersion */
         0,                         /* xCreate */
-        connect,                   /* xConnect */
+        connect<false>,            /* xConnect */
+        bestIndex,                 /* xBestIndex */
+        disconnect,                /* xDisconnect */
+        0,                         /* xDestroy */
+        open,                      /* xOpen - open a cursor */
+        close,                     /* xClose - close a cursor */
+        cursorFilter,              /* xFilter - configure scan constraints */
+        cursorNext,                /* xNext - advance a cursor */
+        cursorEof,                 /* xEof - check for end of scan */
+        cursorColumn,              /* xColumn - read data */
+        cursorRowid,               /* xRowid - read data */
+        0,                         /* xUpdate */
+        0,                         /* xBegin */
+        0,                         /* xSync */
+        0,                         /* xCommit */
+        0,                         /* xRollback */
+        0,                         /* xFindMethod */
+        0,                         /* xRename */
+    };
+
+    // Module definition of 'fl_each_param' function; the same except for xConnect
+    constexpr static sqlite3_module kEachParamModule = {
+        0,                         /* iVersion */
+        0,                         /* xCreate */
+        connect<true>,             /* xConnect */
         bestIndex,                 /* xBestIndex */
         disconnect,                /* xDisconnect */
         0,                         /* xDestroy */
@@ -373,17 +640,22 @@ public:
 
 
 constexpr sqlite3_module FleeceCursor::kEachModule;
+constexpr sqlite3_module FleeceCursor::kEachParamModule;
 
 
-int RegisterFleeceEachFunctions(sqlite3 *db,
-                                DataFile::FleeceAccessor accessor,
-                                SharedKeys *sharedKeys)
-{
+int RegisterFleeceEachFunctions(sqlite3 *db, fleeceFuncContext *context) {
+    int rc = sqlite3_create_module_v2(db,
+                                      "fl_each",
+                                      &FleeceCursor::kEachModule,
+                                      context->retain(),
+                                      &fleeceFuncContext::release);
+    if (rc != SQLITE_OK)
+        return rc;
     return sqlite3_create_module_v2(db,
-                                    "fl_each",
-                                    &FleeceCursor::kEachModule,
-                                    new fleeceFuncContext{accessor, sharedKeys},
-                                    [](void *param){delete (fleeceFuncContext*)param;});
+                                    "fl_each_param",
+                                    &FleeceCursor::kEachParamModule,
+                                    context->retain(),
+                                    &fleeceFuncContext::release);
 }
 
 
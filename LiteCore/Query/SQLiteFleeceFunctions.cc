@@ -40,13 +40,56 @@ namespace litecore {
         }
     }
 
+    // fl_materialize(body, propertyPath) -> columnValue
+    // Like fl_value, but arrays, dicts and data are returned as encoded Fleece: the result is
+    // stored in a column, which can't keep the subtype that tells Fleece apart from other blobs.
+    static void fl_materialize(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        try {
+            const Value *val;
+            if (!evaluatePath(ctx, argv, &val))
+                return;
+            if (val && (val->type() == kArray || val->type() == kDict || val->type() == kData))
+                setResultBlobFromEncodedValue(ctx, val);
+            else
+                setResultFromValue(ctx, val);
+        } catch (const std::exception &) {
+            sqlite3_result_error(ctx, "fl_materialize: exception!", -1);
+        }
+    }
+
+    // fl_materialized(columnValue) -> propertyValue
+    // Converts a value stored by fl_materialize back to what fl_value would have returned.
+    static void fl_materialized(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        sqlite3_value *arg = argv[0];
+        if (sqlite3_value_type(arg) != SQLITE_BLOB || sqlite3_value_bytes(arg) == 0) {
+            sqlite3_result_value(ctx, arg);     // Scalar, Fleece null, or missing
+            return;
+        }
+        const Value *val = Value::fromTrustedData(valueAsSlice(arg));
+        if (!val) {
+            Warn("Invalid Fleece data in materialized column");
+            sqlite3_result_error(ctx, "invalid Fleece data", -1);
+            sqlite3_result_error_code(ctx, SQLITE_MISMATCH);
+        } else if (val->type() == kData) {
+            setResultBlobFromSlice(ctx, val->asData());
+        } else {
+            sqlite3_result_value(ctx, arg);
+            sqlite3_result_subtype(ctx, kFleeceDataSubtype);
+        }
+    }
+
     // fl_root(body) -> fleeceData
     static void fl_root(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
         slice fleece = valueAsSlice(argv[0]);
         // Pull the Fleece data out of a raw document body, if necessary:
         auto funcCtx = (fleeceFuncContext*)sqlite3_user_data(ctx);
-        if (funcCtx->accessor)
-            fleece = funcCtx->accessor(fleece);
+        try {
+            fleece = funcCtx->fleeceData(fleece);
+        } catch (...) {
+            sqlite3_result_error(ctx, "fl_root: invalid compressed body", -1);
+            sqlite3_result_error_code(ctx, SQLITE_CORRUPT);
+            return;
+        }
         
         setResultBlobFromSlice(ctx, fleece);
     }
@@ -175,6 +218,8 @@ namespace litecore {
     const SQLiteFunctionSpec kFleeceFunctionsSpec[] = {
         { "fl_root",           1, fl_root  },
         { "fl_value",          2, fl_value  },
+        { "fl_materialize",    2, fl_materialize },
+        { "fl_materialized",   1, fl_materialized },
         { "fl_exists",         2, fl_exists },
         { "fl_type",           2, fl_type },
         { "fl_count",          2, fl_count },
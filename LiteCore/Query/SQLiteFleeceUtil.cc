@@ -9,6 +9,7 @@
 
 #include "SQLite_Internal.hh"
 #include "SQLiteFleeceUtil.hh"
+#include "RecordCompression.hh"
 #include "Path.hh"
 #include "Error.hh"
 #include "Logging.hh"
@@ -21,6 +22,30 @@ using namespace std;
 namespace litecore {
 
 
+    slice fleeceFuncContext::fleeceData(slice body, alloc_slice *retainData) {
+        if (isCompressedBody(body)) {
+            // A query typically calls several functions on each row's body, so cache the result.
+            // (The comparison has to be by content: SQLite may hand the functions different
+            // copies of the same body, or reuse a buffer for a different row's.)
+            if (slice(_compressedBody) != body) {
+                _decompressedBody = decompressBody(body);
+                _compressedBody = alloc_slice(body);
+            }
+            body = _decompressedBody;
+            if (retainData)
+                *retainData = _decompressedBody;
+        }
+        return accessor ? accessor(body) : body;
+    }
+
+
+    void fleeceFuncContext::release(void *context) {
+        auto self = (fleeceFuncContext*)context;
+        if (--self->_refCount == 0)
+            delete self;
+    }
+
+
     const Value* fleeceParam(sqlite3_context* ctx, sqlite3_value *arg) noexcept {
         slice fleece = valueAsSlice(arg);
         if (sqlite3_value_subtype(arg) == kFleecePointerSubtype) {
@@ -36,8 +61,14 @@ namespace litecore {
             if (sqlite3_value_subtype(arg) != kFleeceDataSubtype) {
                 // Pull the Fleece data out of a raw document body:
                 auto funcCtx = (fleeceFuncContext*)sqlite3_user_data(ctx);
-                if (funcCtx->accessor)
-                    fleece = funcCtx->accessor(fleece);
+                try {
+                    fleece = funcCtx->fleeceData(fleece);
+                } catch (...) {
+                    Warn("Invalid compressed record body in SQLite table");
+                    sqlite3_result_error(ctx, "invalid compressed body", -1);
+                    sqlite3_result_error_code(ctx, SQLITE_CORRUPT);
+                    return nullptr;
+                }
             }
             if (!fleece)
                 return Dict::kEmpty;             // No body; may be deleted rev
@@ -174,18 +205,18 @@ namespace litecore {
 
 
     static void registerFunctionSpecs(sqlite3 *db,
-                                      DataFile::FleeceAccessor accessor,
-                                      fleece::SharedKeys *sharedKeys,
+                                      fleeceFuncContext *context,
                                       const SQLiteFunctionSpec functions[])
     {
         for (auto fn = functions; fn->name; ++fn) {
+            // (SQLite calls the destructor callback even if registration fails.)
             int rc = sqlite3_create_function_v2(db,
                                                 fn->name,
                                                 fn->argCount,
                                                 SQLITE_UTF8 | SQLITE_DETERMINISTIC,
-                                                new fleeceFuncContext{accessor, sharedKeys},
+                                                context->retain(),
                                                 fn->function, nullptr, nullptr,
-                                                [](void *param) {delete (fleeceFuncContext*)param;});
+                                                &fleeceFuncContext::release);
             if (rc != SQLITE_OK)
                 throw SQLite::Exception(db, rc);
         }
@@ -196,10 +227,18 @@ namespace litecore {
                                  DataFile::FleeceAccessor accessor,
                                  fleece::SharedKeys *sharedKeys)
     {
-        registerFunctionSpecs(db, accessor, sharedKeys, kFleeceFunctionsSpec);
-        registerFunctionSpecs(db, accessor, sharedKeys, kRankFunctionsSpec);
-        registerFunctionSpecs(db, accessor, sharedKeys, kN1QLFunctionsSpec);
-        RegisterFleeceEachFunctions(db, accessor, sharedKeys);
+        auto context = new fleeceFuncContext(accessor, sharedKeys);
+        context->retain();      // Keep it alive while registering
+        try {
+            registerFunctionSpecs(db, context, kFleeceFunctionsSpec);
+            registerFunctionSpecs(db, context, kRankFunctionsSpec);
+            registerFunctionSpecs(db, context, kN1QLFunctionsSpec);
+            RegisterFleeceEachFunctions(db, context);
+        } catch (...) {
+            fleeceFuncContext::release(context);
+            throw;
+        }
+        fleeceFuncContext::release(context);
     }
 
 }
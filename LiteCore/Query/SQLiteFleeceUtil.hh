@@ -9,6 +9,9 @@
 #pragma once
 #include "Base.hh"
 #include "Fleece.hh"
+#include "LRUCache.hh"
+#include <memory>
+#include <string>
 #include <sqlite3.h>
 
 
@@ -19,10 +22,36 @@ namespace litecore {
     static const int kFleecePointerSubtype  = 0x67;   // Blob contains a raw Value* (4 or 8 bytes)
 
 
-    // What the user_data of a registered function points to
+    class CompiledRegex;
+
+
+    // What the user_data of a registered function points to. A single instance is shared by all
+    // the functions registered on a connection, so that they share its cache of the current
+    // row's decompressed body.
     struct fleeceFuncContext {
+        fleeceFuncContext(DataFile::FleeceAccessor a, fleece::SharedKeys *sk)
+        :accessor(a), sharedKeys(sk) { }
+
         DataFile::FleeceAccessor accessor;
         fleece::SharedKeys *sharedKeys;
+
+        // Recently compiled regular expressions, by pattern, for the regexp functions to reuse
+        // when a pattern isn't a constant (constant ones are cached by SQLite's auxdata.)
+        LRUCache<std::string, std::shared_ptr<CompiledRegex>> regexCache {16};
+
+        // Returns the Fleece data in a raw record body, decompressing it first if necessary.
+        // The result is only valid until the next call, unless `retainData` is given, in which
+        // case it's set to whatever buffer needs to stay alive. Throws if the body is corrupt.
+        slice fleeceData(slice body, alloc_slice *retainData =nullptr);
+
+        // Each registration retains the context; the destructor callback releases it.
+        fleeceFuncContext* retain()                     {++_refCount; return this;}
+        static void release(void *context);
+
+    private:
+        alloc_slice _compressedBody;    // Last compressed body seen by fleeceData()...
+        alloc_slice _decompressedBody;  // ...and its decompressed form
+        unsigned _refCount {0};
     };
 
 
@@ -65,7 +94,6 @@ namespace litecore {
     extern const SQLiteFunctionSpec kRankFunctionsSpec[];
     extern const SQLiteFunctionSpec kN1QLFunctionsSpec[];
 
-    int RegisterFleeceEachFunctions(sqlite3 *db, DataFile::FleeceAccessor,
-                                    fleece::SharedKeys*);
+    int RegisterFleeceEachFunctions(sqlite3 *db, fleeceFuncContext*);
 
 }
@@ -14,8 +14,12 @@
 #include "Logging.hh"
 #include "StringUtil.hh"
 #include "function_ref.hh"
+#include <algorithm>
 #include <regex>
+#include <cctype>
 #include <cmath>
+#include <cstring>
+#include <memory>
 #include <string>
 
 #ifdef _MSC_VER
@@ -561,49 +565,210 @@ namespace litecore {
 #pragma mark - REGULAR EXPRESSIONS:
 
 
+    // A compiled regular expression. Patterns that are just literal text, optionally anchored
+    // with '^' and/or '$', are matched by comparing strings; the std::regex is only created if
+    // something needs it.
+    class CompiledRegex {
+    public:
+        explicit CompiledRegex(slice pattern)
+        :_pattern(pattern.asString())
+        {
+            parseLiteral();
+            if (!_isLiteral)
+                regex();        // Compile now, so an invalid pattern fails right away
+        }
+
+        bool isLiteral() const                          {return _isLiteral;}
+        bool isAnchored() const                         {return _anchorStart || _anchorEnd;}
+        const string& literal() const                   {return _literal;}
+
+        const std::regex& regex() const {
+            if (!_regex)
+                _regex.reset(new std::regex(_pattern));
+            return *_regex;
+        }
+
+        // Finds the first match in `str`, setting its byte offset and length.
+        bool search(slice str, size_t &matchPos, size_t &matchLen) const {
+            if (_isLiteral) {
+                size_t n = _literal.size();
+                matchLen = n;
+                if (n > str.size)
+                    return false;
+                if (_anchorStart) {
+                    matchPos = 0;
+                    return memcmp(str.buf, _literal.data(), n) == 0
+                        && (!_anchorEnd || n == str.size);
+                } else if (_anchorEnd) {
+                    matchPos = str.size - n;
+                    return memcmp((const char*)str.buf + matchPos, _literal.data(), n) == 0;
+                } else {
+                    auto begin = (const char*)str.buf, end = (const char*)str.end();
+                    auto found = std::search(begin, end, _literal.begin(), _literal.end());
+                    matchPos = found - begin;
+                    return found != end || n == 0;
+                }
+            }
+            cmatch m;
+            if (!regex_search((const char*)str.buf, (const char*)str.end(), m, regex()))
+                return false;
+            matchPos = m.position(0);
+            matchLen = m.length(0);
+            return true;
+        }
+
+    private:
+        // Sets _isLiteral if the pattern has no special characters, other than escaped
+        // punctuation and anchors at the ends.
+        void parseLiteral() {
+            const char *cp = _pattern.data(), *end = cp + _pattern.size();
+            if (cp < end && *cp == '^') {
+                _anchorStart = true;
+                ++cp;
+            }
+            if (end > cp && end[-1] == '$' && !(end - 1 > cp && end[-2] == '\\')) {
+                _anchorEnd = true;
+                --end;
+            }
+            for (; cp < end; ++cp) {
+                char c = *cp;
+                if (c == '\\') {
+                    if (++cp == end || isalnum((unsigned char)*cp))
+                        return;         // \d, \w, \b etc. aren't literal
+                    c = *cp;
+                } else if (strchr("^$.|?*+()[]{}", c)) {
+                    return;
+                }
+                _literal += c;
+            }
+            _isLiteral = true;
+        }
+
+        string _pattern;
+        string _literal;
+        bool _isLiteral {false}, _anchorStart {false}, _anchorEnd {false};
+        mutable unique_ptr<std::regex> _regex;
+    };
+
+
+    // Returns the compiled form of the pattern in argv[patternArg]. If the pattern is a constant
+    // it's compiled once per statement and kept by SQLite as auxdata; otherwise the connection's
+    // LRU cache of recent patterns is used. Returns null, having set the result, if the pattern
+    // is not a string or not a valid regular expression.
+    static const CompiledRegex* compiledRegex(sqlite3_context* ctx,
+                                              sqlite3_value **argv,
+                                              int patternArg) noexcept
+    {
+        auto cached = (shared_ptr<CompiledRegex>*)sqlite3_get_auxdata(ctx, patternArg);
+        if (cached)
+            return cached->get();
+        slice pattern = stringArgument(argv[patternArg]);
+        if (!pattern) {
+            sqlite3_result_null(ctx);
+            return nullptr;
+        }
+        try {
+            auto funcCtx = (fleeceFuncContext*)sqlite3_user_data(ctx);
+            string key = pattern.asString();
+            shared_ptr<CompiledRegex> compiled;
+            if (auto recent = funcCtx->regexCache.get(key)) {
+                compiled = *recent;
+            } else {
+                compiled = make_shared<CompiledRegex>(pattern);
+                funcCtx->regexCache.put(key, compiled);
+            }
+            sqlite3_set_auxdata(ctx, patternArg, new shared_ptr<CompiledRegex>(compiled),
+                                [](void *auxdata) {
+                                    delete (shared_ptr<CompiledRegex>*)auxdata;
+                                });
+            return compiled.get();      // (still retained by the LRU cache)
+        } catch (const regex_error&) {
+            sqlite3_result_error(ctx, "invalid regular expression", -1);
+        } catch (const bad_alloc&) {
+            sqlite3_result_error_nomem(ctx);
+        }
+        return nullptr;
+    }
+
+
     static void regexp_like(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
-        auto arg0 = stringArgument(argv[0]);
-        auto arg1 = stringArgument(argv[1]);
-        regex r((char *)arg1.buf);
-        int result = regex_search((char *)arg0.buf, r) ? 1 : 0;
-        sqlite3_result_int(ctx, result);
+        auto re = compiledRegex(ctx, argv, 1);
+        if (!re)
+            return;
+        auto str = stringArgument(argv[0]);
+        if (!str) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+        size_t pos, len;
+        sqlite3_result_int(ctx, re->search(str, pos, len) ? 1 : 0);
     }
 
     static void regexp_position(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
-        auto arg0 = stringArgument(argv[0]);
-        auto arg1 = stringArgument(argv[1]);
-        regex r((char *)arg1.buf);
-        cmatch pattern_match;
-        if(!regex_search((char *)arg0.buf, pattern_match, r)) {
+        auto re = compiledRegex(ctx, argv, 1);
+        if (!re)
+            return;
+        auto str = stringArgument(argv[0]);
+        if (!str) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+        size_t pos, len;
+        if (!re->search(str, pos, len)) {
             sqlite3_result_int64(ctx, -1);
             return;
         }
-
-        sqlite3_result_int64(ctx, pattern_match.prefix().length());
+        sqlite3_result_int64(ctx, pos);
     }
 
     static void regexp_replace(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
-        auto expression = stringArgument(argv[0]).asString();
-        auto pattern = stringArgument(argv[1]);
+        auto re = compiledRegex(ctx, argv, 1);
+        if (!re)
+            return;
+        auto str = stringArgument(argv[0]);
+        if (!str) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+        auto expression = str.asString();
         auto repl = stringArgument(argv[2]).asString();
-        string result;
-        auto out = back_inserter(result);
         int n = -1;
         if(argc == 4) {
             n = sqlite3_value_int(argv[3]);
         }
 
-        regex r((char *)pattern.buf);
-        auto iter = sregex_iterator(expression.begin(), expression.end(), r);
-        auto last_iter = iter;
-        auto stop = sregex_iterator();
-        for(; n-- && iter != stop; ++iter) {
-            out = copy(iter->prefix().first, iter->prefix().second, out);
-            out = iter->format(out, repl);
-            last_iter = iter;
+        string result;
+        try {
+            if (re->isLiteral() && !re->isAnchored() && !re->literal().empty()
+                                && repl.find('$') == string::npos) {
+                // Plain substring replacement:
+                auto &literal = re->literal();
+                size_t pos = 0, found;
+                for (; n-- && (found = expression.find(literal, pos)) != string::npos;
+                       pos = found + literal.size()) {
+                    result.append(expression, pos, found - pos);
+                    result += repl;
+                }
+                result.append(expression, pos, string::npos);
+            } else {
+                auto out = back_inserter(result);
+                auto tail = expression.cbegin();
+                auto iter = sregex_iterator(expression.begin(), expression.end(), re->regex());
+                auto stop = sregex_iterator();
+                for(; n-- && iter != stop; ++iter) {
+                    out = copy(iter->prefix().first, iter->prefix().second, out);
+                    out = iter->format(out, repl);
+                    tail = (*iter)[0].second;
+                }
+                copy(tail, expression.cend(), out);
+            }
+        } catch (const regex_error&) {
+            sqlite3_result_error(ctx, "invalid regular expression", -1);
+            return;
+        } catch (const bad_alloc&) {
+            sqlite3_result_error_nomem(ctx);
+            return;
         }
-
-        out = copy(last_iter->suffix().first, last_iter->suffix().second, out);
         sqlite3_result_text(ctx, result.c_str(), (int)result.size(), SQLITE_TRANSIENT);
     }
 
@@ -15,7 +15,6 @@
 #include "Error.hh"
 #include "StringUtil.hh"
 #include "Fleece.hh"
-#include "Path.hh"
 #include "Stopwatch.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include <sqlite3.h>
@@ -37,100 +36,136 @@ namespace litecore {
     };
 
 
-    class SQLiteQuery : public Query {
-    public:
-        SQLiteQuery(SQLiteKeyStore &keyStore, slice selectorExpression)
-        :Query(keyStore)
-        {
+    // The result of translating a JSON query into SQL. It's immutable, so the key store can
+    // cache it and share it between the SQLiteQuery objects it creates for the same expression.
+    struct CompiledQuery {
+        string sql;
+        vector<string> columnNames;             // Names of the custom result columns
+        set<string> parameters;
+        vector<string> ftsTables;
+        vector<string> rewrites;                // Predicates QueryParser made index-friendly
+        unsigned firstCustomResultColumn;
+        bool isAggregate;
+        bool isPerDocument;
+
+        CompiledQuery(SQLiteKeyStore &keyStore, slice selectorExpression) {
             LogTo(SQL, "Compiling JSON query: %.*s", SPLAT(selectorExpression));
             QueryParser qp(keyStore.tableName());
+            qp.setMaterializedProperties(keyStore.materializedProperties());
+            qp.setArrayIndexedProperties(keyStore.arrayIndexedProperties());
+            qp.setMappedFTSTables(keyStore.mappedFTSTables());
+            qp.setIndexedExpressions(keyStore.indexedExpressions());
             qp.parseJSON(selectorExpression);
 
-            _parameters = qp.parameters();
-            for (auto p = _parameters.begin(); p != _parameters.end();) {
+            parameters = qp.parameters();
+            for (auto p = parameters.begin(); p != parameters.end();) {
                 if (hasPrefix(*p, "opt_"))
-                    p = _parameters.erase(p);       // Optional param, don't warn if it's unbound
+                    p = parameters.erase(p);        // Optional param, don't warn if it's unbound
                 else
                     ++p;
             }
 
-            _ftsTables = qp.ftsTablesUsed();
-            for (auto ftsTable : _ftsTables) {
-                if (!keyStore.db().tableExists(ftsTable))
+            ftsTables = qp.ftsTablesUsed();
+            // (An index table that isn't registered yet is still being built.)
+            for (auto ftsTable : ftsTables) {
+                if (!keyStore.hasIndexTable(ftsTable))
                     error::_throw(error::NoSuchIndex, "'match' test requires a full-text index");
             }
-            if (!_ftsTables.empty())
+            for (auto &geoTable : qp.geoTablesUsed()) {
+                if (!keyStore.hasIndexTable(geoTable))
+                    error::_throw(error::NoSuchIndex, "'WITHIN' test requires a geo index");
+            }
+            if (!ftsTables.empty())
                 keyStore.createSequenceIndex();     // 'match' operator uses a join on the sequence
 
-            string sql = qp.SQL();
+            rewrites = qp.rewrites();
+
+            sql = qp.SQL();
             LogTo(SQL, "Compiled Query: %s", sql.c_str());
-            _statement.reset(keyStore.compile(sql));
-            
-            _1stCustomResultColumn = qp.firstCustomResultColumn();
-            _isAggregate = qp.isAggregateQuery();
+            firstCustomResultColumn = qp.firstCustomResultColumn();
+            isAggregate = qp.isAggregateQuery();
+            isPerDocument = qp.isPerDocumentQuery();
+
+            // Preparing the statement checks the SQL, and SQLite works out the column names:
+            unique_ptr<SQLite::Statement> statement(keyStore.compile(sql));
+            for (int i = (int)firstCustomResultColumn; i < statement->getColumnCount(); ++i)
+                columnNames.push_back(statement->getColumnName(i));
         }
+    };
 
 
-        sequence_t lastSequence() const {
+    class SQLiteQuery : public Query {
+    public:
+        SQLiteQuery(SQLiteKeyStore &keyStore, slice selectorExpression,
+                    const CompiledQuery &compiled)
+        :Query(keyStore)
+        ,_parameters(compiled.parameters)
+        ,_ftsTables(compiled.ftsTables)
+        ,_rewrites(compiled.rewrites)
+        ,_1stCustomResultColumn(compiled.firstCustomResultColumn)
+        ,_isAggregate(compiled.isAggregate)
+        ,_isPerDocument(compiled.isPerDocument)
+        ,_expression(selectorExpression)
+        ,_sql(compiled.sql)
+        ,_columnNames(compiled.columnNames)
+        { }
+
+
+        // The DB's last sequence, as seen by the given pooled connection (or the main one.)
+        sequence_t lastSequence(SQLiteReadConnection *conn =nullptr) const {
+            if (conn)
+                return ((SQLiteDataFile&)keyStore().dataFile()).lastSequence(keyStore().name(),
+                                                                              conn);
             return keyStore().lastSequence();
         }
 
 
+        unsigned fullTextMatchCount() const noexcept override {
+            return (unsigned)_ftsTables.size();
+        }
+
+
         alloc_slice getMatchedText(FullTextID ftsID) override {
             if (ftsID == 0)
                 error::_throw(error::InvalidParameter);
-            // Get the expression that generated the text
+            return getMatchedTexts({ftsID})[0][0];
+        }
+
+
+        // The text comes from the full-text index tables, which store exactly what was indexed,
+        // rather than from the documents: so each table takes one query per batch of rows, and
+        // the expressions don't have to be evaluated again.
+        vector<vector<alloc_slice>> getMatchedTexts(const vector<FullTextID> &ftsIDs) override {
             if (_ftsTables.size() == 0)
                 error::_throw(error::NoSuchIndex);
-            string expr = _ftsTables[0];    // TODO: Support for multiple matches in a query
-            auto delim = expr.find("::");
-            Assert(delim != string::npos);
-
-            // FIXME: Currently only property expressions are supported:
-            if (expr[delim+2] != '.') {
-                Warn("Unable to get matched text from expression %s", expr.c_str());
-                error::_throw(error::Unimplemented);
+            auto &ks = (SQLiteKeyStore&)keyStore();
+            vector<sequence_t> sequences(ftsIDs.begin(), ftsIDs.end());
+            vector<vector<alloc_slice>> result(ftsIDs.size());
+            for (auto &ftsTable : _ftsTables) {
+                auto texts = ks.indexedTexts(ftsTable, sequences);
+                for (size_t i = 0; i < texts.size(); ++i)
+                    result[i].push_back(texts[i]);
             }
-            string path = expr.substr(delim+3);
-
-            // Now load the document and evaluate the expression:
-            alloc_slice result;
-            keyStore().get(ftsID, kDefaultContent, [&](const Record &rec) {
-                if (rec.body()) {
-                    slice fleeceData = rec.body();
-                    auto accessor = keyStore().dataFile().fleeceAccessor();
-                    if (accessor)
-                        fleeceData = accessor(fleeceData);
-                    auto root = fleece::Value::fromTrustedData(fleeceData);
-                    //TODO: Support multiple FTS properties in a query
-                    auto textObj = fleece::Path::eval(path,
-                                                      keyStore().dataFile().documentKeys(),
-                                                      root);
-                    if (textObj)
-                        result = textObj->asString();
-                }
-            });
             return result;
         }
 
 
         virtual unsigned columnCount() const noexcept override {
-            return _statement->getColumnCount() - _1stCustomResultColumn;
+            return (unsigned)_columnNames.size();
         }
 
 
         virtual string nameOfColumn(unsigned col) const override {
-            return _statement->getColumnName(_1stCustomResultColumn + col);
+            return _columnNames.at(col);
         }
 
         
         string explain() override {
             stringstream result;
             // https://www.sqlite.org/eqp.html
-            string query = _statement->getQuery();
-            result << query << "\n";
+            result << _sql << "\n";
 
-            string sql = "EXPLAIN QUERY PLAN " + query;
+            string sql = "EXPLAIN QUERY PLAN " + _sql;
             auto &df = (SQLiteDataFile&) keyStore().dataFile();
             SQLite::Statement x(df, sql);
             while (x.executeStep()) {
@@ -138,30 +173,121 @@ namespace litecore {
                     result << x.getColumn(i).getInt() << "|";
                 result << " " << x.getColumn(3).getText() << "\n";
             }
+            for (auto &rewrite : _rewrites)
+                result << "Rewrote for index use: " << rewrite << "\n";
             return result.str();
         }
 
         virtual QueryEnumerator* createEnumerator(const Options *options) override;
         SQLiteQueryEnumerator* createEnumerator(const Options *options, sequence_t lastSeq);
+        QueryEnumerator* createStreamingEnumerator(const Options *options, sequence_t lastSeq);
+
+        bool isPerDocument() const override                     {return _isPerDocument;}
+        void getRowsByDocID(const Options*,
+                            function_ref<void(slice docID, slice row)>) override;
+        alloc_slice getRowForDocID(slice docID, const Options*) override;
+
+        // Unless the options allow stale results, indexes any documents still queued by the
+        // deferred full-text indexes the query uses.
+        void catchUpFullText(const Options *options) {
+            if (options && options->allowStaleFullText)
+                return;
+            auto &ks = (SQLiteKeyStore&)keyStore();
+            for (auto &ftsTable : _ftsTables)
+                ks.catchUpDeferredIndex(ftsTable);
+        }
 
         set<string> _parameters;
         vector<string> _ftsTables;
+        vector<string> _rewrites;               // Predicates QueryParser made index-friendly
         unsigned _1stCustomResultColumn;
         bool _isAggregate;
+        bool _isPerDocument;
+
+        // Returns the statement to run the query with: compiled on the pooled read connection
+        // if one is given, else the one on the main connection, which is compiled the first time
+        // it's needed. If `privateCopy` is true, a new main-connection statement is compiled, for
+        // an enumerator that keeps stepping it after createEnumerator() returns and so can't
+        // share the cached one.
+        shared_ptr<SQLite::Statement> statementFor(SQLiteReadConnection *conn,
+                                                   bool privateCopy =false)
+        {
+            if (conn)
+                return conn->compile(_sql);
+            auto &ks = (SQLiteKeyStore&)keyStore();
+            if (privateCopy)
+                return shared_ptr<SQLite::Statement>(ks.compile(_sql));
+            lock_guard<mutex> lock(_statementMutex);
+            if (!_statement)
+                _statement.reset(ks.compile(_sql));
+            return _statement;
+        }
 
-        shared_ptr<SQLite::Statement> statement() {return _statement;}
+        // Returns a statement for a variant of the query whose rows include the docID, optionally
+        // restricted to a single document (see QueryParser::setTrackDocIDs.)
+        shared_ptr<SQLite::Statement> docIDStatementFor(SQLiteReadConnection *conn,
+                                                        bool restrictToDocID)
+        {
+            auto &ks = (SQLiteKeyStore&)keyStore();
+            lock_guard<mutex> lock(_docIDMutex);
+            string &sql = restrictToDocID ? _oneDocSQL : _docIDSQL;
+            if (sql.empty()) {
+                QueryParser qp(ks.tableName());
+                qp.setMaterializedProperties(ks.materializedProperties());
+                qp.setArrayIndexedProperties(ks.arrayIndexedProperties());
+                qp.setMappedFTSTables(ks.mappedFTSTables());
+                qp.setIndexedExpressions(ks.indexedExpressions());
+                qp.setTrackDocIDs(restrictToDocID);
+                qp.parseJSON(_expression);
+                _docIDColumn = qp.firstCustomResultColumn() - 1;
+                sql = qp.SQL();
+                LogTo(SQL, "Compiled per-document query: %s", sql.c_str());
+            }
+            if (conn)
+                return conn->compile(sql);
+            auto &stmt = restrictToDocID ? _oneDocStatement : _docIDStatement;
+            if (!stmt)
+                stmt.reset(ks.compile(sql));
+            return stmt;
+        }
 
     protected:
         ~SQLiteQuery() =default;
             
     private:
-        shared_ptr<SQLite::Statement> _statement;
+        alloc_slice _expression;
+        string _sql;
+        vector<string> _columnNames;
+        mutex _statementMutex;
+        shared_ptr<SQLite::Statement> _statement;                         // Compiled on demand
+        mutex _docIDMutex;                                                // Guards the members below
+        string _docIDSQL, _oneDocSQL;                                     // Generated on demand
+        shared_ptr<SQLite::Statement> _docIDStatement, _oneDocStatement;  // Compiled on demand
+        unsigned _docIDColumn {0};
     };
 
 
 #pragma mark - QUERY ENUMERATOR:
 
 
+    // Parses the offsets() column of a full-text query row into a vector of terms.
+    static void readFullTextTerms(const Array *row, vector<QueryEnumerator::FullTextTerm> &terms) {
+        terms.clear();
+        // The offsets() function returns a string of space-separated numbers in groups of 4.
+        string offsets = row->get(kFTSOffsetsCol)->asString().asString();
+        const char *termStr = offsets.c_str();
+        while (*termStr) {
+            uint32_t n[4];
+            for (int i = 0; i < 4; ++i) {
+                char *next;
+                n[i] = (uint32_t)strtol(termStr, &next, 10);
+                termStr = next;
+            }
+            terms.push_back({n[1], n[2], n[3]});    // {term #, byte offset, byte length}
+        }
+    }
+
+
     // Base class of SQLite query enumerators.
     class SQLiteQueryEnumBase {
     public:
@@ -249,19 +375,7 @@ namespace litecore {
         }
 
         const std::vector<FullTextTerm>& fullTextTerms() override {
-            _fullTextTerms.clear();
-            // The offsets() function returns a string of space-separated numbers in groups of 4.
-            string offsets = _iter->asArray()->get(kFTSOffsetsCol)->asString().asString();
-            const char *termStr = offsets.c_str();
-            while (*termStr) {
-                uint32_t n[4];
-                for (int i = 0; i < 4; ++i) {
-                    char *next;
-                    n[i] = (uint32_t)strtol(termStr, &next, 10);
-                    termStr = next;
-                }
-                _fullTextTerms.push_back({n[1], n[2], n[3]});    // {term #, byte offset, byte length}
-            }
+            readFullTextTerms(_iter->asArray(), _fullTextTerms);
             return _fullTextTerms;
         }
 
@@ -282,9 +396,10 @@ namespace litecore {
     // which is then used as the data source of a SQLiteQueryEnum.
     class SQLiteQueryRunner : public SQLiteQueryEnumBase {
     public:
-        SQLiteQueryRunner(SQLiteQuery *query, const Query::Options *options, sequence_t lastSequence)
+        SQLiteQueryRunner(SQLiteQuery *query, const Query::Options *options, sequence_t lastSequence,
+                          shared_ptr<SQLite::Statement> statement)
         :SQLiteQueryEnumBase(query, options, lastSequence)
-        ,_statement(query->statement())
+        ,_statement(statement)
         {
             _statement->clearBindings();
             _unboundParameters = _query->_parameters;
@@ -302,9 +417,7 @@ namespace litecore {
         }
 
         ~SQLiteQueryRunner() {
-            try {
-                _statement->reset();
-            } catch (...) { }
+            finish();
         }
 
         void bindParameters(slice json) {
@@ -337,6 +450,15 @@ namespace litecore {
                             _statement->bind(sqlKey, str.buf, (int)str.size);
                             break;
                         }
+                        case kArray:
+                        case kDict: {
+                            // Bound as Fleece data, for use with `IN $param` (see fl_each_param)
+                            Encoder enc;
+                            enc.writeValue(val);
+                            alloc_slice data = enc.extractOutput();
+                            _statement->bind(sqlKey, data.buf, (int)data.size);
+                            break;
+                        }
                         default:
                             error::_throw(error::InvalidParameter);
                     }
@@ -384,21 +506,56 @@ namespace litecore {
             }
         }
 
+        // Binds the docID of a statement restricted to one document.
+        void bindDocID(slice docID) {
+            _statement->bind(kDocIDParameterName, (string)docID);
+        }
+
+        // Advances to the next row; returns false at the end of the results.
+        bool step() {
+            return _statement->executeStep();
+        }
+
+        // Writes the current row's columns, starting at `firstCol`, to the encoder as an array.
+        void encodeCurrentRow(Encoder &enc, int firstCol =0) {
+            int nCols = _statement->getColumnCount();
+            enc.beginArray(nCols - firstCol);
+            for (int i = firstCol; i < nCols; ++i)
+                encodeColumn(enc, i);
+            enc.endArray();
+        }
+
+        // Steps the statement, and if there's a row, writes its columns to the encoder as an array.
+        // Returns false at the end of the results.
+        bool encodeRow(Encoder &enc) {
+            if (!step())
+                return false;
+            encodeCurrentRow(enc);
+            return true;
+        }
+
+        // Returns the current row's value of a text column, such as the docID.
+        slice textColumn(int i) {
+            SQLite::Column col = _statement->getColumn(i);
+            return slice(col.getText(), col.getBytes());
+        }
+
+        // Resets the statement, ending its read of the database.
+        void finish() noexcept {
+            try {
+                _statement->reset();
+            } catch (...) { }
+        }
+
         // Collects all the (remaining) rows into a Fleece array of arrays,
         // and returns an enumerator impl that will replay them.
         SQLiteQueryEnumerator* fastForward() {
             Stopwatch st;
-            int nCols = _statement->getColumnCount();
             uint64_t rowCount = 0;
             Encoder enc;
             enc.beginArray();
-            while (_statement->executeStep()) {
-                enc.beginArray(nCols);
-                for (int i = 0; i < nCols; ++i)
-                    encodeColumn(enc, i);
-                enc.endArray();
+            while (encodeRow(enc))
                 ++rowCount;
-            }
             enc.endArray();
             alloc_slice recording = enc.extractOutput();
             LogTo(SQL, "Created prerecorded query enum with %llu rows (%zu bytes) in %.3fms",
@@ -413,9 +570,154 @@ namespace litecore {
 
 
 
-    // The factory method that creates a SQLite Query.
+    // Query enumerator that steps its own SQLite statement as rows are requested, encoding only
+    // the current row into Fleece. The first row is available as soon as SQLite finds it, and
+    // memory use doesn't grow with the size of the result set; but random access isn't possible.
+    // The statement's read snapshot is held until the enumerator reaches the end or is deleted.
+    class SQLiteQueryStreamingEnumerator : public QueryEnumerator, SQLiteQueryEnumBase {
+    public:
+        SQLiteQueryStreamingEnumerator(SQLiteQuery *query,
+                                       const Query::Options *options,
+                                       sequence_t lastSequence,
+                                       SQLiteDataFile::ReadConnectionRef conn)
+        :SQLiteQueryEnumBase(query, options, lastSequence)
+        ,_conn(conn)
+        ,_runner(query, options, lastSequence, query->statementFor(conn.get(), true))
+        { }
+
+        // Reads the first row. This must be called within a read transaction, so that the
+        // statement's snapshot of the database is consistent with _lastSequence; SQLite keeps
+        // that snapshot until the statement is reset.
+        void start() {
+            readRow();
+            _atFirstRow = true;
+        }
+
+        bool next() override {
+            if (_atFirstRow)
+                _atFirstRow = false;
+            else if (_row)
+                readRow();
+            return _row != nullptr;
+        }
+
+        Array::iterator columns() const noexcept override {
+            Array::iterator i(_row);
+            i += _query->_1stCustomResultColumn;
+            return i;
+        }
+
+        QueryEnumerator* refresh() override {
+            // There's no recording to compare against, so any change to the database counts as
+            // a change to the results:
+            return _query->createStreamingEnumerator(&_options, _lastSequence);
+        }
+
+        bool hasFullText() const override {
+            return !_query->_ftsTables.empty();
+        }
+
+        const std::vector<FullTextTerm>& fullTextTerms() override {
+            readFullTextTerms(_row, _fullTextTerms);
+            return _fullTextTerms;
+        }
+
+        Query::FullTextID fullTextID() const override {
+            return (int)_row->get(kFTSSeqCol)->asInt();
+        }
+
+    private:
+        void readRow() {
+            _enc.reset();
+            if (_runner.encodeRow(_enc)) {
+                _rowData = _enc.extractOutput();
+                _row = Value::fromTrustedData(_rowData)->asArray();
+            } else {
+                _rowData = nullslice;
+                _row = nullptr;
+                _runner.finish();       // Release the read snapshot right away
+            }
+        }
+
+        SQLiteDataFile::ReadConnectionRef _conn;  // Pooled connection, if any (outlives _runner)
+        SQLiteQueryRunner _runner;
+        Encoder _enc;
+        alloc_slice _rowData;
+        const Array* _row {nullptr};
+        bool _atFirstRow {false};
+    };
+
+
+
+    // Holds a consistent read snapshot while a query starts running. Outside a transaction this
+    // is a read transaction on a pooled connection, so the query doesn't hold up (or wait for)
+    // other threads using the main connection; otherwise it's a read-only transaction on the
+    // main connection, so the query sees the transaction's changes.
+    class QuerySnapshot {
+    public:
+        explicit QuerySnapshot(DataFile &dataFile)
+        :_conn(((SQLiteDataFile&)dataFile).readConnection())
+        {
+            if (_conn)
+                _connTransaction.reset(new SQLiteReadConnection::Transaction(*_conn));
+            else
+                _transaction.reset(new ReadOnlyTransaction(dataFile));
+        }
+
+        const SQLiteDataFile::ReadConnectionRef& connection() const     {return _conn;}
+
+    private:
+        SQLiteDataFile::ReadConnectionRef _conn;
+        unique_ptr<ReadOnlyTransaction> _transaction;
+        unique_ptr<SQLiteReadConnection::Transaction> _connTransaction;
+    };
+
+
+    // The factory method that creates a SQLite Query. Translated queries are cached by their
+    // JSON expression, since apps tend to create the same few queries over and over. Each Query
+    // gets its own statements, though, since its caller may run it on any thread; they're only
+    // compiled when it runs, and usually come from a pooled connection's statement cache.
     Retained<Query> SQLiteKeyStore::compileQuery(slice selectorExpression) {
-        return new SQLiteQuery(*this, selectorExpression);
+        // Another connection may have created or deleted an index. This only reads the schema
+        // version if the file has changed, and clears the cache if the version has changed:
+        checkSchema();
+        string key = (string)selectorExpression;
+        shared_ptr<const CompiledQuery> compiled;
+        {
+            lock_guard<mutex> lock(_queryCacheMutex);
+            auto cached = _queryCache.get(key);
+            if (cached) {
+                ++_queryCacheStats.hits;
+                compiled = *cached;
+            } else {
+                ++_queryCacheStats.misses;
+            }
+        }
+        if (!compiled) {
+            compiled = make_shared<CompiledQuery>(*this, selectorExpression);
+            lock_guard<mutex> lock(_queryCacheMutex);
+            _queryCache.put(key, compiled);
+        }
+        return new SQLiteQuery(*this, selectorExpression, *compiled);
+    }
+
+
+    void SQLiteKeyStore::setQueryCacheSize(size_t size) {
+        lock_guard<mutex> lock(_queryCacheMutex);
+        _queryCache.setCapacity(size);
+    }
+
+
+    // Must be called when the schema changes in a way that affects how queries are compiled,
+    // i.e. when indexes are created or deleted. (checkSchema calls it when another connection
+    // has changed the schema.)
+    void SQLiteKeyStore::invalidateQueryCache() {
+        {
+            lock_guard<mutex> lock(_queryCacheMutex);
+            _queryCache.clear();
+        }
+        lock_guard<mutex> lock(_indexedTextsMutex);
+        _indexedTextsQueries.clear();
     }
 
 
@@ -424,19 +726,74 @@ namespace litecore {
     SQLiteQueryEnumerator* SQLiteQuery::createEnumerator(const Options *options,
                                                          sequence_t lastSeq)
     {
+        catchUpFullText(options);
         // Start a read-only transaction, to ensure that the result of lastSequence() will be
         // consistent with the query results.
-        ReadOnlyTransaction t(keyStore().dataFile());
+        QuerySnapshot snapshot(keyStore().dataFile());
+        auto conn = snapshot.connection().get();
 
-        sequence_t curSeq = lastSequence();
+        sequence_t curSeq = lastSequence(conn);
         if (lastSeq > 0 && lastSeq == curSeq)
             return nullptr;
-        SQLiteQueryRunner recorder(this, options, curSeq);
+        SQLiteQueryRunner recorder(this, options, curSeq, statementFor(conn));
         return recorder.fastForward();
     }
 
+    // Same as above, but the enumerator steps the statement lazily instead of recording it.
+    // It keeps the pooled connection (if any) until it's deleted.
+    QueryEnumerator* SQLiteQuery::createStreamingEnumerator(const Options *options,
+                                                            sequence_t lastSeq)
+    {
+        catchUpFullText(options);
+        QuerySnapshot snapshot(keyStore().dataFile());
+
+        sequence_t curSeq = lastSequence(snapshot.connection().get());
+        if (lastSeq > 0 && lastSeq == curSeq)
+            return nullptr;
+        unique_ptr<SQLiteQueryStreamingEnumerator> e(
+                new SQLiteQueryStreamingEnumerator(this, options, curSeq, snapshot.connection()));
+        e->start();
+        return e.release();
+    }
+
     QueryEnumerator* SQLiteQuery::createEnumerator(const Options *options) {
+        if (options && options->streaming)
+            return createStreamingEnumerator(options, 0);
         return createEnumerator(options, 0);
     }
 
+
+#pragma mark - PER-DOCUMENT EVALUATION:
+
+
+    void SQLiteQuery::getRowsByDocID(const Options *options,
+                                     function_ref<void(slice docID, slice row)> callback)
+    {
+        Assert(_isPerDocument);
+        QuerySnapshot snapshot(keyStore().dataFile());
+        auto conn = snapshot.connection().get();
+        SQLiteQueryRunner runner(this, options, lastSequence(conn),
+                                 docIDStatementFor(conn, false));
+        Encoder enc;
+        while (runner.step()) {
+            enc.reset();
+            runner.encodeCurrentRow(enc, _docIDColumn + 1);
+            alloc_slice row = enc.extractOutput();
+            callback(runner.textColumn(_docIDColumn), row);
+        }
+    }
+
+
+    alloc_slice SQLiteQuery::getRowForDocID(slice docID, const Options *options) {
+        Assert(_isPerDocument);
+        auto conn = ((SQLiteDataFile&)keyStore().dataFile()).readConnection();
+        SQLiteQueryRunner runner(this, options, 0, docIDStatementFor(conn.get(), true));
+        runner.bindDocID(docID);
+        if (!runner.step())
+            return alloc_slice();
+        Encoder enc;
+        runner.encodeCurrentRow(enc, _docIDColumn + 1);
+        return enc.extractOutput();
+    }
+
 }
@@ -32,7 +32,7 @@ namespace litecore {
         deque<Rev> revs(count);
         auto rev = revs.begin();
         for (; rawRev->isValid(); rawRev = rawRev->next()) {
-            rawRev->copyTo(*rev, revs);
+            rawRev->copyTo(*rev, &revs);
             if (rev->sequence == 0)
                 rev->sequence = curSeq;
             rev->owner = owner;
@@ -45,6 +45,25 @@ namespace litecore {
     }
 
 
+    std::deque<Rev> RawRevision::decodeCurrentRev(slice raw_tree, RevTree* owner,
+                                                  sequence_t curSeq)
+    {
+        const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
+        deque<Rev> revs;
+        if (rawRev->isValid()) {
+            if ((const uint8_t*)rawRev->next() > (const uint8_t*)raw_tree.end() - sizeof(uint32_t))
+                error::_throw(error::CorruptRevisionData);
+            revs.emplace_back();
+            Rev &rev = revs.front();
+            rawRev->copyTo(rev, nullptr);
+            if (rev.sequence == 0)
+                rev.sequence = curSeq;
+            rev.owner = owner;
+        }
+        return revs;
+    }
+
+
     alloc_slice RawRevision::encodeTree(const vector<Rev*> &revs) {
         // Allocate output buffer:
         size_t totalSize = sizeof(uint32_t);  // start with space for trailing 0 size
@@ -90,15 +109,17 @@ namespace litecore {
         return (RawRevision*)offsetby(this, revSize);
     }
 
-    void RawRevision::copyTo(Rev &dst, const deque<Rev> &revs) const {
+    void RawRevision::copyTo(Rev &dst, const deque<Rev> *revs) const {
         const void* end = this->next();
         dst.revID = {this->revID, this->revIDLen};
         dst.flags = (Rev::Flags)(this->flags & ~kPersistentOnlyFlags);
         auto parentIndex = _dec16(this->parentIndex_BE);
-        if (parentIndex == kNoParent)
+        if (parentIndex == kNoParent || !revs)
             dst.parent = nullptr;
+        else if (parentIndex < revs->size())
+            dst.parent = &(*revs)[parentIndex];
         else
-            dst.parent = &revs[parentIndex];
+            error::_throw(error::CorruptRevisionData);
         const void *data = offsetby(&this->revID, this->revIDLen);
         ptrdiff_t len = (uint8_t*)end-(uint8_t*)data;
         data = offsetby(data, GetUVarInt(slice(data, len), &dst.sequence));
@@ -28,6 +28,17 @@ namespace litecore {
                                                 RevTree *owner NONNULL,
                                                 sequence_t curSeq);
 
+        /** Decodes just the first (current) revision, leaving its parent pointer null. */
+        static std::deque<Rev> decodeCurrentRev(slice raw_tree,
+                                                RevTree *owner NONNULL,
+                                                sequence_t curSeq);
+
+        /** Returns true if the encoded tree contains any revisions besides the current one. */
+        static inline bool hasMultipleRevs(slice raw_tree) noexcept {
+            const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
+            return rawRev->isValid() && rawRev->next()->isValid();
+        }
+
         static alloc_slice encodeTree(const std::vector<Rev*> &revs);
 
         static inline slice getCurrentRevBody(slice raw_tree) noexcept {
@@ -73,7 +84,9 @@ namespace litecore {
         }
 
         static size_t sizeToWrite(const Rev&);
-        void copyTo(Rev &dst, const std::deque<Rev>&) const;
+        /** Copies this revision into `dst`, pointing its parent into `revs`; if `revs` is null
+            the parent is left null. Throws CorruptRevisionData on an out-of-range parent. */
+        void copyTo(Rev &dst, const std::deque<Rev> *revs) const;
         RawRevision* copyFrom(const Rev &rev);
     };
 
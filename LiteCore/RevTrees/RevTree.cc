@@ -42,6 +42,7 @@ namespace litecore {
     ,_sorted(other._sorted)
     ,_changed(other._changed)
     ,_unknown(other._unknown)
+    ,_historyLoaded(other._historyLoaded)
     {
         // It's important to have _revs in the same order as other._revs.
         // That means we can't just copy other._revsStorage to _revsStorage;
@@ -62,6 +63,13 @@ namespace litecore {
     void RevTree::decode(litecore::slice raw_tree, sequence_t seq) {
         _revsStorage = RawRevision::decodeTree(raw_tree, this, seq);
         initRevs();
+        _historyLoaded = true;
+    }
+
+    void RevTree::decodeCurrentRevision(slice raw_tree, sequence_t seq) {
+        _revsStorage = RawRevision::decodeCurrentRev(raw_tree, this, seq);
+        initRevs();
+        _historyLoaded = !RawRevision::hasMultipleRevs(raw_tree);
     }
 
     void RevTree::initRevs() {
@@ -74,10 +82,74 @@ namespace litecore {
     }
 
     alloc_slice RevTree::encode() {
+        loadHistory();
         sort();
         return RawRevision::encodeTree(_revs);
     }
 
+
+#pragma mark - HISTORY:
+
+    void RevTree::loadHistory() const {
+        if (!_historyLoaded && !_unknown) {
+            auto self = const_cast<RevTree*>(this);
+            self->readHistory();
+            self->_historyLoaded = true;
+        }
+    }
+
+    // Merges the full tree into this one, which contains only the current revision. The current
+    // Rev object is kept (along with its body), so existing pointers to it stay valid.
+    void RevTree::mergeHistory(const alloc_slice &raw_tree, sequence_t seq) {
+        Assert(_revs.size() == 1);
+        _insertedData.push_back(raw_tree);
+        std::deque<Rev> history = RawRevision::decodeTree(raw_tree, this, seq);
+        if (history.empty() || history[0].revID != _revs[0]->revID)
+            error::_throw(error::CorruptRevisionData);
+
+        // Move the history into _revsStorage, remembering where each Rev ended up:
+        std::vector<Rev*> revs;
+        revs.reserve(history.size());
+        revs.push_back(_revs[0]);
+        for (size_t i = 1; i < history.size(); ++i) {
+            _revsStorage.push_back(history[i]);
+            revs.push_back(&_revsStorage.back());
+        }
+        // Then re-point the parent links into the moved Revs:
+        for (size_t i = 0; i < history.size(); ++i) {
+            const Rev *parent = history[i].parent;
+            if (parent) {
+                size_t p = 0;
+                while (&history[p] != parent)
+                    ++p;
+                parent = revs[p];
+            }
+            revs[i]->parent = parent;
+        }
+        _revs = revs;
+    }
+
+    alloc_slice RevTree::encodeCurrentRevision() {
+        Assert(!_revs.empty());
+        sort();
+        Rev current = *_revs[0];
+        current.parent = nullptr;
+        return RawRevision::encodeTree({&current});
+    }
+
+    alloc_slice RevTree::encodeHistory() {
+        loadHistory();
+        Assert(!_revs.empty());
+        sort();
+        // The current revision is a leaf, so no other Rev's parent points to it; that makes it
+        // safe to substitute a body-less copy of it:
+        Rev current = *_revs[0];
+        current._body = nullslice;
+        std::vector<Rev*> revs(_revs);
+        revs[0] = &current;
+        return RawRevision::encodeTree(revs);
+    }
+
 #if DEBUG
     void Rev::dump(std::ostream& out) {
         out << "(" << sequence << ") " << (std::string)revID.expanded() << "  ";
@@ -102,6 +174,7 @@ namespace litecore {
 
     const Rev* RevTree::get(unsigned index) const {
         Assert(!_unknown);
+        loadHistory();
         Assert(index < _revs.size());
         return _revs[index];
     }
@@ -112,6 +185,10 @@ namespace litecore {
                 return rev;
         }
         Assert(!_unknown);
+        if (!_historyLoaded) {
+            loadHistory();
+            return get(revID);
+        }
         return nullptr;
     }
 
@@ -121,10 +198,15 @@ namespace litecore {
                 return rev;
         }
         Assert(!_unknown);
+        if (!_historyLoaded) {
+            loadHistory();
+            return getBySequence(seq);
+        }
         return nullptr;
     }
 
     bool RevTree::hasConflict() const {
+        loadHistory();
         if (_revs.size() < 2) {
             Assert(!_unknown);
             return false;
@@ -155,6 +237,7 @@ namespace litecore {
     }
 
     std::vector<const Rev*> Rev::history() const {
+        owner->loadHistory();
         std::vector<const Rev*> h;
         for (const Rev* rev = this; rev; rev = rev->parent)
             h.push_back(rev);
@@ -239,6 +322,7 @@ namespace litecore {
                                const Rev* parent, bool allowConflict,
                                int &httpStatus)
     {
+        loadHistory();
         // Make sure the given revID is valid:
         uint32_t newGen = revID.generation();
         if (newGen == 0) {
@@ -296,6 +380,7 @@ namespace litecore {
     int RevTree::insertHistory(const std::vector<revidBuffer> history, slice data,
                                Rev::Flags revFlags) {
         Assert(history.size() > 0);
+        loadHistory();
         // Find the common ancestor, if any. Along the way, preflight revision IDs:
         int i;
         unsigned lastGen = 0;
@@ -334,6 +419,7 @@ namespace litecore {
 
     // Remove bodies of already-saved revs that are no longer leaves:
     void RevTree::removeNonLeafBodies() {
+        loadHistory();
         for (Rev *rev : _revs) {
             if (rev->_body.size > 0 && !(rev->flags & (Rev::kLeaf | Rev::kNew | Rev::kKeepBody))) {
                 rev->removeBody();
@@ -344,6 +430,7 @@ namespace litecore {
 
     unsigned RevTree::prune(unsigned maxDepth) {
         Assert(maxDepth > 0);
+        loadHistory();
         if (_revs.size() <= maxDepth)
             return 0;
 
@@ -377,6 +464,7 @@ namespace litecore {
     }
 
     int RevTree::purge(revid leafID) {
+        loadHistory();
         int nPurged = 0;
         Rev* rev = (Rev*)get(leafID);
         if (!rev || !rev->isLeaf())
@@ -394,6 +482,7 @@ namespace litecore {
     }
 
     int RevTree::purgeAll() {
+        loadHistory();
         int result = (int)_revs.size();
         _revs.resize(0);
         _changed = true;
@@ -467,6 +556,7 @@ namespace litecore {
     }
 
     void RevTree::dump(std::ostream& out) {
+        loadHistory();
         int i = 0;
         for (Rev *rev : _revs) {
             out << "\t" << (++i) << ": ";
@@ -89,19 +89,29 @@ namespace litecore {
 
         void decode(slice raw_tree, sequence_t seq);
 
+        /** Decodes only the current revision; the rest of the tree is left for readHistory()
+            to load on demand. */
+        void decodeCurrentRevision(slice raw_tree, sequence_t seq);
+
         alloc_slice encode();
 
-        size_t size() const                             {return _revs.size();}
+        size_t size() const                             {loadHistory(); return _revs.size();}
         const Rev* get(unsigned index) const;
         const Rev* get(revid) const;
         const Rev* operator[](unsigned index) const {return get(index);}
         const Rev* operator[](revid revID) const    {return get(revID);}
         const Rev* getBySequence(sequence_t) const;
 
-        const std::vector<Rev*>& allRevisions() const   {return _revs;}
+        const std::vector<Rev*>& allRevisions() const   {loadHistory(); return _revs;}
         const Rev* currentRevision();
         bool hasConflict() const;
 
+        /** False if only the current revision has been decoded so far. The other revisions are
+            loaded on demand by the accessors and mutators; pointers to the current revision
+            remain valid when that happens. */
+        bool historyLoaded() const                      {return _historyLoaded;}
+        void loadHistory() const;
+
         // Adds a new leaf revision, given the parent's revID
         const Rev* insert(revid,
                           slice body,
@@ -145,6 +155,16 @@ namespace litecore {
 #endif
 
     protected:
+        /** Subclasses that store the non-current revisions separately override this to load
+            them, by calling mergeHistory(). */
+        virtual void readHistory()                      { }
+        void mergeHistory(const alloc_slice &raw_tree, sequence_t seq);
+
+        /** Encodes just the current revision, without its ancestors. */
+        alloc_slice encodeCurrentRevision();
+        /** Encodes the whole tree except for the current revision's body. */
+        alloc_slice encodeHistory();
+
         virtual bool isBodyOfRevisionAvailable(const Rev* r NONNULL) const;
         virtual alloc_slice readBodyOfRevision(const Rev* r NONNULL) const;
 #if DEBUG
@@ -166,6 +186,7 @@ namespace litecore {
         std::deque<Rev> _revsStorage;               // Actual storage of the Rev objects
         bool _changed {false};
         bool _unknown {false};
+        bool _historyLoaded {true};
     };
 
 }
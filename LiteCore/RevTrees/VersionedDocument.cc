@@ -16,6 +16,8 @@
 #include "VersionedDocument.hh"
 #include "Record.hh"
 #include "KeyStore.hh"
+#include "DataFile.hh"
+#include "Logging.hh"
 #include "Error.hh"
 #include "varint.hh"
 #include <ostream>
@@ -23,6 +25,8 @@
 namespace litecore {
     using namespace fleece;
 
+    static const char* const kHistoryStoreSuffix = "_history";
+
     VersionedDocument::VersionedDocument(KeyStore& db, slice docID)
     :_db(db), _rec(docID)
     {
@@ -39,6 +43,7 @@ namespace litecore {
     :RevTree(other)
     ,_db(other._db)
     ,_rec(other._rec)
+    ,_hasStoredHistory(other._hasStoredHistory)
     { }
 
     void VersionedDocument::read() {
@@ -48,8 +53,14 @@ namespace litecore {
 
     void VersionedDocument::decode() {
         _unknown = false;
+        _hasStoredHistory = (_rec.flags() & DocumentFlags::kHasHistory);
         if (_rec.body().buf) {
-            RevTree::decode(_rec.body(), _rec.sequence());
+            // Most readers only want the current revision, so decode just that for now.
+            // Records saved before history was split out contain the entire tree, and lack the
+            // flag; they'll be rewritten in the new form the next time they're saved.
+            RevTree::decodeCurrentRevision(_rec.body(), _rec.sequence());
+            if (_hasStoredHistory)
+                _historyLoaded = false;
             // The kSynced flag is set when the document's current revision is pushed to a server.
             // This is done instead of updating the doc body, for reasons of speed. So when loading
             // the document, detect that flag and belatedly update the current revision's flags.
@@ -62,6 +73,30 @@ namespace litecore {
         }
     }
 
+    KeyStore& VersionedDocument::historyStore(KeyStore &store) {
+        auto capabilities = store.capabilities();
+        capabilities.sequences = false;
+        return store.dataFile().getKeyStore(store.name() + kHistoryStoreSuffix, capabilities);
+    }
+
+    void VersionedDocument::purgeHistory(KeyStore &store, slice docID, Transaction &t) {
+        historyStore(store).del(docID, t);
+    }
+
+    void VersionedDocument::readHistory() {
+        if (!_hasStoredHistory) {
+            // The rest of the tree is in the record body itself:
+            mergeHistory(_rec.body(), _rec.sequence());
+            return;
+        }
+        Record history = historyStore(_db).get(_rec.key());
+        if (!history.exists()) {
+            Warn("VersionedDocument: history of '%.*s' is missing", SPLAT(_rec.key()));
+            return;
+        }
+        mergeHistory(history.body(), _rec.sequence());
+    }
+
     void VersionedDocument::updateMeta() {
         _rec.setFlags(DocumentFlags::kNone);
         const Rev* curRevision = currentRevision();
@@ -88,22 +123,39 @@ namespace litecore {
     bool VersionedDocument::save(Transaction& transaction) {
         if (!_changed)
             return true;
+        loadHistory();
         updateMeta();
         sequence_t seq = _rec.sequence();
         if (currentRevision()) {
             removeNonLeafBodies();
+            // The record gets only the current revision; the rest of the tree goes to the
+            // history store, so that reading the current revision doesn't drag it along.
+            bool splitHistory = (size() > 1);
+            if (splitHistory)
+                _rec.setFlag(DocumentFlags::kHasHistory);
             // Don't call _rec.setBody() because it'll invalidate all the pointers from Revisions
             // into the existing body buffer.
-            seq = _db.set(_rec.key(), _rec.version(), encode(), _rec.flags(),
-                          transaction, &seq);
+            seq = _db.set(_rec.key(), _rec.version(),
+                          (splitHistory ? encodeCurrentRevision() : encode()),
+                          _rec.flags(), transaction, &seq);
             if (!seq)
                 return false;               // Conflict
+            if (splitHistory)
+                historyStore(_db).set(_rec.key(), _rec.version(), encodeHistory(),
+                                      DocumentFlags::kNone, transaction);
+            else if (_hasStoredHistory)
+                historyStore(_db).del(_rec.key(), transaction);
+            _hasStoredHistory = splitHistory;
             _rec.updateSequence(seq);
             _rec.setExists();
             saved(seq);
         } else {
             if (seq && !_db.del(_rec.key(), transaction, seq))
                 return false;
+            if (_hasStoredHistory) {
+                historyStore(_db).del(_rec.key(), transaction);
+                _hasStoredHistory = false;
+            }
         }
         _changed = false;
         return true;
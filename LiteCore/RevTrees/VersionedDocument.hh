@@ -21,7 +21,10 @@ namespace litecore {
     class KeyStore;
     class Transaction;
 
-    /** Manages storage of a serialized RevTree in a Record. */
+    /** Manages storage of a serialized RevTree in a Record.
+        The record itself holds only the current revision once the document has any history;
+        the rest of the tree, minus the current body, is stored under the same key in a separate
+        KeyStore (see historyStore()) and is only read when some other revision is accessed. */
     class VersionedDocument : public RevTree {
     public:
 
@@ -42,6 +45,7 @@ namespace litecore {
         bool isDeleted() const      {return (flags() & DocumentFlags::kDeleted) != 0;}
         bool isConflicted() const   {return (flags() & DocumentFlags::kConflicted) != 0;}
         bool hasAttachments() const {return (flags() & DocumentFlags::kHasAttachments) != 0;}
+        bool hasStoredHistory() const {return _hasStoredHistory;}
 
         bool exists() const         {return _rec.exists();}
         sequence_t sequence() const {return _rec.sequence();}
@@ -53,6 +57,12 @@ namespace litecore {
 
         void updateMeta();
 
+        /** The KeyStore holding the revision histories of the documents in `store`. */
+        static KeyStore& historyStore(KeyStore &store);
+
+        /** Deletes a document's stored history; call this after purging the document itself. */
+        static void purgeHistory(KeyStore &store, slice docID, Transaction&);
+
 #if DEBUG
         void dump()          {RevTree::dump();}
 #endif
@@ -60,11 +70,13 @@ namespace litecore {
 #if DEBUG
         virtual void dump(std::ostream&) override;
 #endif
+        virtual void readHistory() override;
 
     private:
         void decode();
 
         KeyStore&       _db;
         Record          _rec;
+        bool            _hasStoredHistory {false};  // Is there a record in historyStore()?
     };
 }
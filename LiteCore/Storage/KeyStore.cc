@@ -44,6 +44,14 @@ namespace litecore {
         fn(get(seq, options));
     }
 
+    vector<Record> KeyStore::getMany(const vector<slice> &keys, ContentOptions options) const {
+        vector<Record> recs;
+        recs.reserve(keys.size());
+        for (slice key : keys)
+            recs.push_back(get(key, options));
+        return recs;
+    }
+
     void KeyStore::readBody(Record &rec) const {
         if (!rec.body()) {
             Record fullDoc = rec.sequence() ? get(rec.sequence(), kDefaultContent)
@@ -80,6 +88,15 @@ namespace litecore {
         error::_throw(error::Unimplemented);
     }
 
+    unique_ptr<KeyStore::IndexBuilder> KeyStore::beginIndexBuild(slice name, slice expressionJSON,
+                                                                 IndexType, const IndexOptions*) {
+        error::_throw(error::Unimplemented);
+    }
+
+    void KeyStore::materializeProperty(slice propertyPath) {
+        error::_throw(error::Unimplemented);
+    }
+
     Retained<Query> KeyStore::compileQuery(slice expressionJSON) {
         error::_throw(error::Unimplemented);
     }
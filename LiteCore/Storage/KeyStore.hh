@@ -11,6 +11,9 @@
 #include "RefCounted.hh"
 #include "RecordEnumerator.hh"
 #include "function_ref.hh"
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace litecore {
 
@@ -34,6 +37,7 @@ namespace litecore {
 
         struct Capabilities {
             bool sequences      :1;     ///< Records have sequences & can be enumerated by sequence
+            bool compressBodies :1;     ///< Large record bodies are stored compressed
 
             static const Capabilities defaults;
         };
@@ -63,13 +67,29 @@ namespace litecore {
         /** Reads a record whose key() is already set. */
         virtual bool read(Record &rec, ContentOptions options = kDefaultContent) const =0;
 
+        /** Looks up multiple records at once. The result has one Record per key, in the same
+            order; a Record whose key wasn't found has exists() false. Subclasses can override
+            this to batch the lookups instead of reading each key separately. */
+        virtual std::vector<Record> getMany(const std::vector<slice> &keys,
+                                            ContentOptions = kDefaultContent) const;
+
         /** Reads the body of a Record that's already been read with kMetaonly.
             Does nothing if the record's body is non-null. */
         virtual void readBody(Record &rec) const;
 
-        /** Creates a database query object. */
+        /** Creates a database query object. Implementations may return a cached instance
+            that was compiled earlier from the identical expression. */
         virtual Retained<Query> compileQuery(slice expr);
 
+        struct QueryCacheStats {
+            uint64_t hits;          ///< Number of compileQuery calls answered from the cache
+            uint64_t misses;        ///< Number of compileQuery calls that compiled a new query
+        };
+
+        /** Sets the maximum number of compiled queries to keep cached; 0 disables caching. */
+        virtual void setQueryCacheSize(size_t)                          { }
+        virtual QueryCacheStats queryCacheStats() const                 {return {0, 0};}
+
         //////// Writing:
 
         /** Core write method. If replacingSequence is not null, will only update the
@@ -98,12 +118,15 @@ namespace litecore {
         enum IndexType {
             kValueIndex,         ///< Regular index of property value
             kFullTextIndex,      ///< Full-text index
-            kGeoIndex,           ///< Geo index of GeoJSON values
+            kGeoIndex,           ///< Geo (R-tree) index of numeric coordinates
+            kArrayIndex,         ///< Index of the elements of an array property
         };
 
         struct IndexOptions {
             const char *stemmer;
             bool ignoreDiacritics;
+            bool deferred;          ///< Full-text: saves only queue records for indexing
+            const char *prefixLengths;  ///< Full-text: term prefix lengths to index, e.g. "1,2,3"
         };
 
         virtual bool supportsIndexes(IndexType) const                   {return false;}
@@ -114,6 +137,39 @@ namespace litecore {
         virtual void deleteIndex(slice name);
         virtual alloc_slice getIndexes() const;
 
+        /** Indexes up to `maxRecords` of the records queued by each deferred full-text index.
+            Returns true if no records are left in the queues. */
+        virtual bool updateDeferredIndexes(unsigned maxRecords)         {return true;}
+
+        /** Builds an index incrementally, a batch of records at a time, so that writers are only
+            blocked for the duration of a batch. The index isn't used by queries until it's done.
+            Deleting the builder before it's done cancels the build. */
+        class IndexBuilder {
+        public:
+            virtual ~IndexBuilder()                                     { }
+
+            /** Indexes up to `maxRecords` more records. Returns true once the index is complete. */
+            virtual bool step(unsigned maxRecords) =0;
+
+            /** The approximate fraction of the records indexed so far, from 0.0 to 1.0. */
+            virtual float progress() const =0;
+        };
+
+        virtual std::unique_ptr<IndexBuilder> beginIndexBuild(slice name,
+                                                              slice expressionJSON,
+                                                              IndexType =kValueIndex,
+                                                              const IndexOptions* = nullptr);
+
+        //////// MATERIALIZED PROPERTIES:
+
+        /** Stores a document property in a column of its own, kept up to date on every write, so
+            queries can read it without decoding the record body. The path has the same form as
+            in a query's property expression, e.g. "name.first". This can't be undone. */
+        virtual void materializeProperty(slice propertyPath);
+
+        /** The paths of the properties that have been materialized. */
+        virtual std::vector<std::string> materializedProperties() const {return {};}
+
         // public for complicated reasons; clients should never call it
         virtual ~KeyStore()                             { }
 
@@ -18,13 +18,15 @@
 
 namespace litecore {
 
-    /** Flags used by Document, stored in a Record. Matches C4DocumentFlags. */
+    /** Flags used by Document, stored in a Record. Matches C4DocumentFlags, except for
+        kHasHistory, which is a storage detail that mustn't be exposed (see publicFlags.) */
     enum class DocumentFlags : uint8_t {
         kNone           = 0x00,
         kDeleted        = 0x01, ///< Document's current revision is deleted (a tombstone)
         kConflicted     = 0x02, ///< Document is in conflict (multiple leaf revisions)
         kHasAttachments = 0x04, ///< Document has one or more revisions with attachments/blobs
         kSynced         = 0x08, ///< Document's current revision has been pushed to server
+        kHasHistory     = 0x10, ///< Document's older revisions are stored in a separate KeyStore
     };
 
     static inline bool operator& (DocumentFlags a, DocumentFlags b) {
@@ -35,6 +37,11 @@ namespace litecore {
         return (DocumentFlags)((uint8_t)a | (uint8_t)b);
     }
 
+    /** Returns the flags without the internal ones, for conversion to C4DocumentFlags. */
+    static inline DocumentFlags publicFlags(DocumentFlags flags) {
+        return (DocumentFlags)((uint8_t)flags & ~(uint8_t)DocumentFlags::kHasHistory);
+    }
+
     /** The unit of storage in a DataFile: a key, version and body (all opaque blobs);
         and some extra metadata like flags and a sequence number. */
     class Record {
@@ -0,0 +1,56 @@
+//
+//  RecordCompression.cc
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#include "RecordCompression.hh"
+#include "Error.hh"
+#include "snappy.h"
+#include <vector>
+
+using namespace std;
+
+namespace litecore {
+
+    alloc_slice compressBody(slice body) {
+        if (body.size < kMinCompressedBodySize || isCompressedBody(body))
+            return alloc_slice();
+        vector<char> buffer(1 + snappy::MaxCompressedLength(body.size));
+        buffer[0] = (char)kCompressedBodyMarker;
+        size_t compressedSize;
+        snappy::RawCompress((const char*)body.buf, body.size, &buffer[1], &compressedSize);
+        // Not worth it unless it saves at least 1/8 of the size:
+        if (1 + compressedSize > body.size - body.size / 8)
+            return alloc_slice();
+        return alloc_slice(buffer.data(), 1 + compressedSize);
+    }
+
+
+    alloc_slice decompressBody(slice compressed) {
+        if (!isCompressedBody(compressed))
+            error::_throw(error::CorruptData, "Record body is not compressed");
+        auto data = (const char*)compressed.buf + 1;
+        size_t dataSize = compressed.size - 1;
+        size_t size;
+        if (!snappy::GetUncompressedLength(data, dataSize, &size))
+            error::_throw(error::CorruptData, "Invalid compressed record body");
+        alloc_slice body(size);
+        if (!snappy::RawUncompress(data, dataSize, (char*)body.buf))
+            error::_throw(error::CorruptData, "Invalid compressed record body");
+        return body;
+    }
+
+
+    size_t uncompressedBodySize(slice compressedHeader) {
+        // Snappy's data starts with the uncompressed length as a varint of up to 5 bytes:
+        size_t size;
+        if (!isCompressedBody(compressedHeader)
+                || !snappy::GetUncompressedLength((const char*)compressedHeader.buf + 1,
+                                                  compressedHeader.size - 1, &size))
+            error::_throw(error::CorruptData, "Invalid compressed record body");
+        return size;
+    }
+
+}
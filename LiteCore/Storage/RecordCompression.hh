@@ -0,0 +1,38 @@
+//
+//  RecordCompression.hh
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include "Base.hh"
+
+namespace litecore {
+
+    /** Record bodies smaller than this are never compressed. */
+    static constexpr size_t kMinCompressedBodySize = 256;
+
+    /** First byte of a compressed body. No RevTree or Fleece body can start with this byte, so
+        code that only sees the body (like the SQL functions) can recognize compressed ones. */
+    static constexpr uint8_t kCompressedBodyMarker = 0xFF;
+
+    static inline bool isCompressedBody(slice body) {
+        return body.size > 0 && body[0] == kCompressedBodyMarker;
+    }
+
+    /** Compresses a record body with Snappy. Returns a null slice if the body is too small, or
+        doesn't shrink enough to be worth decompressing later. */
+    alloc_slice compressBody(slice body);
+
+    /** Decompresses a body returned by compressBody. Throws CorruptData if it's invalid. */
+    alloc_slice decompressBody(slice compressed);
+
+    /** The number of bytes at the start of a compressed body that give its uncompressed size. */
+    static constexpr size_t kCompressedBodyHeaderSize = 6;
+
+    /** Returns the size a compressed body will have when decompressed, given at least its first
+        kCompressedBodyHeaderSize bytes. Throws CorruptData if it's invalid. */
+    size_t uncompressedBodySize(slice compressedHeader);
+
+}
@@ -61,6 +61,12 @@ namespace litecore {
     // SQLite cache size (per connection)
     static const size_t kCacheSize = 10 * MB;
 
+    // SQLite cache size of each pooled read-only connection
+    static const size_t kReadCacheSize = 2 * MB;
+
+    // Maximum number of idle read-only connections kept in the pool
+    static const size_t kMaxIdleReadConnections = 4;
+
     // Maximum size WAL journal will be left at after a commit
     static const int64_t kJournalSize = 5 * MB;
 
@@ -105,6 +111,19 @@ namespace litecore {
     }
 
 
+    // Registers collators, custom functions, and the FTS tokenizer on a connection:
+    static void registerExtensions(sqlite3 *sqlite,
+                                   CollationContextVector &collationContexts,
+                                   const DataFile &dataFile)
+    {
+        RegisterSQLiteUnicodeCollations(sqlite, collationContexts);
+        RegisterSQLiteFunctions(sqlite, dataFile.fleeceAccessor(), dataFile.documentKeys());
+        int rc = register_unicodesn_tokenizer(sqlite);
+        if (rc != SQLITE_OK)
+            Warn("Unable to register FTS tokenizer: SQLite err %d", rc);
+    }
+
+
     UsingStatement::UsingStatement(SQLite::Statement &stmt) noexcept
     :_stmt(stmt)
     {
@@ -179,6 +198,12 @@ path.path().c_str());
 
 
     SQLiteDataFile::~SQLiteDataFile() {
+        // A leased read connection's deleter, and its SQL functions, refer to this object, so
+        // a lease outliving it would be a use-after-free:
+        {
+            lock_guard<mutex> lock(_readPoolMutex);
+            Assert(_readLeases == 0, "SQLiteDataFile destroyed while read connections are leased");
+        }
         close();
     }
 
@@ -192,7 +217,7 @@ path.path().c_str());
                                                sqlFlags,
                                                kBusyTimeoutSecs * 1000);
 
-        if (!decrypt())
+        if (!decrypt(*_sqlDb))
             error::_throw(error::UnsupportedEncryption);
 
         if (sqlite3_libversion_number() < 003012) {
@@ -249,12 +274,7 @@ path.path().c_str());
         if (maxThreads > 0)
             sqlite3_limit(sqlite, SQLITE_LIMIT_WORKER_THREADS, maxThreads);
 
-        // Register collators, custom functions, and the FTS tokenizer:
-        RegisterSQLiteUnicodeCollations(sqlite, _collationContexts);
-        RegisterSQLiteFunctions(sqlite, fleeceAccessor(), documentKeys());
-        int rc = register_unicodesn_tokenizer(sqlite);
-        if (rc != SQLITE_OK)
-            Warn("Unable to register FTS tokenizer: SQLite err %d", rc);
+        registerExtensions(sqlite, _collationContexts, *this);
     }
 
 
@@ -264,9 +284,11 @@ path.path().c_str());
 
 
     void SQLiteDataFile::close() {
+        closeReadConnections();
         DataFile::close(); // closes all the KeyStores
         _getLastSeqStmt.reset();
         _setLastSeqStmt.reset();
+        _schemaVersionStmt.reset();
         if (_sqlDb) {
             optimizeAndVacuum();
             _sqlDb.reset();
@@ -275,7 +297,7 @@ path.path().c_str());
     }
 
 
-    bool SQLiteDataFile::decrypt() {
+    bool SQLiteDataFile::decrypt(SQLite::Database &sqlDb) {
         auto alg = options().encryptionAlgorithm;
         if (alg != kNoEncryption) {
             if (!factory().encryptionEnabled(alg))
@@ -285,15 +307,110 @@ path.path().c_str());
             slice key = options().encryptionKey;
             if(key.buf == nullptr || key.size != 32)
                 error::_throw(error::InvalidParameter);
-            _exec(string("PRAGMA key = \"x'") + key.hexString() + "'\"");
+            sqlDb.exec(string("PRAGMA key = \"x'") + key.hexString() + "'\"");
         }
 
         // Verify that encryption key is correct (or db is unencrypted, if no key given):
-        _exec("SELECT count(*) FROM sqlite_master");
+        sqlDb.exec("SELECT count(*) FROM sqlite_master");
         return true;
     }
 
 
+#pragma mark - READ CONNECTION POOL:
+
+
+    SQLiteReadConnection::SQLiteReadConnection(SQLiteDataFile &dataFile) {
+        _sqlDb = make_unique<SQLite::Database>(dataFile.filePath().path().c_str(),
+                                               SQLite::OPEN_READONLY,
+                                               kBusyTimeoutSecs * 1000);
+        if (!dataFile.decrypt(*_sqlDb))
+            error::_throw(error::UnsupportedEncryption);
+        _sqlDb->exec(format("PRAGMA cache_size=%d; "
+                            "PRAGMA mmap_size=%d",
+                            -(int)kReadCacheSize/1024, kMMapSize));
+        registerExtensions(_sqlDb->getHandle(), _collationContexts, dataFile);
+        LogVerbose(SQL, "Opened read-only connection to %s", dataFile.filePath().path().c_str());
+    }
+
+
+    SQLiteReadConnection::~SQLiteReadConnection() {
+        _statements.clear();        // Statements have to be freed before the database is closed
+        _sqlDb.reset();
+    }
+
+
+    shared_ptr<SQLite::Statement> SQLiteReadConnection::compile(const string &sql) {
+        auto &stmt = _statements[sql];
+        if (!stmt) {
+            try {
+                stmt = make_shared<SQLite::Statement>(*_sqlDb, sql);
+            } catch (const SQLite::Exception &x) {
+                _statements.erase(sql);
+                Warn("SQLite error compiling statement \"%s\": %s", sql.c_str(), x.what());
+                throw;
+            }
+        }
+        return stmt;
+    }
+
+
+    SQLiteReadConnection::Transaction::Transaction(SQLiteReadConnection &conn)
+    :_conn(conn)
+    {
+        _conn.db().exec("BEGIN");
+    }
+
+
+    SQLiteReadConnection::Transaction::~Transaction() {
+        try {
+            _conn.db().exec("COMMIT");
+        } catch (const SQLite::Exception &x) {
+            Warn("Caught SQLite exception ending read transaction: %s", x.what());
+        }
+    }
+
+
+    SQLiteDataFile::ReadConnectionRef SQLiteDataFile::readConnection() const {
+        checkOpen();
+        if (inTransaction())
+            return nullptr;
+        unique_ptr<SQLiteReadConnection> conn;
+        unsigned generation;
+        {
+            lock_guard<mutex> lock(_readPoolMutex);
+            generation = _readPoolGeneration;
+            if (!_idleReadConnections.empty()) {
+                conn = move(_idleReadConnections.back());
+                _idleReadConnections.pop_back();
+            }
+        }
+        if (!conn)
+            conn.reset(new SQLiteReadConnection(const_cast<SQLiteDataFile&>(*this)));
+        {
+            lock_guard<mutex> lock(_readPoolMutex);
+            ++_readLeases;
+        }
+
+        // The deleter puts the connection back in the pool, unless the pool has been closed
+        // in the meantime or is already full:
+        return ReadConnectionRef(conn.release(), [this,generation](SQLiteReadConnection *c) {
+            unique_ptr<SQLiteReadConnection> returned(c);
+            lock_guard<mutex> lock(_readPoolMutex);
+            --_readLeases;
+            if (generation == _readPoolGeneration
+                    && _idleReadConnections.size() < kMaxIdleReadConnections)
+                _idleReadConnections.push_back(move(returned));
+        });
+    }
+
+
+    void SQLiteDataFile::closeReadConnections() {
+        lock_guard<mutex> lock(_readPoolMutex);
+        _idleReadConnections.clear();
+        ++_readPoolGeneration;
+    }
+
+
     void SQLiteDataFile::rekey(EncryptionAlgorithm alg, slice newKey) {
         bool currentlyEncrypted = (options().encryptionAlgorithm != kNoEncryption);
         switch (alg) {
@@ -476,16 +593,43 @@ path.path().c_str());
     }
 
     
-    sequence_t SQLiteDataFile::lastSequence(const string& keyStoreName) const {
+    sequence_t SQLiteDataFile::lastSequence(const string& keyStoreName,
+                                            SQLiteReadConnection *conn) const
+    {
+        static const char* const kSQL = "SELECT lastSeq FROM kvmeta WHERE name=?";
+        ReadConnectionRef pooled;
+        if (!conn && (pooled = readConnection()))
+            conn = pooled.get();
+        auto &stmt = conn ? *conn->compile(kSQL) : compile(_getLastSeqStmt, kSQL);
         sequence_t seq = 0;
-        compile(_getLastSeqStmt, "SELECT lastSeq FROM kvmeta WHERE name=?");
-        UsingStatement u(_getLastSeqStmt);
-        _getLastSeqStmt->bindNoCopy(1, keyStoreName);
-        if (_getLastSeqStmt->executeStep())
-            seq = (int64_t)_getLastSeqStmt->getColumn(0);
+        UsingStatement u(stmt);
+        stmt.bindNoCopy(1, keyStoreName);
+        if (stmt.executeStep())
+            seq = (int64_t)stmt.getColumn(0);
         return seq;
     }
 
+    // The schema can only have changed if the file has, so PRAGMA schema_version is only read
+    // again when the pager's data version has changed. (SQLite updates that at the start of each
+    // transaction, so this doesn't see another connection's change until this one reads; pass
+    // `reread` to read it now.)
+    int64_t SQLiteDataFile::schemaVersion(bool reread) {
+#if SQLITE_VERSION_NUMBER >= 3026000
+        unsigned dataVersion = 0;
+        int rc = sqlite3_file_control(_sqlDb->getHandle(), "main",
+                                      SQLITE_FCNTL_DATA_VERSION, &dataVersion);
+        if (rc == SQLITE_OK && !reread && _schemaVersion >= 0 && dataVersion == _dataVersion)
+            return _schemaVersion;
+        _dataVersion = dataVersion;
+#endif
+        compile(_schemaVersionStmt, "PRAGMA schema_version");
+        UsingStatement u(_schemaVersionStmt);
+        _schemaVersion = _schemaVersionStmt->executeStep() ? (int64_t)_schemaVersionStmt->getColumn(0)
+                                                           : 0;
+        return _schemaVersion;
+    }
+
+
     void SQLiteDataFile::setLastSequence(SQLiteKeyStore &store, sequence_t seq) {
         compile(_setLastSeqStmt,
                 "INSERT OR REPLACE INTO kvmeta (name, lastSeq) VALUES (?, ?)");
@@ -10,6 +10,10 @@
 
 #include "DataFile.hh"
 #include "UnicodeCollator.hh"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace SQLite {
     class Database;
@@ -21,6 +25,36 @@ namespace SQLite {
 namespace litecore {
 
     class SQLiteKeyStore;
+    class SQLiteDataFile;
+
+
+    /** A read-only connection to a SQLiteDataFile's database file, leased from the data file's
+        pool by SQLiteDataFile::readConnection(). Statements compiled on it are cached by SQL. */
+    class SQLiteReadConnection {
+    public:
+        explicit SQLiteReadConnection(SQLiteDataFile&);
+        ~SQLiteReadConnection();
+
+        SQLite::Database& db()                                  {return *_sqlDb;}
+
+        /** Returns a compiled statement, reusing the cached one if this SQL was seen before. */
+        std::shared_ptr<SQLite::Statement> compile(const std::string &sql);
+
+        /** Holds a read transaction open on the connection while in scope, so that multiple
+            statements see the same snapshot of the database. */
+        class Transaction {
+        public:
+            explicit Transaction(SQLiteReadConnection&);
+            ~Transaction();
+        private:
+            SQLiteReadConnection &_conn;
+        };
+
+    private:
+        CollationContextVector _collationContexts;
+        std::unique_ptr<SQLite::Database> _sqlDb;
+        std::unordered_map<std::string, std::shared_ptr<SQLite::Statement>> _statements;
+    };
 
 
     /** SQLite implementation of Database. */
@@ -45,6 +79,16 @@ namespace litecore {
 
         fleece::alloc_slice rawQuery(const std::string &query) override;
 
+        using ReadConnectionRef = std::shared_ptr<SQLiteReadConnection>;
+
+        /** Leases a read-only connection from the pool, opening a new one if none are idle, so
+            that reads on different threads don't contend for the main connection. Returns null
+            if a transaction is open on this handle, since reads then have to see its uncommitted
+            changes and so must use the main connection. The connection is returned to the pool
+            when the last reference to it is released, which must happen before this
+            SQLiteDataFile is destroyed. */
+        ReadConnectionRef readConnection() const;
+
         class Factory : public DataFile::Factory {
         public:
             Factory();
@@ -69,7 +113,8 @@ namespace litecore {
         void deleteKeyStore(const std::string &name) override;
 #endif
 
-        sequence_t lastSequence(const std::string& keyStoreName) const;
+        sequence_t lastSequence(const std::string& keyStoreName,
+                                SQLiteReadConnection* =nullptr) const;
         void setLastSequence(SQLiteKeyStore&, sequence_t);
 
         SQLite::Statement& compile(const std::unique_ptr<SQLite::Statement>& ref,
@@ -77,17 +122,33 @@ namespace litecore {
         int exec(const std::string &sql, LogLevel =LogLevel::Verbose);
         int execWithLock(const std::string &sql);
         int64_t intQuery(const char *query);
+
+        /** The file's current PRAGMA schema_version, which changes whenever any connection
+            alters the schema. Cheap to call when nothing has changed, unless `reread` is true. */
+        int64_t schemaVersion(bool reread =false);
         void optimizeAndVacuum();
 
     private:
         friend class SQLiteKeyStore;
+        friend class SQLiteReadConnection;
+        friend class SQLiteQuery;
 
-        bool decrypt();
+        bool decrypt(SQLite::Database&);
         int _exec(const std::string &sql, LogLevel =LogLevel::Verbose);
+        void closeReadConnections();
 
         std::unique_ptr<SQLite::Database>    _sqlDb;         // SQLite database object
         std::unique_ptr<SQLite::Statement>   _getLastSeqStmt, _setLastSeqStmt;
+        std::unique_ptr<SQLite::Statement>   _schemaVersionStmt;
+        int64_t _schemaVersion {-1};                        // Last value read by schemaVersion()
+        unsigned _dataVersion {0};                          // SQLITE_FCNTL_DATA_VERSION at the time
         CollationContextVector _collationContexts;
+
+        // Pool of idle read-only connections:
+        mutable std::mutex _readPoolMutex;
+        mutable std::vector<std::unique_ptr<SQLiteReadConnection>> _idleReadConnections;
+        mutable unsigned _readPoolGeneration {0};   // Incremented when the pool is closed
+        mutable unsigned _readLeases {0};           // Connections currently leased out
     };
 
 }
@@ -25,8 +25,10 @@ namespace litecore {
 
    class SQLiteEnumerator : public RecordEnumerator::Impl {
     public:
-        SQLiteEnumerator(SQLite::Statement *stmt, bool descending, ContentOptions content)
-        :_stmt(stmt),
+        SQLiteEnumerator(SQLiteDataFile::ReadConnectionRef conn,
+                         SQLite::Statement *stmt, bool descending, ContentOptions content)
+        :_conn(conn),
+         _stmt(stmt),
          _content(content)
         {
             LogVerbose(SQL, "Enumerator: %s", _stmt->getQuery().c_str());
@@ -45,6 +47,7 @@ namespace litecore {
         }
 
     private:
+        SQLiteDataFile::ReadConnectionRef _conn;   // Pooled connection, if any (outlives _stmt)
         unique_ptr<SQLite::Statement> _stmt;
         ContentOptions _content;
     };
@@ -53,7 +56,7 @@ namespace litecore {
     void SQLiteKeyStore::selectFrom(stringstream& in, RecordEnumerator::Options options) {
         in << "SELECT sequence, flags, key, version";
         if (options.contentOptions & kMetaOnly)
-            in << ", length(body)";
+            in << ", " << kBodySizeSQL;
         else
             in << ", body";
         in << " FROM kv_" << name();
@@ -93,10 +96,13 @@ namespace litecore {
         sql << (bySequence ? " ORDER BY sequence" : " ORDER BY key");
         writeSQLOptions(sql, options);
 
-        auto stmt = new SQLite::Statement(db(), sql.str());        // TODO: Cache a statement
+        // Outside a transaction, scan on a pooled read connection held by the enumerator:
+        auto conn = db().readConnection();
+        auto stmt = conn ? new SQLite::Statement(conn->db(), sql.str())
+                         : new SQLite::Statement(db(), sql.str());  // TODO: Cache a statement
         if (bySequence)
             stmt->bind(1, (long long)since);
-        return new SQLiteEnumerator(stmt, options.descending, options.contentOptions);
+        return new SQLiteEnumerator(conn, stmt, options.descending, options.contentOptions);
     }
 
 }
@@ -11,12 +11,19 @@
 #include "SQLite_Internal.hh"
 #include "QueryParser.hh"
 #include "Record.hh"
+#include "RecordCompression.hh"
 #include "RecordEnumerator.hh"
 #include "Error.hh"
 #include "StringUtil.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include "Fleece.hh"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
 #include <sstream>
+#include <tuple>
+#include <unordered_map>
 #include <iostream>
 
 extern "C" {
@@ -73,17 +80,51 @@ namespace litecore {
                           "  version BLOB,"
                           "  body BLOB)"));
         }
+        checkSchema();
+    }
+
+
+    // Another connection to the same file (e.g. one opened by c4db_openAgain) may have changed
+    // the schema since this one last looked, by materializing a property or creating or
+    // deleting an index. Anything derived from the schema has to be recomputed when it has.
+    void SQLiteKeyStore::checkSchema(bool reread) {
+        int64_t schemaVersion = db().schemaVersion(reread);
+        if (schemaVersion == _schemaVersion)
+            return;
+        if (_schemaVersion >= 0)
+            LogVerbose(DBLog, "KeyStore(%s) schema changed; reloading", name().c_str());
+        _schemaVersion = schemaVersion;
+
+        // Look for columns added by materializeProperty:
+        vector<string> properties;
+        SQLite::Statement columns(db(), "PRAGMA table_info(" + tableName() + ")");
+        while (columns.executeStep()) {
+            string column = columns.getColumn(1).getString();
+            if (hasPrefix(column, "prop:"))
+                properties.push_back(column.substr(5));
+        }
+        if (properties != _materializedProperties) {
+            // The statements written by set() have to be recompiled with the new columns:
+            _setStmt.reset();
+            _insertStmt.reset();
+            _replaceStmt.reset();
+            _materializedProperties = properties;
+        }
+        invalidateQueryCache();
     }
 
 
     void SQLiteKeyStore::close() {
         // If statements are left open, closing the database will fail with a "db busy" error...
+        invalidateQueryCache();
         _recCountStmt.reset();
         _getByKeyStmt.reset();
         _getMetaByKeyStmt.reset();
         _getBySeqStmt.reset();
         _getByOffStmt.reset();
         _getMetaBySeqStmt.reset();
+        _getManyStmt.reset();
+        _getManyMetaStmt.reset();
         _setStmt.reset();
         _insertStmt.reset();
         _replaceStmt.reset();
@@ -127,6 +168,18 @@ namespace litecore {
     }
 
 
+    // Returns a statement to read with: if a pooled read connection is given, the statement is
+    // compiled (and cached) on it; otherwise it's the main connection's statement cached in `ref`.
+    SQLite::Statement& SQLiteKeyStore::compileRead(SQLiteReadConnection *conn,
+                                                   const unique_ptr<SQLite::Statement>& ref,
+                                                   const char *sqlTemplate) const
+    {
+        if (conn)
+            return *conn->compile(subst(sqlTemplate));
+        return compile(ref, sqlTemplate);
+    }
+
+
     uint64_t SQLiteKeyStore::recordCount() const {
         if (!_recCountStmt) {
             stringstream sql;
@@ -167,6 +220,7 @@ namespace litecore {
             _lastSequenceChanged = false;
         }
         _lastSequence = -1;
+        _schemaCheckedInTransaction = false;
     }
 
 
@@ -180,26 +234,41 @@ namespace litecore {
     // alloc_slice (not just slice).
 
 
-    // Gets flags from col 1, version from col 3, and body (or its length) from col 4
+    // The length of an uncompressed body, or the start of a compressed one, which holds the
+    // length it decompresses to; a meta-only read reports the latter, like a full read would:
+    const string SQLiteKeyStore::kBodySizeSQL =
+        "CASE WHEN flags & " + to_string(kCompressedBodyFlag) + " THEN substr(body, 1, "
+        + to_string(kCompressedBodyHeaderSize) + ") ELSE length(body) END";
+
+
+    // Gets flags from col 1, version from col 3, and body (or kBodySizeSQL) from col 4
     /*static*/ void SQLiteKeyStore::setRecordMetaAndBody(Record &rec,
                                                          SQLite::Statement &stmt,
                                                          ContentOptions options)
     {
+        int flags = (int)stmt.getColumn(1);
         rec.setExists();
-        rec.setFlags((DocumentFlags)(int)stmt.getColumn(1));
+        rec.setFlags((DocumentFlags)(flags & ~kCompressedBodyFlag));
         rec.setVersion(columnAsSlice(stmt.getColumn(3)));
-        if (options & kMetaOnly)
-            rec.setUnloadedBodySize((ssize_t)stmt.getColumn(4));
+        if (options & kMetaOnly) {
+            if (flags & kCompressedBodyFlag)
+                rec.setUnloadedBodySize(uncompressedBodySize(columnAsSlice(stmt.getColumn(4))));
+            else
+                rec.setUnloadedBodySize((ssize_t)stmt.getColumn(4));
+        } else if (flags & kCompressedBodyFlag)
+            rec.setBody(decompressBody(columnAsSlice(stmt.getColumn(4))));
         else
             rec.setBody(columnAsSlice(stmt.getColumn(4)));
     }
     
 
     bool SQLiteKeyStore::read(Record &rec, ContentOptions options) const {
+        static const string kMetaSQL = "SELECT sequence, flags, 0, version, " + kBodySizeSQL
+                                       + " FROM kv_@ WHERE key=?";
+        auto conn = db().readConnection();
         auto &stmt = (options & kMetaOnly)
-            ? compile(_getMetaByKeyStmt,
-                      "SELECT sequence, flags, 0, version, length(body) FROM kv_@ WHERE key=?")
-            : compile(_getByKeyStmt,
+            ? compileRead(conn.get(), _getMetaByKeyStmt, kMetaSQL.c_str())
+            : compileRead(conn.get(), _getByKeyStmt,
                       "SELECT sequence, flags, 0, version, body FROM kv_@ WHERE key=?");
         stmt.bindNoCopy(1, (const char*)rec.key().buf, (int)rec.key().size);
         UsingStatement u(stmt);
@@ -213,14 +282,68 @@ namespace litecore {
     }
 
 
+    // Number of keys looked up by each statement in getMany(). Unused parameters stay NULL.
+    static const size_t kGetManyBatchSize = 64;
+
+    static string getManySQL(bool metaOnly) {
+        stringstream sql;
+        sql << "SELECT sequence, flags, key, version, " << (metaOnly ? kBodySizeSQL : "body")
+            << " FROM kv_@ WHERE key IN (?";
+        for (size_t i = 1; i < kGetManyBatchSize; ++i)
+            sql << ",?";
+        sql << ")";
+        return sql.str();
+    }
+
+
+    vector<Record> SQLiteKeyStore::getMany(const vector<slice> &keys,
+                                           ContentOptions options) const
+    {
+        vector<Record> recs;
+        recs.reserve(keys.size());
+        unordered_multimap<slice, size_t, fleece::sliceHash> indexOfKey;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            recs.emplace_back(keys[i]);
+            indexOfKey.emplace(keys[i], i);
+        }
+        if (keys.empty())
+            return recs;
+
+        bool metaOnly = (options & kMetaOnly) != 0;
+        static const string kSQL = getManySQL(false), kMetaSQL = getManySQL(true);
+        auto conn = db().readConnection();
+        auto &stmt = metaOnly ? compileRead(conn.get(), _getManyMetaStmt, kMetaSQL.c_str())
+                              : compileRead(conn.get(), _getManyStmt, kSQL.c_str());
+        for (size_t start = 0; start < keys.size(); start += kGetManyBatchSize) {
+            size_t end = min(start + kGetManyBatchSize, keys.size());
+            UsingStatement u(stmt);
+            stmt.clearBindings();
+            for (size_t i = start; i < end; ++i)
+                stmt.bindNoCopy((int)(i - start + 1), (const char*)keys[i].buf, (int)keys[i].size);
+            while (stmt.executeStep()) {
+                sequence_t seq = (int64_t)stmt.getColumn(0);
+                auto range = indexOfKey.equal_range(columnAsSlice(stmt.getColumn(2)));
+                for (auto it = range.first; it != range.second; ++it) {
+                    Record &rec = recs[it->second];
+                    rec.updateSequence(seq);
+                    setRecordMetaAndBody(rec, stmt, options);
+                }
+            }
+        }
+        return recs;
+    }
+
+
     Record SQLiteKeyStore::get(sequence_t seq, ContentOptions options) const {
         if (!_capabilities.sequences)
             error::_throw(error::NoSequences);
+        static const string kMetaSQL = "SELECT 0, flags, key, version, " + kBodySizeSQL
+                                       + " FROM kv_@ WHERE sequence=?";
         Record rec;
+        auto conn = db().readConnection();
         auto &stmt = (options & kMetaOnly)
-            ? compile(_getMetaBySeqStmt,
-                      "SELECT 0, flags, key, version, length(body) FROM kv_@ WHERE sequence=?")
-            : compile(_getBySeqStmt,
+            ? compileRead(conn.get(), _getMetaBySeqStmt, kMetaSQL.c_str())
+            : compileRead(conn.get(), _getBySeqStmt,
                       "SELECT 0, flags, key, version, body FROM kv_@ WHERE sequence=?");
         UsingStatement u(stmt);
         stmt.bind(1, (long long)seq);
@@ -233,36 +356,75 @@ namespace litecore {
     }
 
 
+    // Compiles one of the statements used by set(): an INSERT with the given verb, or an UPDATE
+    // if `insertVerb` is null. Materialized property columns get their values from the body
+    // (parameter 2), so they're always in sync with it. (See fl_materialize.)
+    SQLite::Statement& SQLiteKeyStore::compileSet(const unique_ptr<SQLite::Statement>& ref,
+                                                  const char *insertVerb) const
+    {
+        if (ref != nullptr) {
+            db().checkOpen();
+            return *ref.get();
+        }
+        stringstream sql;
+        if (insertVerb) {
+            stringstream values;
+            sql << insertVerb << " INTO " << tableName() << " (version, body, flags, sequence, key";
+            for (auto &property : _materializedProperties) {
+                sql << ", " << QueryParser::materializedColumnName(property);
+                values << ", fl_materialize(?2, ";
+                QueryParser::writeSQLString(values, slice(property));
+                values << ")";
+            }
+            sql << ") VALUES (?, ?, ?, ?, ?" << values.str() << ")";
+        } else {
+            sql << "UPDATE " << tableName() << " SET version=?, body=?, flags=?, sequence=?";
+            for (auto &property : _materializedProperties) {
+                sql << ", " << QueryParser::materializedColumnName(property) << "=fl_materialize(?2, ";
+                QueryParser::writeSQLString(sql, slice(property));
+                sql << ")";
+            }
+            sql << " WHERE key=? AND sequence=?";
+        }
+        return db().compile(ref, sql.str().c_str());
+    }
+
+
     sequence_t SQLiteKeyStore::set(slice key, slice vers, slice body, DocumentFlags flags,
                                    Transaction&, const sequence_t *replacingSequence) {
+        if (!_schemaCheckedInTransaction) {
+            // Once this transaction has read the file, no other connection can change its schema
+            // until it ends, so checking before the first write is enough:
+            checkSchema(true);
+            _schemaCheckedInTransaction = true;
+        }
         SQLite::Statement *stmt;
         if (replacingSequence == nullptr) {
             // Default:
             LogVerbose(DBLog, "KeyStore(%s) set %s", name().c_str(), logSlice(key));
-            compile(_setStmt,
-                    "INSERT OR REPLACE INTO kv_@ (version, body, flags, sequence, key)"
-                    " VALUES (?, ?, ?, ?, ?)");
-            stmt = _setStmt.get();
+            stmt = &compileSet(_setStmt, "INSERT OR REPLACE");
         } else if (*replacingSequence == 0) {
             // Insert only:
             LogVerbose(DBLog, "KeyStore(%s) insert %s", name().c_str(), logSlice(key));
-            compile(_insertStmt,
-                    "INSERT OR IGNORE INTO kv_@ (version, body, flags, sequence, key)"
-                    " VALUES (?, ?, ?, ?, ?)");
-            stmt = _insertStmt.get();
+            stmt = &compileSet(_insertStmt, "INSERT OR IGNORE");
         } else {
             // Replace only:
             Assert(_capabilities.sequences);
             LogVerbose(DBLog, "KeyStore(%s) update %s", name().c_str(), logSlice(key));
-            compile(_replaceStmt,
-                    "UPDATE kv_@ SET version=?, body=?, flags=?, sequence=?"
-                    " WHERE key=? AND sequence=?");
-            stmt = _replaceStmt.get();
+            stmt = &compileSet(_replaceStmt, nullptr);
             stmt->bind(6, (long long)*replacingSequence);
         }
+        int flagsColumn = (int)flags;
+        alloc_slice compressed;
+        if (_capabilities.compressBodies)
+            compressed = compressBody(body);
+        if (compressed) {
+            body = compressed;
+            flagsColumn |= kCompressedBodyFlag;
+        }
         stmt->bindNoCopy(1, vers.buf, (int)vers.size);
         stmt->bindNoCopy(2, body.buf, (int)body.size);
-        stmt->bind(3, (int)flags);
+        stmt->bind(3, flagsColumn);
         stmt->bindNoCopy(5, (const char*)key.buf, (int)key.size);
 
         sequence_t seq = 0;
@@ -319,17 +481,29 @@ namespace litecore {
 #pragma mark - INDEXES:
 
 
-    // Parses the JSON index-spec expression into an Array:
-    static pair<alloc_slice, const Array*> parseIndexExpr(slice expression,
-                                                          KeyStore::IndexType type)
+    // Parses the JSON index-spec expression into an Array of expressions, plus an optional
+    // WHERE expression. The spec is either the array itself, or a dict whose "WHAT" key is the
+    // array and whose "WHERE" key is the condition for a partial index.
+    static tuple<alloc_slice, const Array*, const Value*> parseIndexExpr(slice expression,
+                                                                        KeyStore::IndexType type)
     {
         alloc_slice expressionFleece;
         const Array *params = nullptr;
+        const Value *where = nullptr;
         try {
             expressionFleece = JSONConverter::convertJSON(expression);
             auto f = Value::fromTrustedData(expressionFleece);
-            if (f)
-                params = f->asArray();
+            if (f) {
+                auto dict = f->asDict();
+                if (dict) {
+                    auto what = dict->get("WHAT"_sl);
+                    if (what)
+                        params = what->asArray();
+                    where = dict->get("WHERE"_sl);
+                } else {
+                    params = f->asArray();
+                }
+            }
         } catch (const FleeceException &) { }
         if (!params || params->count() == 0)
             error::_throw(error::InvalidQuery);
@@ -342,8 +516,28 @@ namespace litecore {
             if (!params)
                 error::_throw(error::InvalidQuery);
         }
+        if (type == KeyStore::kGeoIndex && params->count() > 5)
+            error::_throw(error::InvalidQuery, "Geo index can't have more than 5 expressions");
+        if (type == KeyStore::kArrayIndex && params->count() != 1)
+            error::_throw(error::InvalidQuery, "Array index must have a single expression");
+        if (where && type != KeyStore::kValueIndex)
+            error::_throw(error::InvalidQuery, "Only value indexes can have a WHERE clause");
+
+        return make_tuple(expressionFleece, params, where);
+    }
 
-        return {expressionFleece, params};
+
+    // Generates the CREATE INDEX statement for a value index, reading materialized properties
+    // from their columns.
+    string SQLiteKeyStore::valueIndexSQL(const string &indexName, slice expression) const {
+        alloc_slice expressionFleece;
+        const Array *params;
+        const Value *where;
+        tie(expressionFleece, params, where) = parseIndexExpr(expression, kValueIndex);
+        QueryParser qp(tableName());
+        qp.setMaterializedProperties(_materializedProperties);
+        qp.writeCreateIndex(indexName, params, where);
+        return qp.SQL();
     }
 
 
@@ -354,15 +548,16 @@ namespace litecore {
         validateIndexName(indexName);
         alloc_slice expressionFleece;
         const Array *params;
-        tie(expressionFleece, params) = parseIndexExpr(expression, type);
+        const Value *where;
+        tie(expressionFleece, params, where) = parseIndexExpr(expression, type);
+        if (type == kFullTextIndex && options && options->deferred)
+            createSequenceIndex();      // Queued records are looked up by sequence
 
         Transaction t(db());
         switch (type) {
             case  kValueIndex: {
-                QueryParser qp(tableName());
                 string indexNameStr = (string)indexName;
-                qp.writeCreateIndex(indexNameStr, params);
-                string sql = qp.SQL();
+                string sql = valueIndexSQL(indexNameStr, expression);
                 SQLite::Statement getExistingSQL(db(), "SELECT sql FROM sqlite_master WHERE type='index' "
                                                 "AND name=?");
                 getExistingSQL.bind(1, indexNameStr);
@@ -375,34 +570,79 @@ namespace litecore {
                 getExistingSQL.reset();
                 
                 _deleteIndex(indexName);
-                db().exec(qp.SQL(), LogLevel::Info);
+                db().exec(sql, LogLevel::Info);
+
+                // Remember the expression, so materializeProperty can regenerate the index:
+                db().exec("CREATE TABLE IF NOT EXISTS kv_index_specs "
+                          "(name TEXT PRIMARY KEY, keyStore TEXT, expression TEXT) WITHOUT ROWID");
+                SQLite::Statement saveSpec(db(), "INSERT INTO kv_index_specs (name, keyStore, "
+                                           "expression) VALUES (?, ?, ?)");
+                saveSpec.bind(1, indexNameStr);
+                saveSpec.bind(2, name());
+                saveSpec.bind(3, (string)expression);
+                saveSpec.exec();
+                break;
+            }
+            case kFullTextIndex:
+            case kArrayIndex:
+            case kGeoIndex: {
+                IndexTable table = indexTable(type, params, options);
+                if (!prepareIndexTable(indexName, table))
+                    return; // No-op
+                // Index existing records:
+                db().exec(table.indexSQL(""));
+                finishIndexTable(indexName, table);
                 break;
             }
+            default:
+                error::_throw(error::Unimplemented);
+        }
+        t.commit();
+    }
+
+
+    // Validates a full-text index's list of prefix lengths, like "1,2,3", and returns it in the
+    // form FTS4's "prefix" option expects.
+    static string prefixLengthsSQL(const char *prefixLengths) {
+        stringstream sql;
+        const char *cp = prefixLengths;
+        while (true) {
+            char *end;
+            long length = strtol(cp, &end, 10);
+            if (end == cp || !isdigit(*cp) || length < 1 || length > 32)
+                error::_throw(error::LiteCoreError::InvalidParameter,
+                              "Invalid full-text index prefix lengths '%s'", prefixLengths);
+            sql << length;
+            cp = end;
+            if (*cp == '\0')
+                break;
+            if (*cp++ != ',')
+                error::_throw(error::LiteCoreError::InvalidParameter,
+                              "Invalid full-text index prefix lengths '%s'", prefixLengths);
+            sql << ',';
+            while (*cp == ' ')
+                ++cp;
+        }
+        return sql.str();
+    }
+
+
+    // Describes the table that stores a full-text, array or geo index, and the SQL statements
+    // that populate it and keep it up to date.
+    SQLiteKeyStore::IndexTable SQLiteKeyStore::indexTable(IndexType type,
+                                                          const Array *params,
+                                                          const IndexOptions *options) const
+    {
+        IndexTable table;
+        string kvTable = tableName();
+        QueryParser qp(kvTable);
+        switch (type) {
             case kFullTextIndex: {
                 // Create the FTS4 virtual table: ( https://www.sqlite.org/fts3.html )
-                QueryParser qp(tableName());
-                auto ftsTableName = qp.FTSIndexName(params);
-                string alias = tableName() + "::" + (string)indexName;
-                SQLite::Statement existingIndex(db(), "SELECT expression FROM kv_fts_map WHERE alias=?");
-                existingIndex.bind(1, alias);
-                if(existingIndex.executeStep()) {
-                    auto existingExpression = existingIndex.getColumn(0).getString();
-                    existingIndex.reset();
-                    if(existingExpression == ftsTableName) {
-                        
-                        return; // No-op
-                    }
-                }
- 
-                if (db().tableExists(ftsTableName)) {
-                    // This is a problem; the index already exists under another alias
-                    error::_throw(error::LiteCoreError::InvalidParameter, "Identical index was created "
-                                  "with another name already");
-                }
-                
-                _deleteIndex(indexName);
+                table.name = qp.FTSIndexName(params);
+                string quotedTable = "\"" + table.name + "\"";
                 stringstream sql;
-                sql << "CREATE VIRTUAL TABLE \"" << ftsTableName << "\" USING fts4(text, tokenize=unicodesn";
+                sql << "CREATE VIRTUAL TABLE " << quotedTable << " USING fts4(text, tokenize=unicodesn";
                 if (options) {
                     if (options->stemmer) {
                         if (unicodesn_isSupportedStemmer(options->stemmer)) {
@@ -415,33 +655,226 @@ namespace litecore {
                     if (options->ignoreDiacritics) {
                         sql << " \"remove_diacritics=1\"";
                     }
+                    if (options->prefixLengths && *options->prefixLengths)
+                        sql << ", prefix=\"" << prefixLengthsSQL(options->prefixLengths) << "\"";
                 }
                 sql << ")";
-                db().exec(sql.str(), LogLevel::Info);
-                db().exec("INSERT INTO kv_fts_map (alias, expression) VALUES (\"" + alias +
-                          "\", \"" + ftsTableName + "\")");
-                // Index existing records:
-                db().exec("INSERT INTO \"" + ftsTableName + "\" (rowid, text) SELECT sequence, " + QueryParser::expressionSQL(params, "body") + " FROM kv_" + name());
+                table.createSQL.push_back(sql.str());
 
-                // Set up triggers to keep the FTS5 table up to date:
-                string ins = "INSERT INTO \"" + ftsTableName + "\" (rowid, text) VALUES (new.sequence, " + QueryParser::expressionSQL(params, "new.body") + "); ";
-                string del = "DELETE FROM \"" + ftsTableName + "\" WHERE rowid = old.sequence; ";
+                // The FTS rows are keyed by the sequence of the revision that was indexed. The
+                // "::seqs" table maps each record's current sequence to its FTS row, so that
+                // saving a record without changing its text only has to update the mapping:
+                string seqs = "\"" + table.name + "::seqs\"";
+                table.createSQL.push_back("CREATE TABLE " + seqs + " (kvSequence INTEGER PRIMARY KEY,"
+                                          " ftsRowid INTEGER NOT NULL)");
+                table.createSQL.push_back("CREATE INDEX \"" + table.name + "::seqs::rowid\" ON "
+                                          + seqs + " (ftsRowid)");
 
-                db().exec(string("CREATE TRIGGER \"") + ftsTableName + "::ins\" AFTER INSERT ON kv_" + name() + " BEGIN " + ins + " END");
-                db().exec(string("CREATE TRIGGER \"") + ftsTableName + "::del\" AFTER DELETE ON kv_" + name() + " BEGIN " + del + " END");
-                db().exec(string("CREATE TRIGGER \"") + ftsTableName + "::upd\" AFTER UPDATE ON kv_" + name() + " BEGIN " + del + ins + " END");
+                string text = QueryParser::expressionSQL(params, "body");
+                string oldText = QueryParser::expressionSQL(params, "old.body");
+                string newText = QueryParser::expressionSQL(params, "new.body");
+                table.indexSQL = [=](const string &condition) {
+                    string where = condition.empty() ? "" : " WHERE " + condition;
+                    return "INSERT INTO " + quotedTable + " (rowid, text) SELECT sequence, " + text
+                           + " FROM " + kvTable + where + "; "
+                           "INSERT INTO " + seqs + " (kvSequence, ftsRowid) SELECT sequence, sequence"
+                           " FROM " + kvTable + where;
+                };
+                string stale = " WHERE kvSequence NOT IN (SELECT sequence FROM " + kvTable + ")";
+                table.staleSQL = "DELETE FROM " + quotedTable + " WHERE rowid IN (SELECT ftsRowid"
+                                 " FROM " + seqs + stale + "); "
+                                 "DELETE FROM " + seqs + stale;
+                table.insertSQL = "INSERT INTO " + quotedTable + " (rowid, text) VALUES (new.sequence, "
+                                  + newText + "); "
+                                  "INSERT OR REPLACE INTO " + seqs + " (kvSequence, ftsRowid) "
+                                  "VALUES (new.sequence, new.sequence); ";
+                table.deleteSQL = "DELETE FROM " + quotedTable + " WHERE rowid = (SELECT ftsRowid FROM "
+                                  + seqs + " WHERE kvSequence = old.sequence); "
+                                  "DELETE FROM " + seqs + " WHERE kvSequence = old.sequence; ";
+                table.updateSQL = table.deleteSQL + table.insertSQL;
+                table.updateCondition = "(" + oldText + ") IS NOT (" + newText + ")";
+                table.unchangedSQL = "UPDATE " + seqs + " SET kvSequence = new.sequence"
+                                     " WHERE kvSequence = old.sequence; ";
+
+                if (options && options->deferred) {
+                    // Saving a record only queues its sequence; removing a sequence from the
+                    // queue (see indexPending) brings its row of the FTS table up to date:
+                    string pending = "\"" + table.name + "::pending\"";
+                    table.createSQL.push_back("CREATE TABLE " + pending
+                                              + " (sequence INTEGER PRIMARY KEY)");
+                    table.createSQL.push_back("CREATE TRIGGER \"" + table.name + "::index\""
+                                              " AFTER DELETE ON " + pending + " BEGIN "
+                                              + table.deleteSQL
+                                              + "INSERT INTO " + quotedTable + " (rowid, text) SELECT sequence, "
+                                              + text + " FROM " + kvTable + " WHERE sequence = old.sequence; "
+                                              "INSERT INTO " + seqs + " (kvSequence, ftsRowid) SELECT sequence, "
+                                              "sequence FROM " + kvTable + " WHERE sequence = old.sequence; END");
+                    table.insertSQL = "INSERT OR IGNORE INTO " + pending + " (sequence) VALUES (new.sequence); ";
+                    table.deleteSQL = "INSERT OR IGNORE INTO " + pending + " (sequence) VALUES (old.sequence); ";
+                    table.updateSQL = table.deleteSQL + table.insertSQL;
+                    // A record whose text is still waiting to be indexed stays in the queue:
+                    table.unchangedSQL += "UPDATE " + pending + " SET sequence = new.sequence"
+                                          " WHERE sequence = old.sequence; ";
+                }
+                break;
+            }
+            case kArrayIndex: {
+                // The index is a table of (docID, element value) rows, kept up to date by triggers
+                // like a FTS table. It's keyed by docID, not sequence, because an INSERT OR REPLACE
+                // doesn't fire the delete trigger for the row it replaces.
+                string property = QueryParser::arrayIndexProperty(params->get(0));
+                table.name = qp.arrayIndexName(property);
+                stringstream propertyStr;
+                QueryParser::writeSQLString(propertyStr, slice(property));
+                string quotedTable = "\"" + table.name + "\"";
+                table.createSQL.push_back("CREATE TABLE " + quotedTable + " (key TEXT NOT NULL, value)");
+                table.createSQL.push_back("CREATE INDEX \"" + table.name + "::key\" ON "
+                                          + quotedTable + " (key)");
+                table.createSQL.push_back("CREATE INDEX \"" + table.name + "::value\" ON "
+                                          + quotedTable + " (value, key)");
+
+                string each = "fl_each(" + kvTable + ".body, " + propertyStr.str() + ")";
+                table.indexSQL = [=](const string &condition) {
+                    string sql;
+                    if (!condition.empty()) {
+                        // An earlier batch of an index build may have indexed an older revision:
+                        sql = "DELETE FROM " + quotedTable + " WHERE key IN (SELECT key FROM "
+                              + kvTable + " WHERE " + condition + "); ";
+                    }
+                    return sql + "INSERT INTO " + quotedTable + " (key, value) SELECT " + kvTable
+                           + ".key, _each.value FROM " + kvTable + ", " + each + " AS _each"
+                           + (condition.empty() ? "" : " WHERE " + condition);
+                };
+                table.staleSQL = "DELETE FROM " + quotedTable + " WHERE key NOT IN (SELECT key FROM "
+                                 + kvTable + ")";
+                table.deleteSQL = "DELETE FROM " + quotedTable + " WHERE key = old.key; ";
+                table.insertSQL = "DELETE FROM " + quotedTable + " WHERE key = new.key; "
+                                  "INSERT INTO " + quotedTable + " (key, value) SELECT new.key, value"
+                                  " FROM fl_each(new.body, " + propertyStr.str() + "); ";
+                table.updateSQL = table.insertSQL;
+                break;
+            }
+            case kGeoIndex: {
+                // Create an R*Tree virtual table: ( https://www.sqlite.org/rtree.html )
+                // Each document is a point whose coordinates are the values of the expressions.
+                table.name = qp.geoIndexName(params);
+                uint32_t n = params->count();
+                stringstream columns, bounds, valuesFrom, valuesFromNew, numeric;
+                for (uint32_t i = 0; i < n; ++i) {
+                    columns << ", min" << i << ", max" << i;
+                    bounds << ", v" << i << ", v" << i;
+                    string sep = (i > 0) ? ", " : "";
+                    valuesFrom << sep << QueryParser::expressionSQL(params->get(i), "body")
+                               << " AS v" << i;
+                    valuesFromNew << sep << QueryParser::expressionSQL(params->get(i), "new.body")
+                                  << " AS v" << i;
+                    numeric << (i > 0 ? " AND " : "") << "typeof(v" << i << ") IN ('integer','real')";
+                }
+                string quotedTable = "\"" + table.name + "\"";
+                table.createSQL.push_back("CREATE VIRTUAL TABLE " + quotedTable + " USING rtree(id"
+                                          + columns.str() + ")");
+
+                // Records whose values aren't all numbers are left out:
+                string insertInto = "INSERT INTO " + quotedTable + " (id" + columns.str() + ")";
+                string select = bounds.str() + " FROM (SELECT ";
+                string values = valuesFrom.str(), where = ") WHERE " + numeric.str();
+                table.indexSQL = [=](const string &condition) {
+                    return insertInto + " SELECT sequence" + select + "sequence, " + values
+                           + " FROM " + kvTable + (condition.empty() ? "" : " WHERE " + condition)
+                           + where;
+                };
+                table.staleSQL = "DELETE FROM " + quotedTable + " WHERE id NOT IN (SELECT sequence"
+                                 " FROM " + kvTable + ")";
+                table.insertSQL = insertInto + " SELECT new.sequence" + select
+                                  + valuesFromNew.str() + where + "; ";
+                table.deleteSQL = "DELETE FROM " + quotedTable + " WHERE id = old.sequence; ";
+                table.updateSQL = table.deleteSQL + table.insertSQL;
                 break;
             }
             default:
                 error::_throw(error::Unimplemented);
         }
-        t.commit();
+        return table;
+    }
+
+
+    // Creates an empty index table, after checking for an existing one. Returns false if the
+    // index already exists with the same expression and options, so there's nothing to do.
+    bool SQLiteKeyStore::prepareIndexTable(slice indexName, const IndexTable &table) {
+        string alias = tableName() + "::" + (string)indexName;
+        SQLite::Statement existingIndex(db(), "SELECT alias FROM kv_fts_map WHERE expression=?");
+        existingIndex.bind(1, table.name);
+        if (existingIndex.executeStep()) {
+            bool sameName = (existingIndex.getColumn(0).getString() == alias);
+            existingIndex.reset();
+            if (!sameName) {
+                // This is a problem; the index already exists under another alias
+                error::_throw(error::LiteCoreError::InvalidParameter, "Identical index was "
+                              "created with another name already");
+            }
+            // The options (like a full-text index's prefix lengths) are in the table's schema:
+            SQLite::Statement existingTable(db(), "SELECT sql FROM sqlite_master"
+                                            " WHERE type='table' AND name=?");
+            existingTable.bind(1, table.name);
+            bool sameOptions = existingTable.executeStep()
+                            && existingTable.getColumn(0).getString() == table.createSQL[0];
+            existingTable.reset();
+            if (sameOptions)
+                return false; // No-op
+            LogTo(SQL, "Rebuilding index '%.*s' with new options", SPLAT(indexName));
+            _deleteIndex(indexName);
+        }
+
+        // An unregistered table is left over from an index build that never finished:
+        dropIndexTable(table.name);
+        for (auto &sql : table.createSQL)
+            db().exec(sql, LogLevel::Info);
+        return true;
+    }
+
+
+    // Makes a populated index table live: replaces any existing index with the same name,
+    // sets up triggers to keep the table up to date, and registers it in kv_fts_map.
+    void SQLiteKeyStore::finishIndexTable(slice indexName, const IndexTable &table) {
+        _deleteIndex(indexName);
+        string trigger = "CREATE TRIGGER \"" + table.name;
+        db().exec(trigger + "::ins\" AFTER INSERT ON " + tableName() + " BEGIN " + table.insertSQL + " END");
+        db().exec(trigger + "::del\" AFTER DELETE ON " + tableName() + " BEGIN " + table.deleteSQL + " END");
+        string update = trigger + "::upd\" AFTER UPDATE OF body ON " + tableName();
+        if (!table.updateCondition.empty())
+            update += " WHEN " + table.updateCondition;
+        db().exec(update + " BEGIN " + table.updateSQL + " END");
+        if (!table.unchangedSQL.empty()) {
+            db().exec(trigger + "::move\" AFTER UPDATE OF body ON " + tableName() + " WHEN NOT "
+                      + table.updateCondition + " BEGIN " + table.unchangedSQL + " END");
+        }
+        string alias = tableName() + "::" + (string)indexName;
+        db().exec("INSERT INTO kv_fts_map (alias, expression) VALUES (\"" + alias +
+                  "\", \"" + table.name + "\")");
+    }
+
+
+    void SQLiteKeyStore::dropIndexTable(const string &tableName) {
+        db().exec(string("DROP TABLE IF EXISTS \"") + tableName + "\"", LogLevel::Info);
+        db().exec(string("DROP TABLE IF EXISTS \"") + tableName + "::pending\"");
+        db().exec(string("DROP TABLE IF EXISTS \"") + tableName + "::seqs\"");
+        db().exec(string("DROP TRIGGER IF EXISTS \"") + tableName + "::ins\"");
+        db().exec(string("DROP TRIGGER IF EXISTS \"") + tableName + "::del\"");
+        db().exec(string("DROP TRIGGER IF EXISTS \"") + tableName + "::upd\"");
+        db().exec(string("DROP TRIGGER IF EXISTS \"") + tableName + "::move\"");
     }
 
+
     void SQLiteKeyStore::_deleteIndex(slice name) {
         validateIndexName(name);
+        invalidateQueryCache();
         string indexName = (string)name;
         db().exec(string("DROP INDEX IF EXISTS ") + indexName, LogLevel::Info);
+        if (db().tableExists("kv_index_specs")) {
+            SQLite::Statement deleteSpec(db(), "DELETE FROM kv_index_specs WHERE name=?");
+            deleteSpec.bind(1, indexName);
+            deleteSpec.exec();
+        }
         
         SQLite::Statement getExpression(db(), "SELECT expression FROM kv_fts_map WHERE alias=?");
         string alias = tableName() + "::" + (string)name;
@@ -452,10 +885,7 @@ namespace litecore {
         
         indexName = getExpression.getColumn(0).getString();
         getExpression.reset();
-        db().exec(string("DROP TABLE IF EXISTS \"") + indexName + "\"", LogLevel::Info);
-        db().exec(string("DROP TRIGGER IF EXISTS \"") + indexName + "::ins\"");
-        db().exec(string("DROP TRIGGER IF EXISTS \"") + indexName + "::del\"");
-        db().exec(string("DROP TRIGGER IF EXISTS \"") + indexName + "::upd\"");
+        dropIndexTable(indexName);
         db().exec(string("DELETE FROM kv_fts_map WHERE alias=\"") + alias + "\"");
     }
 
@@ -487,6 +917,387 @@ namespace litecore {
         return enc.extractOutput();
     }
 
+    void SQLiteKeyStore::materializeProperty(slice propertyPath) {
+        if (propertyPath.size > 0 && propertyPath[0] == '.')
+            propertyPath.moveStart(1);
+        if (propertyPath.size == 0)
+            error::_throw(error::InvalidParameter, "Property path must not be empty");
+        string property = (string)propertyPath;
+        if (property == "_id" || property == "_sequence")
+            error::_throw(error::InvalidParameter, "'%s' is already a column", property.c_str());
+        Transaction t(db());
+        checkSchema(true);
+        if (find(_materializedProperties.begin(), _materializedProperties.end(), property)
+                != _materializedProperties.end()) {
+            t.commit();
+            return;
+        }
+
+        string column = QueryParser::materializedColumnName(property);
+        stringstream path;
+        QueryParser::writeSQLString(path, propertyPath);
+        db().exec("ALTER TABLE " + tableName() + " ADD COLUMN " + column, LogLevel::Info);
+        db().exec("UPDATE " + tableName() + " SET " + column + "=fl_materialize(body, "
+                  + path.str() + ")", LogLevel::Info);
+        // Picks up the new column, recompiling the statements written by set():
+        checkSchema(true);
+
+        // Queries will compare the column instead of calling fl_value, so value indexes on the
+        // property have to be regenerated to index the column. (Indexes created by versions
+        // that didn't record their expressions in kv_index_specs are left as they are.)
+        if (db().tableExists("kv_index_specs")) {
+            vector<pair<string,string>> indexes;
+            SQLite::Statement getSpecs(db(), "SELECT specs.name, specs.expression, sqlite_master.sql "
+                                       "FROM kv_index_specs AS specs JOIN sqlite_master "
+                                       "ON sqlite_master.name = specs.name "
+                                       "WHERE specs.keyStore=? AND sqlite_master.type='index'");
+            getSpecs.bind(1, name());
+            while (getSpecs.executeStep()) {
+                string indexName = getSpecs.getColumn(0).getString();
+                string sql = valueIndexSQL(indexName, getSpecs.getColumn(1).getString());
+                if (sql != getSpecs.getColumn(2).getString())
+                    indexes.emplace_back(indexName, sql);
+            }
+            getSpecs.reset();
+            for (auto &index : indexes) {
+                db().exec("DROP INDEX \"" + index.first + "\"", LogLevel::Info);
+                db().exec(index.second, LogLevel::Info);
+            }
+        }
+        t.commit();
+    }
+
+
+    vector<string> SQLiteKeyStore::arrayIndexedProperties() const {
+        string prefix = QueryParser(tableName()).arrayIndexName("");
+        vector<string> properties;
+        SQLite::Statement getTables(db(), "SELECT expression FROM kv_fts_map WHERE alias LIKE ?");
+        getTables.bind(1, tableName() + "::%");
+        while (getTables.executeStep()) {
+            string arrayTableName = getTables.getColumn(0).getString();
+            if (hasPrefix(arrayTableName, prefix))
+                properties.push_back(arrayTableName.substr(prefix.size()));
+        }
+        return properties;
+    }
+
+
+    set<string> SQLiteKeyStore::indexedExpressions() const {
+        // Value indexes are written by QueryParser::writeCreateIndex, as
+        // `CREATE INDEX "name" ON kv_table (expr1, expr2, ...)`; find where expr1 ends:
+        set<string> expressions;
+        string columnsStart = " ON " + tableName() + " (";
+        SQLite::Statement getIndexSQL(db(), "SELECT sql FROM sqlite_master WHERE type='index' "
+                                      "AND tbl_name=? AND sql NOT NULL");
+        getIndexSQL.bind(1, tableName());
+        while (getIndexSQL.executeStep()) {
+            string sql = getIndexSQL.getColumn(0).getString();
+            size_t start = sql.find(columnsStart);
+            if (start == string::npos)
+                continue;
+            start += columnsStart.size();
+            int depth = 0;
+            char quote = 0;
+            size_t end;
+            for (end = start; end < sql.size(); ++end) {
+                char c = sql[end];
+                if (quote) {
+                    if (c == quote)
+                        quote = 0;
+                } else if (c == '\'' || c == '"') {
+                    quote = c;
+                } else if (c == '(') {
+                    ++depth;
+                } else if ((c == ')' || c == ',') && depth == 0) {
+                    break;
+                } else if (c == ')') {
+                    --depth;
+                }
+            }
+            if (end < sql.size())
+                expressions.insert(sql.substr(start, end - start));
+        }
+        return expressions;
+    }
+
+
+    bool SQLiteKeyStore::hasIndexTable(const string &indexTableName) const {
+        SQLite::Statement check(db(), "SELECT 1 FROM kv_fts_map WHERE expression=?");
+        check.bind(1, indexTableName);
+        bool exists = check.executeStep();
+        check.reset();
+        return exists;
+    }
+
+
+    set<string> SQLiteKeyStore::mappedFTSTables() const {
+        set<string> tables;
+        SQLite::Statement getTables(db(), "SELECT expression FROM kv_fts_map WHERE alias LIKE ?");
+        getTables.bind(1, tableName() + "::%");
+        while (getTables.executeStep()) {
+            string table = getTables.getColumn(0).getString();
+            if (db().tableExists(table + "::seqs"))
+                tables.insert(table);
+        }
+        return tables;
+    }
+
+    vector<alloc_slice> SQLiteKeyStore::indexedTexts(const string &ftsTableName,
+                                                     const vector<sequence_t> &sequences) const
+    {
+        vector<alloc_slice> texts(sequences.size());
+        if (sequences.empty())
+            return texts;
+        unordered_multimap<sequence_t, size_t> indexOfSequence;
+        for (size_t i = 0; i < sequences.size(); ++i)
+            indexOfSequence.emplace(sequences[i], i);
+
+        // The SQL (which depends on the table's schema) and the main connection's statement are
+        // cached per table, since match text is typically fetched a page of rows at a time:
+        auto conn = db().readConnection();
+        shared_ptr<SQLite::Statement> stmt;
+        string sql;
+        {
+            lock_guard<mutex> lock(_indexedTextsMutex);
+            IndexedTextsQuery &cached = _indexedTextsQueries[ftsTableName];
+            if (cached.sql.empty()) {
+                // Unused parameters stay NULL, as in getMany():
+                string quotedTable = "\"" + ftsTableName + "\"";
+                stringstream sqlStr;
+                if (db().tableExists(ftsTableName + "::seqs"))
+                    sqlStr << "SELECT seqs.kvSequence, fts.text FROM \"" << ftsTableName
+                           << "::seqs\" AS seqs JOIN " << quotedTable << " AS fts"
+                              " ON fts.rowid = seqs.ftsRowid WHERE seqs.kvSequence IN (?";
+                else
+                    sqlStr << "SELECT rowid, text FROM " << quotedTable << " WHERE rowid IN (?";
+                for (size_t i = 1; i < kGetManyBatchSize; ++i)
+                    sqlStr << ",?";
+                sqlStr << ")";
+                cached.sql = sqlStr.str();
+            }
+            if (conn) {
+                sql = cached.sql;
+            } else {
+                if (!cached.statement)
+                    cached.statement.reset(compile(cached.sql));
+                stmt = cached.statement;
+            }
+        }
+        if (conn)
+            stmt = conn->compile(sql);
+        for (size_t start = 0; start < sequences.size(); start += kGetManyBatchSize) {
+            size_t end = min(start + kGetManyBatchSize, sequences.size());
+            UsingStatement u(*stmt);
+            stmt->clearBindings();
+            for (size_t i = start; i < end; ++i)
+                stmt->bind((int)(i - start + 1), (long long)sequences[i]);
+            while (stmt->executeStep()) {
+                sequence_t seq = (int64_t)stmt->getColumn(0);
+                alloc_slice text(columnAsSlice(stmt->getColumn(1)));
+                auto range = indexOfSequence.equal_range(seq);
+                for (auto it = range.first; it != range.second; ++it)
+                    texts[it->second] = text;
+            }
+        }
+        return texts;
+    }
+
+
+#pragma mark - DEFERRED FULL-TEXT INDEXES:
+
+
+    // The tables of the deferred full-text indexes, i.e. the ones with a queue of sequences.
+    vector<string> SQLiteKeyStore::deferredIndexTables() const {
+        vector<string> tables;
+        SQLite::Statement getTables(db(), "SELECT expression FROM kv_fts_map WHERE alias LIKE ?");
+        getTables.bind(1, tableName() + "::%");
+        while (getTables.executeStep()) {
+            string table = getTables.getColumn(0).getString();
+            if (db().tableExists(table + "::pending"))
+                tables.push_back(table);
+        }
+        return tables;
+    }
+
+
+    // Indexes the first `maxRecords` sequences in a deferred index's queue, by deleting them
+    // from the queue, which fires its trigger. Returns the number of records indexed.
+    unsigned SQLiteKeyStore::indexPending(const string &ftsTableName, unsigned maxRecords) {
+        string pending = "\"" + ftsTableName + "::pending\"";
+        SQLite::Statement getBatch(db(), "SELECT count(*), max(sequence) FROM (SELECT sequence FROM "
+                                   + pending + " ORDER BY sequence LIMIT ?)");
+        getBatch.bind(1, (long long)maxRecords);
+        getBatch.executeStep();
+        auto count = (unsigned)getBatch.getColumn(0).getInt64();
+        auto batchEnd = (sequence_t)getBatch.getColumn(1).getInt64();
+        getBatch.reset();
+        if (count > 0)
+            db().exec("DELETE FROM " + pending + " WHERE sequence <= " + to_string(batchEnd));
+        return count;
+    }
+
+
+    bool SQLiteKeyStore::updateDeferredIndexes(unsigned maxRecords) {
+        maxRecords = max(maxRecords, 1u);
+        bool done = true;
+        Transaction t(db());
+        for (auto &ftsTable : deferredIndexTables()) {
+            if (indexPending(ftsTable, maxRecords) == maxRecords)
+                done = false;
+        }
+        t.commit();
+        return done;
+    }
+
+
+    void SQLiteKeyStore::catchUpDeferredIndex(const string &ftsTableName) {
+        if (!db().tableExists(ftsTableName + "::pending"))
+            return;
+        SQLite::Statement anyPending(db(), "SELECT 1 FROM \"" + ftsTableName + "::pending\" LIMIT 1");
+        bool isPending = anyPending.executeStep();
+        anyPending.reset();
+        if (!isPending)
+            return;
+        if (!dataFile().options().writeable) {
+            Warn("Can't update deferred full-text index '%s' of read-only database",
+                 ftsTableName.c_str());
+            return;
+        }
+
+        LogTo(SQL, "Catching up deferred full-text index '%s'", ftsTableName.c_str());
+        if (db().inTransaction()) {
+            indexPending(ftsTableName, UINT_MAX);
+        } else {
+            Transaction t(db());
+            indexPending(ftsTableName, UINT_MAX);
+            t.commit();
+        }
+    }
+
+#pragma mark - INDEX BUILDER:
+
+
+    // Builds an index a batch of records at a time, each batch in its own short transaction.
+    // Records are visited in sequence order, and every write gives a record a new sequence, so
+    // records written during the build are caught up by later batches. The last batch deletes
+    // the rows left behind by records that changed or were purged since they were indexed, then
+    // sets up the triggers and registers the table, so queries can't see the index until it's
+    // complete.
+    class SQLiteIndexBuilder : public KeyStore::IndexBuilder {
+    public:
+        // A value index is created by a single SQLite statement, so the first step builds it all.
+        SQLiteIndexBuilder(SQLiteKeyStore &store, slice name, slice expression)
+        :_store(store)
+        ,_name(name)
+        ,_expression(expression)
+        { }
+
+        SQLiteIndexBuilder(SQLiteKeyStore &store, slice name, SQLiteKeyStore::IndexTable &&table,
+                           bool done)
+        :_store(store)
+        ,_name(name)
+        ,_table(move(table))
+        ,_done(done)
+        { }
+
+        ~SQLiteIndexBuilder() {
+            if (!_done && !_table.name.empty()) {
+                // Canceled; throw away the partial index:
+                try {
+                    Transaction t(_store.db());
+                    _store.dropIndexTable(_table.name);
+                    t.commit();
+                } catch (const exception &x) {
+                    Warn("Couldn't delete unfinished index table '%s': %s",
+                         _table.name.c_str(), x.what());
+                }
+            }
+        }
+
+        bool step(unsigned maxRecords) override {
+            if (_done)
+                return true;
+            if (_table.name.empty()) {
+                _store.createIndex(_name, _expression, KeyStore::kValueIndex);
+                _done = true;
+                return true;
+            }
+
+            maxRecords = max(maxRecords, 1u);
+            string kvTable = _store.tableName();
+            Transaction t(_store.db());
+            SQLite::Statement getBatch(_store.db(), "SELECT count(*), max(sequence) FROM "
+                                       "(SELECT sequence FROM " + kvTable + " WHERE sequence > ?"
+                                       " ORDER BY sequence LIMIT ?)");
+            getBatch.bind(1, (long long)_indexedThrough);
+            getBatch.bind(2, (long long)maxRecords);
+            getBatch.executeStep();
+            auto count = (unsigned)getBatch.getColumn(0).getInt64();
+            auto batchEnd = (sequence_t)getBatch.getColumn(1).getInt64();
+            getBatch.reset();
+
+            string condition = kvTable + ".sequence > " + to_string(_indexedThrough);
+            if (count < maxRecords) {
+                // This is the last batch, so make the index live in the same transaction:
+                _store.db().exec(_table.indexSQL(condition));
+                if (_indexedThrough > 0) {
+                    // Records indexed by earlier batches may since have been purged, or saved
+                    // with a new sequence that this or a later batch indexed again:
+                    _store.db().exec(_table.staleSQL);
+                }
+                _store.finishIndexTable(_name, _table);
+                _done = true;
+            } else {
+                condition += " AND " + kvTable + ".sequence <= " + to_string(batchEnd);
+                _store.db().exec(_table.indexSQL(condition));
+                _indexedThrough = batchEnd;
+            }
+            t.commit();
+            return _done;
+        }
+
+        float progress() const override {
+            if (_done)
+                return 1.0f;
+            sequence_t lastSeq = _store.lastSequence();
+            if (lastSeq == 0)
+                return 0.0f;
+            return min(1.0f, (float)_indexedThrough / lastSeq);
+        }
+
+    private:
+        SQLiteKeyStore &_store;
+        alloc_slice _name;
+        alloc_slice _expression;                    // Only for a value index
+        SQLiteKeyStore::IndexTable _table;          // Empty for a value index
+        sequence_t _indexedThrough {0};             // Records up to here are indexed
+        bool _done {false};
+    };
+
+
+    unique_ptr<KeyStore::IndexBuilder> SQLiteKeyStore::beginIndexBuild(slice indexName,
+                                                                       slice expression,
+                                                                       IndexType type,
+                                                                       const IndexOptions *options)
+    {
+        validateIndexName(indexName);
+        alloc_slice expressionFleece;
+        const Array *params;
+        const Value *where;
+        tie(expressionFleece, params, where) = parseIndexExpr(expression, type);
+        if (type == kValueIndex)
+            return unique_ptr<IndexBuilder>(new SQLiteIndexBuilder(*this, indexName, expression));
+
+        createSequenceIndex();      // Batches are selected by sequence
+        IndexTable table = indexTable(type, params, options);
+        Transaction t(db());
+        bool exists = !prepareIndexTable(indexName, table);
+        t.commit();
+        return unique_ptr<IndexBuilder>(new SQLiteIndexBuilder(*this, indexName, move(table),
+                                                               exists));
+    }
+
+
     void SQLiteKeyStore::createSequenceIndex() {
         if (!_createdSeqIndex) {
             if (!_capabilities.sequences)
@@ -8,6 +8,14 @@
 
 #pragma once
 #include "KeyStore.hh"
+#include "Query.hh"
+#include "LRUCache.hh"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
 
 namespace fleece {
     class Value;
@@ -22,6 +30,8 @@ namespace SQLite {
 namespace litecore {
 
     class SQLiteDataFile;
+    class SQLiteReadConnection;
+    struct CompiledQuery;
     
 
     /** SQLite implementation of KeyStore; corresponds to a SQL table. */
@@ -32,6 +42,8 @@ namespace litecore {
 
         Record get(sequence_t, ContentOptions) const override;
         bool read(Record &rec, ContentOptions options) const override;
+        std::vector<Record> getMany(const std::vector<slice> &keys,
+                                    ContentOptions) const override;
 
         sequence_t set(slice key, slice meta, slice value, DocumentFlags,
                        Transaction&, const sequence_t *replacingSequence =nullptr) override;
@@ -51,8 +63,45 @@ namespace litecore {
         void deleteIndex(slice name) override;
         alloc_slice getIndexes() const override;
 
+        std::unique_ptr<IndexBuilder> beginIndexBuild(slice name,
+                                                      slice expressionJSON,
+                                                      IndexType =kValueIndex,
+                                                      const IndexOptions* = nullptr) override;
+
         void createSequenceIndex();
 
+        void materializeProperty(slice propertyPath) override;
+        std::vector<std::string> materializedProperties() const override
+                                                                {return _materializedProperties;}
+
+        /** The properties that have array indexes (kArrayIndex). */
+        std::vector<std::string> arrayIndexedProperties() const;
+
+        /** The SQL expressions that are the first column of a value index, with any COLLATE. */
+        std::set<std::string> indexedExpressions() const;
+
+        /** True if a complete full-text, array or geo index is stored in the named table. */
+        bool hasIndexTable(const std::string &tableName) const;
+
+        /** The full-text index tables that map record sequences to their rows through a
+            "::seqs" table; the others (created by older versions) are keyed by sequence. */
+        std::set<std::string> mappedFTSTables() const;
+
+        /** Reads the text that a full-text index table has indexed for each of the given record
+            sequences, in batches. A text is null if its record isn't in the index. */
+        std::vector<alloc_slice> indexedTexts(const std::string &ftsTableName,
+                                              const std::vector<sequence_t> &sequences) const;
+
+        bool updateDeferredIndexes(unsigned maxRecords) override;
+
+        /** Indexes all the records queued by a deferred full-text index, if it is one. */
+        void catchUpDeferredIndex(const std::string &ftsTableName);
+
+        void setQueryCacheSize(size_t) override;
+        QueryCacheStats queryCacheStats() const override        {return _queryCacheStats;}
+
+        static const size_t kDefaultQueryCacheSize = 32;
+
     protected:
         std::string tableName() const                       {return std::string("kv_") + name();}
 
@@ -64,11 +113,22 @@ namespace litecore {
         SQLite::Statement* compile(const std::string &sql) const;
         SQLite::Statement& compile(const std::unique_ptr<SQLite::Statement>& ref,
                                    const char *sqlTemplate) const;
+        SQLite::Statement& compileSet(const std::unique_ptr<SQLite::Statement>& ref,
+                                      const char *insertVerb) const;
+        SQLite::Statement& compileRead(SQLiteReadConnection*,
+                                       const std::unique_ptr<SQLite::Statement>& ref,
+                                       const char *sqlTemplate) const;
 
         void transactionWillEnd(bool commit);
 
         void close() override;
 
+        // Bit in the `flags` column marking a compressed body; never set in a Record's flags.
+        static const int kCompressedBodyFlag = 0x80;
+
+        // Column a meta-only read selects in place of the body, to get its size from
+        static const std::string kBodySizeSQL;
+
         static slice columnAsSlice(const SQLite::Column &col);
         static void setRecordMetaAndBody(Record &rec,
                                          SQLite::Statement &stmt,
@@ -78,7 +138,22 @@ namespace litecore {
         friend class SQLiteDataFile;
         friend class SQLiteEnumerator;
         friend class SQLiteQuery;
-        
+        friend struct CompiledQuery;
+        friend class SQLiteIndexBuilder;
+
+        // Describes the side table storing a full-text, array or geo index:
+        struct IndexTable {
+            std::string name;                                   // Table name
+            std::vector<std::string> createSQL;                 // Statements creating the table
+            std::function<std::string(const std::string&)> indexSQL; // Indexes records matching
+                                                                // a condition on the kv table
+            std::string staleSQL;                               // Deletes rows of records
+                                                                // that are gone or moved
+            std::string insertSQL, deleteSQL, updateSQL;        // Trigger actions
+            std::string updateCondition;                        // If set, updateSQL runs only
+            std::string unchangedSQL;                           // when it's true, else this does
+        };
+
         SQLiteKeyStore(SQLiteDataFile&, const std::string &name, KeyStore::Capabilities options);
         SQLiteDataFile& db() const                    {return (SQLiteDataFile&)dataFile();}
         std::string subst(const char *sqlTemplate) const;
@@ -86,16 +161,42 @@ namespace litecore {
         void writeSQLOptions(std::stringstream &sql, RecordEnumerator::Options options);
         void setLastSequence(sequence_t seq);
         void _deleteIndex(slice name);
+        std::string valueIndexSQL(const std::string &indexName, slice expression) const;
+        IndexTable indexTable(IndexType, const fleece::Array *params, const IndexOptions*) const;
+        bool prepareIndexTable(slice indexName, const IndexTable&);
+        void finishIndexTable(slice indexName, const IndexTable&);
+        void dropIndexTable(const std::string &tableName);
+        std::vector<std::string> deferredIndexTables() const;
+        unsigned indexPending(const std::string &ftsTableName, unsigned maxRecords);
+        void checkSchema(bool reread =false);
+        void invalidateQueryCache();
 
         std::unique_ptr<SQLite::Statement> _recCountStmt;
         std::unique_ptr<SQLite::Statement> _getByKeyStmt, _getMetaByKeyStmt, _getByOffStmt;
         std::unique_ptr<SQLite::Statement> _getBySeqStmt, _getMetaBySeqStmt;
+        std::unique_ptr<SQLite::Statement> _getManyStmt, _getManyMetaStmt;
         std::unique_ptr<SQLite::Statement> _setStmt, _insertStmt, _replaceStmt;
         std::unique_ptr<SQLite::Statement> _backupStmt, _delByKeyStmt, _delBySeqStmt, _delByBothStmt;
         std::unique_ptr<SQLite::Statement> _setFlagStmt;
         bool _createdSeqIndex {false};     // Created by-seq index yet?
         bool _lastSequenceChanged {false};
         int64_t _lastSequence {-1};
+        std::vector<std::string> _materializedProperties;  // Properties stored in their own columns
+        int64_t _schemaVersion {-1};       // PRAGMA schema_version when last checked
+        bool _schemaCheckedInTransaction {false};   // checkSchema called since BEGIN?
+
+        // Translated queries, keyed by their JSON expression (see compileQuery):
+        std::mutex _queryCacheMutex;
+        LRUCache<std::string, std::shared_ptr<const CompiledQuery>> _queryCache {kDefaultQueryCacheSize};
+        QueryCacheStats _queryCacheStats {0, 0};
+
+        // The SQL indexedTexts uses for each FTS table, and its statement on the main connection:
+        struct IndexedTextsQuery {
+            std::string sql;
+            std::shared_ptr<SQLite::Statement> statement;
+        };
+        mutable std::mutex _indexedTextsMutex;
+        mutable std::unordered_map<std::string, IndexedTextsQuery> _indexedTextsQueries;
     };
 
 }
@@ -0,0 +1,73 @@
+//
+//  LRUCache.hh
+//  LiteCore
+//
+//  Copyright © 2017 Couchbase. All rights reserved.
+//
+
+#pragma once
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace litecore {
+
+    /** A map with a maximum size; when it's full, adding an item evicts the least recently
+        used one. Not thread-safe. */
+    template <class KEY, class VALUE, class HASH = std::hash<KEY>>
+    class LRUCache {
+    public:
+        explicit LRUCache(size_t capacity)          :_capacity(capacity) { }
+
+        size_t size() const                         {return _map.size();}
+        size_t capacity() const                     {return _capacity;}
+
+        void setCapacity(size_t capacity) {
+            _capacity = capacity;
+            trim();
+        }
+
+        /** Returns a pointer to the value for the key, or nullptr if it's not cached.
+            A successful lookup makes the item the most recently used. */
+        VALUE* get(const KEY &key) {
+            auto i = _map.find(key);
+            if (i == _map.end())
+                return nullptr;
+            _list.splice(_list.begin(), _list, i->second);
+            return &i->second->second;
+        }
+
+        /** Adds or replaces the value for a key, making it the most recently used. */
+        void put(const KEY &key, VALUE value) {
+            auto i = _map.find(key);
+            if (i != _map.end()) {
+                i->second->second = std::move(value);
+                _list.splice(_list.begin(), _list, i->second);
+            } else {
+                _list.emplace_front(key, std::move(value));
+                _map[key] = _list.begin();
+                trim();
+            }
+        }
+
+        void clear() {
+            _map.clear();
+            _list.clear();
+        }
+
+    private:
+        using Entry = std::pair<KEY, VALUE>;
+
+        void trim() {
+            while (_map.size() > _capacity) {
+                _map.erase(_list.back().first);
+                _list.pop_back();
+            }
+        }
+
+        size_t _capacity;
+        std::list<Entry> _list;                 // Most recently used first
+        std::unordered_map<KEY, typename std::list<Entry>::iterator, HASH> _map;
+    };
+
+}
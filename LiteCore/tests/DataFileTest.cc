@@ -8,12 +8,15 @@
 
 #include "DataFile.hh"
 #include "RecordEnumerator.hh"
+#include "RecordCompression.hh"
 #include "Error.hh"
 #include "FilePath.hh"
 #include "Fleece.hh"
 #include "Benchmark.hh"
 
 #include "LiteCoreTest.hh"
+#include <atomic>
+#include <thread>
 
 using namespace litecore;
 using namespace std;
@@ -159,6 +162,44 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile EnumerateDocsDescending",
 }
 
 
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile ConcurrentReads", "[DataFile]") {
+    createNumberedDocs(store);
+
+    // Outside a transaction, reads and enumerations can run on several threads at once:
+    atomic<int> failures {0};
+    vector<thread> threads;
+    for (int n = 0; n < 4; ++n) {
+        threads.emplace_back([&] {
+            for (int pass = 0; pass < 10; ++pass) {
+                int count = 0;
+                for (RecordEnumerator e(*store); e.next(); ++count) {
+                    if (store->get((*e).key()).body() != (*e).key())
+                        ++failures;
+                }
+                if (count != 100)
+                    ++failures;
+            }
+        });
+    }
+    for (auto &t : threads)
+        t.join();
+    CHECK(failures == 0);
+
+    // Inside a transaction, reads see its uncommitted changes:
+    {
+        Transaction t(db);
+        store->set("rec-001"_sl, "changed"_sl, t);
+        CHECK(store->get("rec-001"_sl).body() == "changed"_sl);
+        int count = 0;
+        for (RecordEnumerator e(*store); e.next(); ++count)
+            ;
+        CHECK(count == 100);
+        t.abort();
+    }
+    CHECK(store->get("rec-001"_sl).body() == "rec-001"_sl);
+}
+
+
 N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile AbortTransaction", "[DataFile]") {
     // Initial record:
     {
@@ -304,6 +345,71 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile KeyStoreWrite", "[DataFil
 }
 
 
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile CompressedBodies", "[DataFile]") {
+    string big;
+    for (int i = 0; i < 100; ++i)
+        big += stringWithFormat("The quick brown fox jumps over lazy dog #%d. ", i);
+    slice bigBody(big);
+
+    // Small or incompressible bodies aren't compressed:
+    CHECK(compressBody("tiny"_sl).buf == nullptr);
+    alloc_slice compressed = compressBody(bigBody);
+    REQUIRE(compressed.buf);
+    CHECK(isCompressedBody(compressed));
+    CHECK(compressed.size < bigBody.size / 2);
+    CHECK(decompressBody(compressed) == bigBody);
+    CHECK(compressBody(compressed).buf == nullptr);
+
+    KeyStore::Capabilities caps = db->options().keyStores;
+    caps.compressBodies = true;
+    KeyStore &s = db->getKeyStore("compressed", caps);
+    {
+        Transaction t(db);
+        s.set("big"_sl, "1-aa"_sl, bigBody, DocumentFlags::kHasAttachments, t);
+        s.set("small"_sl, "1-bb"_sl, "tiny"_sl, DocumentFlags::kNone, t);
+        t.commit();
+    }
+
+    Record rec = s.get("big"_sl);
+    REQUIRE(rec.exists());
+    CHECK(rec.body() == bigBody);
+    CHECK(rec.version() == "1-aa"_sl);
+    CHECK(rec.flags() == DocumentFlags::kHasAttachments);
+    Record small = s.get("small"_sl);
+    CHECK(small.body() == "tiny"_sl);
+    CHECK(small.flags() == DocumentFlags::kNone);
+
+    // A meta-only read reports the uncompressed size, without decompressing:
+    Record meta = s.get("big"_sl, kMetaOnly);
+    CHECK(meta.bodySize() == bigBody.size);
+    CHECK(meta.flags() == DocumentFlags::kHasAttachments);
+    meta = s.get(meta.sequence(), kMetaOnly);
+    CHECK(meta.bodySize() == bigBody.size);
+    CHECK(s.get("small"_sl, kMetaOnly).bodySize() == 4);
+
+    auto recs = s.getMany({"small"_sl, "big"_sl});
+    CHECK(recs[0].body() == "tiny"_sl);
+    CHECK(recs[1].body() == bigBody);
+    CHECK(recs[1].flags() == DocumentFlags::kHasAttachments);
+
+    RecordEnumerator e(s);
+    REQUIRE(e.next());
+    CHECK(e->key() == "big"_sl);
+    CHECK(e->body() == bigBody);
+    REQUIRE(e.next());
+    CHECK(e->key() == "small"_sl);
+    CHECK(e->body() == "tiny"_sl);
+    CHECK_FALSE(e.next());
+
+    RecordEnumerator::Options opts;
+    opts.contentOptions = kMetaOnly;
+    RecordEnumerator metaEnum(s, opts);
+    REQUIRE(metaEnum.next());
+    CHECK(metaEnum->bodySize() == bigBody.size);
+    CHECK(metaEnum->flags() == DocumentFlags::kHasAttachments);
+}
+
+
 N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile Conditional Write", "[DataFile]") {
     KeyStore &s = db->getKeyStore("store");
     alloc_slice key("key");
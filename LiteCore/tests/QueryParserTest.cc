@@ -24,8 +24,9 @@ static string parse(string json) {
     return qp.SQL();
 }
 
-static string parseWhere(string json) {
+static string parseWhere(string json, const set<string> &indexed = {}) {
     QueryParser qp("kv_default");
+    qp.setIndexedExpressions(indexed);
     alloc_slice fleece = JSONConverter::convertJSON(json5(json));
     qp.parseJustExpression(Value::fromTrustedData(fleece));
     return qp.SQL();
@@ -69,6 +70,10 @@ TEST_CASE("QueryParser basic", "[Query]") {
           == "fl_value(body, 'name') IN ('Webbis', 'Wowbagger')");
     CHECK(parseWhere("['NOT IN', ['.', 'name'], ['[]', 'Webbis', 'Wowbagger']]")
           == "fl_value(body, 'name') NOT IN ('Webbis', 'Wowbagger')");
+    CHECK(parseWhere("['IN', ['.', 'name'], ['$', 'names']]")
+          == "fl_value(body, 'name') IN (SELECT value FROM fl_each_param($_names))");
+    CHECK(parseWhere("['NOT IN', ['._id'], ['$ids']]")
+          == "key NOT IN (SELECT value FROM fl_each_param($_ids))");
     CHECK(parseWhere("['IN', 'licorice', ['.', 'candies']]")
           == "array_contains(fl_value(body, 'candies'), 'licorice')");
     CHECK(parseWhere("['NOT IN', 7, ['.', 'ages']]")
@@ -129,6 +134,39 @@ TEST_CASE("QueryParser ANY complex", "[Query]") {
 }
 
 
+TEST_CASE("QueryParser ANY with array index", "[Query]") {
+    auto parseIndexed = [](string json) {
+        QueryParser qp("kv_default");
+        qp.setArrayIndexedProperties({"names"});
+        alloc_slice fleece = JSONConverter::convertJSON(json5(json));
+        qp.parseJustExpression(Value::fromTrustedData(fleece));
+        return qp.SQL();
+    };
+    CHECK(parseIndexed("['ANY', 'X', ['.', 'names'], ['=', ['?', 'X'], 'Smith']]")
+          == "kv_default.key IN (SELECT key FROM \"kv_default::unnest.names\" AS _X WHERE _X.value = 'Smith')");
+    // Properties of the variable aren't in the index:
+    CHECK(parseIndexed("['ANY', 'X', ['.', 'names'], ['=', ['?', 'X', 'last'], 'Smith']]")
+          == "EXISTS (SELECT 1 FROM fl_each(body, 'names') AS _X WHERE fl_value(_X.pointer, 'last') = 'Smith')");
+    // ...and an array or dict element can't be passed to a function, since the index doesn't
+    // keep the subtype that marks it as Fleece:
+    CHECK(parseIndexed("['ANY', 'X', ['.', 'names'], ['isobject()', ['?X']]]")
+          == "EXISTS (SELECT 1 FROM fl_each(body, 'names') AS _X WHERE isobject(_X.value))");
+    CHECK(parseIndexed("['ANY', 'X', ['.', 'names'], ['=', ['length()', ['?X']], 5]]")
+          == "EXISTS (SELECT 1 FROM fl_each(body, 'names') AS _X WHERE N1QL_length(_X.value) = 5)");
+    // Neither is EVERY:
+    CHECK(parseIndexed("['EVERY', 'X', ['.', 'names'], ['=', ['?', 'X'], 'Smith']]")
+          == "NOT EXISTS (SELECT 1 FROM fl_each(body, 'names') AS _X WHERE NOT (_X.value = 'Smith'))");
+}
+
+
+TEST_CASE("QueryParser WITHIN", "[Query]") {
+    CHECK(parseWhere("['WITHIN', [['.lat'], ['.lon']], [10, 20], [30, 40]]")
+          == "(kv_default.sequence IN (SELECT id FROM \"kv_default::geo:[['.lat'],['.lon']]\" "
+             "WHERE max0 >= 10 AND min0 <= 30 AND max1 >= 20 AND min1 <= 40) "
+             "AND fl_value(body, 'lat') BETWEEN 10 AND 30 AND fl_value(body, 'lon') BETWEEN 20 AND 40)");
+}
+
+
 TEST_CASE("QueryParser SELECT", "[Query]") {
     CHECK(parseWhere("['SELECT', {WHAT: ['._id'],\
                                  WHERE: ['=', ['.', 'last'], 'Smith'],\
@@ -160,6 +198,15 @@ TEST_CASE("QueryParser SELECT FTS", "[Query]") {
           == "SELECT sequence, offsets(\"kv_default::.bio\"), key, sequence FROM kv_default JOIN \"kv_default::.bio\" AS FTS1 ON FTS1.rowid = kv_default.sequence WHERE (FTS1.text MATCH 'mobile') AND (flags & 1) = 0");
 }
 
+TEST_CASE("QueryParser SELECT FTS with sequence map", "[Query]") {
+    QueryParser qp("kv_default");
+    qp.setMappedFTSTables({"kv_default::.bio"});
+    alloc_slice fleece = JSONConverter::convertJSON(json5("['SELECT', {\
+                     WHERE: ['MATCH', ['.', 'bio'], 'mobile']}]"));
+    qp.parseJustExpression(Value::fromTrustedData(fleece));
+    CHECK(qp.SQL() == "SELECT sequence, offsets(\"kv_default::.bio\"), key, sequence FROM kv_default JOIN \"kv_default::.bio::seqs\" AS FTSSEQS1 ON FTSSEQS1.kvSequence = kv_default.sequence JOIN \"kv_default::.bio\" AS FTS1 ON FTS1.rowid = FTSSEQS1.ftsRowid WHERE (FTS1.text MATCH 'mobile') AND (flags & 1) = 0");
+}
+
 TEST_CASE("QueryParser SELECT WHAT", "[Query]") {
     CHECK(parseWhere("['SELECT', {WHAT: ['._id'], WHERE: ['=', ['.', 'last'], 'Smith']}]")
           == "SELECT key FROM kv_default WHERE (fl_value(body, 'last') = 'Smith') AND (flags & 1) = 0");
@@ -215,6 +262,101 @@ TEST_CASE("QueryParser Collate", "[Query][Collation]") {
 }
 
 
+TEST_CASE("QueryParser partial index", "[Query]") {
+    // A literal on the left of a comparison is moved to the right:
+    CHECK(parseWhere("['=', 'person', ['.type']]")
+          == "fl_value(body, 'type') = 'person'");
+    CHECK(parseWhere("['<', 18, ['.age']]")
+          == "fl_value(body, 'age') > 18");
+
+    QueryParser qp("kv_default");
+    alloc_slice what = JSONConverter::convertJSON(json5("[['.name']]"));
+    alloc_slice where = JSONConverter::convertJSON(json5("['=', 'person', ['.type']]"));
+    qp.writeCreateIndex("byName", Value::fromTrustedData(what)->asArray(),
+                        Value::fromTrustedData(where));
+    CHECK(qp.SQL() == "CREATE INDEX \"byName\" ON kv_default (fl_value(body, 'name')) "
+                      "WHERE (fl_value(body, 'type') = 'person') AND (flags & 1) = 0");
+}
+
+
+TEST_CASE("QueryParser materialized properties", "[Query]") {
+    // Operators and ORDER BY compare the column natively; result columns and function arguments
+    // get fl_materialized, to keep the Fleece subtype of arrays and dicts:
+    QueryParser qp("kv_default");
+    qp.setMaterializedProperties({"title", "tags"});
+    alloc_slice fleece = JSONConverter::convertJSON(json5(
+                "{WHAT: ['.book.title', ['array_length()', ['.book.tags']]], \
+                  FROM: [{as: 'book'}],\
+                 WHERE: ['>', ['.book.title'], 'M'], \
+              ORDER_BY: [['.book.title']]}"));
+    qp.parse(Value::fromTrustedData(fleece));
+    CHECK(qp.SQL() == "SELECT fl_materialized(\"book\".\"prop:title\"), "
+                             "array_length(fl_materialized(\"book\".\"prop:tags\")) "
+                        "FROM kv_default AS \"book\" "
+                       "WHERE (\"book\".\"prop:title\" > 'M') AND (\"book\".flags & 1) = 0 "
+                    "ORDER BY \"book\".\"prop:title\"");
+
+    // An index on the property indexes the column itself:
+    alloc_slice what = JSONConverter::convertJSON(json5("[['.title']]"));
+    qp.writeCreateIndex("byTitle", Value::fromTrustedData(what)->asArray());
+    CHECK(qp.SQL() == "CREATE INDEX \"byTitle\" ON kv_default (\"prop:title\")");
+}
+
+
+TEST_CASE("QueryParser index-friendly rewrites", "[Query]") {
+    // A LIKE pattern with a fixed prefix also gets range tests, for binary and NOCASE indexes:
+    const set<string> nameIndexed {"fl_value(body, 'name')",
+                                   "fl_value(body, 'name') COLLATE NOCASE"};
+    CHECK(parseWhere("['LIKE', ['.name'], 'abz%']", nameIndexed)
+          == "fl_value(body, 'name') LIKE 'abz%' "
+             "AND fl_value(body, 'name') >= 'ABZ' AND fl_value(body, 'name') < 'ab{' "
+             "AND fl_value(body, 'name') COLLATE NOCASE >= 'abz' "
+             "AND fl_value(body, 'name') COLLATE NOCASE < 'ab{'");
+    CHECK(parseWhere("['NOT', ['LIKE', ['.name'], 'x_y%']]", nameIndexed)
+          == "NOT (fl_value(body, 'name') LIKE 'x_y%' "
+             "AND fl_value(body, 'name') >= 'X' AND fl_value(body, 'name') < 'y' "
+             "AND fl_value(body, 'name') COLLATE NOCASE >= 'x' "
+             "AND fl_value(body, 'name') COLLATE NOCASE < 'y')");
+    // ...only for the kinds of index there are:
+    CHECK(parseWhere("['LIKE', ['.name'], 'abz%']", {"fl_value(body, 'name')"})
+          == "fl_value(body, 'name') LIKE 'abz%' "
+             "AND fl_value(body, 'name') >= 'ABZ' AND fl_value(body, 'name') < 'ab{'");
+    CHECK(parseWhere("['LIKE', ['.name'], 'abz%']", {"fl_value(body, 'name') COLLATE NOCASE"})
+          == "fl_value(body, 'name') LIKE 'abz%' "
+             "AND fl_value(body, 'name') COLLATE NOCASE >= 'abz' "
+             "AND fl_value(body, 'name') COLLATE NOCASE < 'ab{'");
+    // ...but not if there's no index, no prefix, or the prefix could match a number:
+    CHECK(parseWhere("['LIKE', ['.name'], 'abz%']")
+          == "fl_value(body, 'name') LIKE 'abz%'");
+    CHECK(parseWhere("['LIKE', ['.name'], '%abc']", nameIndexed)
+          == "fl_value(body, 'name') LIKE '%abc'");
+    CHECK(parseWhere("['LIKE', ['.zip'], '94%']", {"fl_value(body, 'zip')"})
+          == "fl_value(body, 'zip') LIKE '94%'");
+    CHECK(parseWhere("['LIKE', ['.name'], ['$PATTERN']]", nameIndexed)
+          == "fl_value(body, 'name') LIKE $_PATTERN");
+
+    // lower(x) = 'literal' also gets a NOCASE equality test, if x has a NOCASE index:
+    CHECK(parseWhere("['=', ['lower()', ['.name']], 'jones']", nameIndexed)
+          == "fl_value(body, 'name') COLLATE NOCASE = 'jones' "
+             "AND N1QL_lower(fl_value(body, 'name')) = 'jones'");
+    CHECK(parseWhere("['=', 'jones', ['lower()', ['.name']]]", nameIndexed)
+          == "fl_value(body, 'name') COLLATE NOCASE = 'jones' "
+             "AND N1QL_lower(fl_value(body, 'name')) = 'jones'");
+    // ...but not if there's no such index:
+    CHECK(parseWhere("['=', ['lower()', ['.name']], 'jones']", {"fl_value(body, 'name')"})
+          == "N1QL_lower(fl_value(body, 'name')) = 'jones'");
+    CHECK(parseWhere("['=', ['lower()', ['.nickname']], 'jones']", nameIndexed)
+          == "N1QL_lower(fl_value(body, 'nickname')) = 'jones'");
+    // ...or if the literal isn't safe to compare with NOCASE, or a Unicode collation is active:
+    CHECK(parseWhere("['=', ['lower()', ['.name']], 'Jones']", nameIndexed)
+          == "N1QL_lower(fl_value(body, 'name')) = 'Jones'");
+    CHECK(parseWhere("['=', ['lower()', ['.name']], 'kim']", nameIndexed)
+          == "N1QL_lower(fl_value(body, 'name')) = 'kim'");
+    CHECK(parseWhere("['COLLATE', {unicode: true}, ['=', ['lower()', ['.name']], 'jones']]", nameIndexed)
+          == "N1QL_lower(fl_value(body, 'name')) COLLATE LCUnicode____ = 'jones'");
+}
+
+
 TEST_CASE("QueryParser errors", "[Query][!throws]") {
     mustFail("['poop()', 1]");
     mustFail("['power()', 1]");
@@ -224,6 +224,90 @@ TEST_CASE_METHOD(DataFileTestFixture, "Query null value", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(DataFileTestFixture, "Query batch", "[Query]") {
+    {
+        Transaction t(store->dataFile());
+        for (int i = 1; i <= 10; i++) {
+            fleece::Encoder enc;
+            enc.beginDictionary();
+            enc.writeKey("num");
+            enc.writeInt(i);
+            if (i % 2 == 0) {
+                enc.writeKey("str");
+                enc.writeString(stringWithFormat("s%d", i));
+            }
+            enc.writeKey("mixed");          // ints and doubles
+            if (i % 2 == 0)
+                enc.writeDouble(i + 0.5);
+            else
+                enc.writeInt(i);
+            enc.writeKey("any");            // strings, then ints
+            if (i <= 2)
+                enc.writeString("x");
+            else
+                enc.writeInt(i);
+            enc.writeKey("big");            // ints too big for doubles, and doubles
+            if (i % 2 == 0)
+                enc.writeDouble(i + 0.5);
+            else
+                enc.writeInt((1ll << 60) + i);
+            enc.endDictionary();
+            alloc_slice body = enc.extractOutput();
+            store->set(slice(stringWithFormat("rec-%03d", i)), body, t);
+        }
+        t.commit();
+    }
+
+    Retained<Query> query{ store->compileQuery(json5(
+                    "{WHAT: [['.num'], ['.str'], ['.mixed'], ['.any'], ['.big']],"
+                    " ORDER_BY: [['.num']]}")) };
+    unique_ptr<QueryEnumerator> e(query->createEnumerator());
+    QueryBatch batch;
+    REQUIRE(e->nextBatch(batch, 4));
+    REQUIRE(batch.rowCount == 4);
+    REQUIRE(batch.columns.size() == 5);
+
+    auto &num = batch.columns[0];
+    CHECK(num.type == QueryBatch::kIntColumn);
+    CHECK(num.ints == (vector<int64_t>{1, 2, 3, 4}));
+
+    auto &str = batch.columns[1];
+    CHECK(str.type == QueryBatch::kStringColumn);
+    CHECK(str.isNull == (vector<uint8_t>{1, 0, 1, 0}));
+    CHECK(str.offsets == (vector<uint32_t>{0, 0, 2, 2, 4}));
+    CHECK(string(str.data.begin(), str.data.end()) == "s2s4");
+
+    auto &mixed = batch.columns[2];
+    CHECK(mixed.type == QueryBatch::kDoubleColumn);
+    CHECK(mixed.doubles == (vector<double>{1.0, 2.5, 3.0, 4.5}));
+
+    auto &any = batch.columns[3];
+    CHECK(any.type == QueryBatch::kFleeceColumn);
+    REQUIRE(any.offsets.size() == 5);
+    auto item = [&](size_t row) {
+        return Value::fromData(slice(any.data.data() + any.offsets[row],
+                                     any.offsets[row + 1] - any.offsets[row]));
+    };
+    CHECK(item(1)->asString() == "x"_sl);
+    CHECK(item(3)->asInt() == 4);
+
+    auto &big = batch.columns[4];
+    CHECK(big.type == QueryBatch::kFleeceColumn);
+    REQUIRE(big.offsets.size() == 5);
+    CHECK(Value::fromData(slice(big.data.data() + big.offsets[0],
+                                big.offsets[1] - big.offsets[0]))->asInt() == (1ll << 60) + 1);
+
+    REQUIRE(e->nextBatch(batch, 4));
+    CHECK(batch.rowCount == 4);
+    CHECK(batch.columns[0].ints == (vector<int64_t>{5, 6, 7, 8}));
+    CHECK(batch.columns[3].type == QueryBatch::kIntColumn);
+    REQUIRE(e->nextBatch(batch, 4));
+    CHECK(batch.rowCount == 2);
+    CHECK(!e->nextBatch(batch, 4));
+    CHECK(batch.rowCount == 0);
+}
+
+
 TEST_CASE_METHOD(DataFileTestFixture, "Query FullText", "[Query]") {
     // Add some text to the database:
     static const char* strings[] = {"FTS5 is an SQLite virtual table module that provides full-text search functionality to database applications.",
@@ -264,7 +348,10 @@ TEST_CASE_METHOD(DataFileTestFixture, "Query FullText", "[Query]") {
                     WHAT: [['.sentence']]}]")) };
     REQUIRE(query != nullptr);
     unsigned rows = 0;
-    int expectedOrder[] = {1, 2, 0, 4};
+    // BM25 ranks the short sentence with "searching" above the longer one that has one "search";
+    // without English stemming, "searching" doesn't match at all:
+    bool english = (strcmp(options.stemmer, "en") == 0);
+    int expectedOrder[] = {1, 2, english ? 4 : 0, 0};
     int expectedTerms[] = {3, 3, 1, 1};
     unique_ptr<QueryEnumerator> e(query->createEnumerator());
     while (e->next()) {
@@ -275,12 +362,12 @@ TEST_CASE_METHOD(DataFileTestFixture, "Query FullText", "[Query]") {
         CHECK(e->fullTextTerms().size() == expectedTerms[rows]);
         for (auto term : e->fullTextTerms()) {
             auto word = string(strings[expectedOrder[rows]] + term.start, term.length);
-            CHECK(word == (rows == 3 ? "searching" : "search"));
+            CHECK(word == (expectedOrder[rows] == 4 ? "searching" : "search"));
         }
         CHECK((string)query->getMatchedText(e->fullTextID()) == strings[expectedOrder[rows]]);
         ++rows;
     }
-    if (strcmp(options.stemmer, "en") == 0) {
+    if (english) {
         CHECK(rows == 4);
     } else {
         // Non-English stemmer will not find "searching" in the 4th document
@@ -292,6 +379,56 @@ TEST_CASE_METHOD(DataFileTestFixture, "Query FullText", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(DataFileTestFixture, "Query FullText BM25 ranking", "[Query]") {
+    static const char* strings[] = {"apple banana cherry date elderberry fig grape honeydew",
+                                    "banana cherry",
+                                    "apple banana cherry date",
+                                    "apple apple apple banana"};
+    {
+        Transaction t(store->dataFile());
+        for (int i = 0; i < sizeof(strings)/sizeof(strings[0]); i++) {
+            string docID = stringWithFormat("rec-%03d", i);
+            fleece::Encoder enc;
+            enc.beginDictionary();
+            enc.writeKey("text");
+            enc.writeString(strings[i]);
+            enc.endDictionary();
+            alloc_slice body = enc.extractOutput();
+            store->set(slice(docID), body, t);
+        }
+        t.commit();
+    }
+    store->createIndex("text"_sl, "[[\".text\"]]"_sl, KeyStore::kFullTextIndex);
+
+    // More hits rank higher; with equal hits, the shorter text ranks higher:
+    Retained<Query> query{ store->compileQuery(json5(
+        "['SELECT', {WHERE: ['MATCH', ['.text'], 'apple'],\
+                    ORDER_BY: [['DESC', ['rank()', ['.text']]]],\
+                    WHAT: [['._id'], ['rank()', ['.text']]]}]")) };
+    unique_ptr<QueryEnumerator> e(query->createEnumerator());
+    vector<string> docIDs;
+    double lastRank = 1e9;
+    while (e->next()) {
+        docIDs.push_back(e->columns()[0]->asString().asString());
+        double rank = e->columns()[1]->asDouble();
+        CHECK(rank > 0.0);
+        CHECK(rank < lastRank);
+        lastRank = rank;
+    }
+    CHECK(docIDs == (vector<string>{"rec-003", "rec-002", "rec-000"}));
+
+    // Top-k:
+    query = store->compileQuery(json5(
+        "['SELECT', {WHERE: ['MATCH', ['.text'], 'apple'],\
+                    ORDER_BY: [['DESC', ['rank()', ['.text']]]],\
+                    WHAT: [['._id']], LIMIT: 1}]"));
+    e.reset(query->createEnumerator());
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asString() == "rec-003"_sl);
+    CHECK(!e->next());
+}
+
+
 TEST_CASE_METHOD(DataFileTestFixture, "Query refresh", "[Query]") {
     addNumberedDocs(store);
     Retained<Query> query{ store->compileQuery(json5(
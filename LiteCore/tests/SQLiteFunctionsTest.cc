@@ -174,6 +174,18 @@ N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite fl_each array", "[Query][fl_
             == (vector<string>{"2", "2", "2", "3"}));
     CHECK(query("SELECT DISTINCT kv.key FROM kv, fl_each(kv.body) WHERE fl_each.value = 4")
             == (vector<string>{"one", "two"}));
+
+    // Integers and floats are compared exactly, even where a double can't hold the integer:
+    insert("big",   "[9007199254740993]");
+    CHECK(query("SELECT kv.key FROM kv, fl_each(kv.body) WHERE kv.key = 'big'"
+                " AND fl_each.value = 9007199254740992.0")
+            == (vector<string>{}));
+    CHECK(query("SELECT kv.key FROM kv, fl_each(kv.body) WHERE kv.key = 'big'"
+                " AND fl_each.value > 9007199254740992.0")
+            == (vector<string>{"big"}));
+    CHECK(query("SELECT kv.key FROM kv, fl_each(kv.body) WHERE kv.key = 'big'"
+                " AND fl_each.value = 9007199254740993")
+            == (vector<string>{"big"}));
 }
 
 
@@ -309,6 +321,40 @@ N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "N1QL string functions", "[Query]")
     CHECK(query("SELECT N1QL_trim('  x  ')") == (vector<string>{"x"}));
 }
 
+
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "N1QL regexp functions", "[Query]") {
+    // Literal patterns, which don't use std::regex:
+    CHECK(query("SELECT regexp_like('hello world', 'o w')") == (vector<string>{"1"}));
+    CHECK(query("SELECT regexp_like('hello world', '^hello')") == (vector<string>{"1"}));
+    CHECK(query("SELECT regexp_like('hello world', '^world')") == (vector<string>{"0"}));
+    CHECK(query("SELECT regexp_like('hello world', 'world$')") == (vector<string>{"1"}));
+    CHECK(query("SELECT regexp_like('hello world', '^hello$')") == (vector<string>{"0"}));
+    CHECK(query("SELECT regexp_like('a.b', 'a\\.b')") == (vector<string>{"1"}));
+    CHECK(query("SELECT regexp_position('hello world', 'wor')") == (vector<string>{"6"}));
+    CHECK(query("SELECT regexp_position('hello world', 'x')") == (vector<string>{"-1"}));
+    CHECK(query("SELECT regexp_replace('a-b-c', '-', '+')") == (vector<string>{"a+b+c"}));
+    CHECK(query("SELECT regexp_replace('a-b-c', '-', '+', 1)") == (vector<string>{"a+b-c"}));
+
+    // Real regular expressions:
+    CHECK(query("SELECT regexp_like('hello world', 'w.r')") == (vector<string>{"1"}));
+    CHECK(query("SELECT regexp_like('hello world', '^h.*d$')") == (vector<string>{"1"}));
+    CHECK(query("SELECT regexp_like('hello world', '\\d')") == (vector<string>{"0"}));
+    CHECK(query("SELECT regexp_position('hello world', 'o+ ')") == (vector<string>{"4"}));
+    CHECK(query("SELECT regexp_replace('a1b22c', '[0-9]+', '#')") == (vector<string>{"a#b#c"}));
+    CHECK(query("SELECT regexp_replace('abc', 'x', '#')") == (vector<string>{"abc"}));
+    CHECK(query("SELECT regexp_replace('a-b', '(a)-(b)', '$2-$1')") == (vector<string>{"b-a"}));
+
+    // A non-string input gives a null result:
+    CHECK(query("SELECT regexp_like(17, '7')") == (vector<string>{"MISSING"}));
+    CHECK(query("SELECT regexp_replace(17, '7', '#')") == (vector<string>{"MISSING"}));
+    CHECK(query("SELECT regexp_replace(NULL, '7', '#')") == (vector<string>{"MISSING"}));
+
+    // Non-constant patterns:
+    CHECK(query("SELECT regexp_like('hello', p) FROM (SELECT 'l+' AS p UNION ALL SELECT '^h' "
+                "UNION ALL SELECT 'l+' UNION ALL SELECT 'z')")
+          == (vector<string>{"1", "1", "1", "0"}));
+}
+
 #if __APPLE__ || defined(_MSC_VER) || LITECORE_USES_ICU //FIXME: collator isn't available on all platforms yet
 TEST_CASE("Unicode collation", "[Query][Collation]") {
     struct {slice a; slice b; int result; bool caseSensitive; bool diacriticSensitive;} tests[] = {
@@ -197,3 +197,102 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "VersionedDocument Conflict", "[Ver
     v.updateMeta();
     REQUIRE(!v.isConflicted());
 }
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "VersionedDocument StoredHistory", "[VersionedDocument]") {
+    string body1 = "{\"hello\":1}", body2 = "{\"hello\":2}", body3 = "{\"hello\":3}";
+    revidBuffer revID1("1-1111"_sl), revID2("2-2222"_sl), revID3("3-3333"_sl), revID4("4-4444"_sl);
+    {
+        Transaction t(db);
+        VersionedDocument v(*store, "foo"_sl);
+        int httpStatus;
+        auto rev1 = v.insert(revID1, body1, Rev::kKeepBody, nullptr, false, httpStatus);
+        auto rev2 = v.insert(revID2, body2, (Rev::Flags)0, rev1, false, httpStatus);
+        v.insert(revID3, body3, (Rev::Flags)0, rev2, false, httpStatus);
+        REQUIRE(httpStatus == 201);
+        REQUIRE(v.save(t));
+        CHECK(v.hasStoredHistory());
+        t.commit();
+    }
+
+    // The record holds only the current revision:
+    Record rec = store->get("foo"_sl);
+    CHECK((rec.flags() & DocumentFlags::kHasHistory));
+    CHECK(RevTree(rec.body(), rec.sequence()).size() == 1);
+
+    VersionedDocument v(*store, rec);
+    CHECK(!v.historyLoaded());
+    const Rev *current = v.currentRevision();
+    CHECK(current->revID == revID3);
+    CHECK(current->body() == slice(body3));
+    CHECK(!v.historyLoaded());
+
+    // Accessing an older revision loads the rest of the tree:
+    const Rev *rev1 = v.get(revID1);
+    REQUIRE(rev1);
+    CHECK(v.historyLoaded());
+    CHECK(v.size() == 3);
+    CHECK(v.currentRevision() == current);
+    CHECK(current->body() == slice(body3));
+    CHECK(rev1->body() == slice(body1));
+    REQUIRE(current->parent);
+    CHECK(current->parent->revID == revID2);
+    CHECK(current->parent->parent == rev1);
+
+    // Saving again rewrites both parts:
+    {
+        Transaction t(db);
+        int httpStatus;
+        v.insert(revID4, "{}"_sl, (Rev::Flags)0, current, false, httpStatus);
+        REQUIRE(httpStatus == 201);
+        REQUIRE(v.save(t));
+        t.commit();
+    }
+    VersionedDocument v2(*store, "foo"_sl);
+    CHECK(v2.currentRevision()->revID == revID4);
+    REQUIRE(v2.currentRevision()->parent == nullptr);
+    CHECK(v2.size() == 4);
+    CHECK(v2.currentRevision()->parent->revID == revID3);
+    CHECK(v2.get(revID1)->body() == slice(body1));
+
+    // Purging every revision deletes the stored history too:
+    {
+        Transaction t(db);
+        v2.purgeAll();
+        REQUIRE(v2.save(t));
+        t.commit();
+    }
+    CHECK(!VersionedDocument::historyStore(*store).get("foo"_sl).exists());
+}
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "VersionedDocument LazyDecode", "[VersionedDocument]") {
+    // Store a whole tree in the record, the way it was done before history was split out:
+    string body1 = "{\"hello\":1}", body2 = "{\"hello\":2}";
+    revidBuffer revID1("1-1111"_sl), revID2("2-2222"_sl);
+    RevTree tree;
+    int httpStatus;
+    auto rev1 = tree.insert(revID1, body1, Rev::kKeepBody, nullptr, false, httpStatus);
+    tree.insert(revID2, body2, (Rev::Flags)0, rev1, false, httpStatus);
+    REQUIRE(httpStatus == 201);
+    {
+        Transaction t(db);
+        store->set("foo"_sl, revID2, tree.encode(), DocumentFlags::kNone, t);
+        t.commit();
+    }
+
+    VersionedDocument v(*store, "foo"_sl);
+    CHECK(!v.hasStoredHistory());
+    CHECK(!v.historyLoaded());
+    const Rev *current = v.currentRevision();
+    CHECK(current->revID == revID2);
+    CHECK(current->body() == slice(body2));
+    CHECK(current->parent == nullptr);
+
+    CHECK(v.size() == 2);
+    CHECK(v.historyLoaded());
+    CHECK(v.currentRevision() == current);
+    REQUIRE(current->parent);
+    CHECK(current->parent->revID == revID1);
+    CHECK(current->parent->body() == slice(body1));
+}
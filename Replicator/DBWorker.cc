@@ -383,15 +383,36 @@ namespace litecore { namespace repl {
             }
         }
 
+        // Look up all the documents at once, instead of one query per entry:
+        size_t count = changes.count();
+        vector<C4String> docIDs(count);
+        int i = -1;
+        for (auto item : changes)
+            docIDs[++i] = item.asArray()[proposed ? 0 : 1].asString();
+        vector<C4DocumentInfo> infos;
+        vector<C4Document*> docs;
+        C4SliceResult revIDStorage = {};
+        C4Error err;
+        bool gotDocs;
+        if (proposed) {
+            infos.resize(count);
+            gotDocs = c4db_getDocInfos(_db, docIDs.data(), count, infos.data(), &revIDStorage, &err);
+        } else {
+            docs.resize(count);
+            gotDocs = c4db_getDocs(_db, docIDs.data(), count, docs.data(), &err);
+        }
+        if (!gotDocs)
+            gotError(err);
+
         MessageBuilder response(req);
         response["maxHistory"_sl] = c4db_getMaxRevTreeDepth(_db);
         response["blobs"_sl] = "true"_sl;
-        vector<bool> whichRequested(changes.count());
+        vector<bool> whichRequested(count);
         unsigned itemsWritten = 0, requested = 0;
         vector<alloc_slice> ancestors;
         auto &encoder = response.jsonBody();
         encoder.beginArray();
-        int i = -1;
+        i = -1;
         for (auto item : changes) {
             ++i;
             // Look up each revision in the `req` list:
@@ -408,7 +429,8 @@ namespace litecore { namespace repl {
                 slice parentRevID = change[2].asString();
                 if (parentRevID.size == 0)
                     parentRevID = nullslice;
-                int status = findProposedChange(docID, revID, parentRevID);
+                int status = findProposedChange((gotDocs ? &infos[i] : nullptr),
+                                                revID, parentRevID);
                 if (status == 0) {
                     ++requested;
                     whichRequested[i] = true;
@@ -422,7 +444,7 @@ namespace litecore { namespace repl {
 
             } else {
                 // "changes" entry: [sequence, docID, revID, deleted?, bodySize?]
-                if (!findAncestors(docID, revID, ancestors)) {
+                if (!findAncestors(docs[i], revID, ancestors)) {
                     // I don't have this revision, so request it:
                     ++requested;
                     whichRequested[i] = true;
@@ -438,6 +460,10 @@ namespace litecore { namespace repl {
         }
         encoder.endArray();
 
+        for (C4Document *doc : docs)
+            c4doc_free(doc);
+        c4slice_free(revIDStorage);
+
         if (callback)
             callback(whichRequested);
 
@@ -448,9 +474,10 @@ namespace litecore { namespace repl {
 
     // Returns true if revision exists; else returns false and sets ancestors to an array of
     // ancestor revisions I do have (empty if doc doesn't exist at all)
-    bool DBWorker::findAncestors(slice docID, slice revID, vector<alloc_slice> &ancestors) {
+    // Checks whether the doc (if it exists) has the revision. If not, collects the revIDs of
+    // the doc's revisions that could be ancestors of it.
+    bool DBWorker::findAncestors(C4Document *doc, slice revID, vector<alloc_slice> &ancestors) {
         C4Error err;
-        c4::ref<C4Document> doc = c4doc_get(_db, docID, true, &err);
         if (doc && c4doc_selectRevision(doc, revID, false, &err)) {
             // I already have this revision. Make sure it's marked as foreign:
             if (!(doc->selectedRev.flags & kRevIsForeign)) {
@@ -468,34 +495,27 @@ namespace litecore { namespace repl {
                 } while (c4doc_selectNextPossibleAncestorOf(doc, revID)
                          && ancestors.size() < kMaxPossibleAncestors);
             }
-        } else if (!isNotFoundError(err)) {
-            gotError(err);
         }
         return false;
     }
 
 
     // Checks whether the revID (if any) is really current for the given doc.
+    // `info` is NULL if the lookup failed.
     // Returns an HTTP-ish status code: 0=OK, 409=conflict, 500=internal error
-    int DBWorker::findProposedChange(slice docID, slice revID, slice parentRevID) {
-        C4Error err;
-        //OPT: We don't need the document body, just its metadata, but there's no way to say that
-        c4::ref<C4Document> doc = c4doc_get(_db, docID, true, &err);
-        if (!doc) {
-            if (isNotFoundError(err)) {
-                // Doc doesn't exist; it's a conflict if the peer thinks it does:
-                return parentRevID ? 409 : 0;
-            } else {
-                gotError(err);
-                return 500;
-            }
-        } else if (slice(doc->revID) == revID) {
+    int DBWorker::findProposedChange(const C4DocumentInfo *info, slice revID, slice parentRevID) {
+        if (!info) {
+            return 500;
+        } else if (!(info->flags & kDocExists)) {
+            // Doc doesn't exist; it's a conflict if the peer thinks it does:
+            return parentRevID ? 409 : 0;
+        } else if (slice(info->revID) == revID) {
             // I already have this revision:
             return 304;
         } else if (!parentRevID) {
             // Peer is creating new doc; that's OK if doc is currently deleted:
-            return (doc->flags & kDocDeleted) ? 0 : 409;
-        } else if (slice(doc->revID) != parentRevID) {
+            return (info->flags & kDocDeleted) ? 0 : 409;
+        } else if (slice(info->revID) != parentRevID) {
             // Peer's revID isn't current, so this is a conflict:
             return 409;
         } else {
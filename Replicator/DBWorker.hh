@@ -94,9 +94,9 @@ namespace litecore { namespace repl {
         void writeRevWithLegacyAttachments(fleeceapi::Encoder&,
                                            fleeceapi::Dict rev,
                                            FLSharedKeys sk);
-        bool findAncestors(slice docID, slice revID,
+        bool findAncestors(C4Document *doc, slice revID,
                            std::vector<alloc_slice> &ancestors);
-        int findProposedChange(slice docID, slice revID, slice parentRevID);
+        int findProposedChange(const C4DocumentInfo *info, slice revID, slice parentRevID);
 
         static const size_t kMaxPossibleAncestors = 10;
 